@@ -0,0 +1,92 @@
+// Measures how parallel_read() scales with the number of threads on a large
+// generated source file of independent top-level forms.
+//
+//   parallel_read_bench [size_in_mb] [max_threads]
+
+#include <fmt/core.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <thread>
+
+#include "guci/parse/parallel_reader.hpp"
+#include "guci/parse/reader.hpp"
+
+namespace {
+
+std::string generate_source(std::size_t bytes) {
+  std::mt19937 gen{2020};
+  std::string out;
+  out.reserve(bytes + 256);
+  for (std::size_t i = 0; out.size() < bytes; ++i) {
+    switch (gen() % 4) {
+      case 0:
+        out += fmt::format("(+ {} (* x {}) (- (* {} y) 3))\n", i, gen() % 97,
+                           gen() % 1000);
+        break;
+      case 1:
+        out += fmt::format("(let name{} \"value ( {} \\\" ) with escapes\")\n",
+                           i, gen());
+        break;
+      case 2:
+        out += fmt::format("(eval (+ a (* b c)) a {} b {} c {})\n", gen() % 50,
+                           gen() % 50, gen() % 50);
+        break;
+      default:
+        out += "(((nested (list of (identifiers and 1 2 3)))))\n";
+        break;
+    }
+  }
+  return out;
+}
+
+template <typename F>
+double seconds(F&& f) {
+  auto const start = std::chrono::steady_clock::now();
+  f();
+  std::chrono::duration<double> const d =
+      std::chrono::steady_clock::now() - start;
+  return d.count();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  std::size_t const megabytes = argc > 1 ? std::atoi(argv[1]) : 128;
+  std::size_t const max_threads =
+      argc > 2 ? std::atoi(argv[2])
+               : std::max(1u, std::thread::hardware_concurrency());
+
+  std::string const source = generate_source(megabytes << 20);
+  fmt::print("input: {:.1f} MB, hardware threads: {}\n",
+             source.size() / double(1 << 20),
+             std::thread::hardware_concurrency());
+
+  std::size_t forms = 0;
+  double const split = seconds(
+      [&] { forms = guci::find_split_points(source, max_threads * 8).size(); });
+  fmt::print("boundary pre-pass: {:.3f} s\n", split);
+
+  std::size_t expected_forms = 0;
+  double const sequential = seconds(
+      [&] { expected_forms = guci::read_all(source).value().size(); });
+  fmt::print("{:>8} {:>10} {:>10} {:>8}\n", "threads", "seconds", "MB/s",
+             "speedup");
+  fmt::print("{:>8} {:>10.3f} {:>10.1f} {:>8}\n", "seq", sequential,
+             source.size() / sequential / (1 << 20), "1.00");
+
+  for (std::size_t threads = 1; threads <= max_threads; threads *= 2) {
+    double const t = seconds([&] {
+      auto result = guci::parallel_read(source, threads).value();
+      if (result.size() != expected_forms) std::abort();
+    });
+    fmt::print("{:>8} {:>10.3f} {:>10.1f} {:>8.2f}\n", threads, t,
+               source.size() / t / (1 << 20), sequential / t);
+    if (threads < max_threads and threads * 2 > max_threads) {
+      threads = max_threads / 2;
+    }
+  }
+}
@@ -0,0 +1,199 @@
+// Measures how fast a SessionServer answers many clients at once. Every
+// client sends the same form over and over, waiting for each answer, and
+// the throughput and the percentiles of the time from sending a form to
+// reading its answer are printed as JSON on stdout.
+//
+//   server_load_bench [--socket PATH] [--clients N] [--requests N]
+//                     [--threads N] [--preload FILE] [--form FORM]
+//                     [--reconnect]
+//
+// Without --socket, the benchmark serves the definitions of --preload, or
+// a `fib`, itself with --threads threads on a socket in the temporary
+// directory. --reconnect opens a session per form, as a client that starts
+// a process per request would.
+
+#include <fmt/core.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <numeric>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "bench/json.hpp"
+#include "guci/eval/session.hpp"
+#include "guci/server/server.hpp"
+#include "guci/utils/mapped_file.hpp"
+
+namespace {
+
+using guci::bench::json_string;
+using Clock = std::chrono::steady_clock;
+
+constexpr std::string_view kDefaultPreload =
+    "(define fib (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))";
+
+struct Options {
+  std::optional<std::string> socket;
+  std::size_t clients = 32;
+  std::size_t requests = 200;
+  std::size_t threads = std::max(std::thread::hardware_concurrency(), 1u);
+  std::optional<std::string> preload;
+  std::string form = "(fib 15)";
+  bool reconnect = false;
+};
+
+struct Client {
+  std::vector<double> latencies_us;
+  std::size_t errors = 0;
+};
+
+void run_client(Options const& options, std::string const& path,
+                std::atomic<bool> const& go, Client& out) {
+  out.latencies_us.reserve(options.requests);
+  std::optional<guci::SessionClient> client;
+  while (not go) std::this_thread::yield();
+  for (std::size_t i = 0; i < options.requests; ++i) {
+    auto const start = Clock::now();
+    if (not client or options.reconnect) {
+      auto connected = guci::SessionClient::connect(path);
+      if (not connected) {
+        ++out.errors;
+        continue;
+      }
+      client.emplace(std::move(connected).value());
+    }
+    if (not client->call(options.form)) {
+      ++out.errors;
+      client.reset();
+      continue;
+    }
+    std::chrono::duration<double, std::micro> const d = Clock::now() - start;
+    out.latencies_us.push_back(d.count());
+  }
+}
+
+double percentile(std::vector<double> const& sorted, double p) {
+  if (sorted.empty()) return 0;
+  auto const i = static_cast<std::size_t>(p * (sorted.size() - 1) + 0.5);
+  return sorted[i];
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  for (int i = 1; i < argc; ++i) {
+    std::string_view const arg = argv[i];
+    bool const has_value = i + 1 < argc;
+    if (arg == "--socket" and has_value) {
+      options.socket = argv[++i];
+    } else if (arg == "--clients" and has_value) {
+      options.clients = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--requests" and has_value) {
+      options.requests = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--threads" and has_value) {
+      options.threads = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--preload" and has_value) {
+      options.preload = argv[++i];
+    } else if (arg == "--form" and has_value) {
+      options.form = argv[++i];
+    } else if (arg == "--reconnect") {
+      options.reconnect = true;
+    } else {
+      fmt::print(stderr,
+                 "usage: {} [--socket PATH] [--clients N] [--requests N] "
+                 "[--threads N] [--preload FILE] [--form FORM] "
+                 "[--reconnect]\n",
+                 argv[0]);
+      return 1;
+    }
+  }
+
+  guci::SharedEnvironment environment;
+  std::unique_ptr<guci::SessionServer> server;
+  std::string path;
+  if (options.socket) {
+    path = *options.socket;
+  } else {
+    std::string preload{kDefaultPreload};
+    if (options.preload) {
+      auto const file = guci::MappedFile::open(*options.preload);
+      if (not file) {
+        fmt::print(stderr, "{}: {}\n", *options.preload,
+                   file.error().message());
+        return 1;
+      }
+      preload = file.value().view();
+    }
+    if (auto loaded = environment.load(preload); not loaded) {
+      fmt::print(stderr, "preload: {}\n", loaded.error().msg());
+      return 1;
+    }
+    path = std::filesystem::temp_directory_path() /
+           fmt::format("guci-server-load-{}.sock", ::getpid());
+    auto started = guci::SessionServer::start(environment, path,
+                                              options.threads);
+    if (not started) {
+      fmt::print(stderr, "{}: {}\n", path, started.error().message());
+      return 1;
+    }
+    server = std::move(started).value();
+  }
+
+  std::vector<Client> clients(options.clients);
+  std::atomic<bool> go{false};
+  std::vector<std::thread> threads;
+  for (Client& c : clients) {
+    threads.emplace_back([&] { run_client(options, path, go, c); });
+  }
+  auto const start = Clock::now();
+  go = true;
+  for (auto& t : threads) t.join();
+  std::chrono::duration<double, std::milli> const wall = Clock::now() - start;
+
+  std::vector<double> latencies;
+  std::size_t errors = 0;
+  for (Client const& c : clients) {
+    latencies.insert(latencies.end(), c.latencies_us.begin(),
+                     c.latencies_us.end());
+    errors += c.errors;
+  }
+  std::sort(latencies.begin(), latencies.end());
+  double const mean =
+      latencies.empty()
+          ? 0
+          : std::accumulate(latencies.begin(), latencies.end(), 0.0) /
+                latencies.size();
+
+  guci::SessionServer::Stats const stats =
+      server != nullptr ? server->stats() : guci::SessionServer::Stats{};
+  if (server != nullptr) {
+    server.reset();
+    std::filesystem::remove(path);
+  }
+
+  fmt::print(
+      "{{\"form\": {}, \"clients\": {}, \"requests_per_client\": {}, "
+      "\"server_threads\": {}, \"reconnect\": {}, \"answered\": {}, "
+      "\"errors\": {}, \"wall_ms\": {:.3f}, \"throughput_rps\": {:.1f}, "
+      "\"latency_us\": {{\"mean\": {:.1f}, \"p50\": {:.1f}, \"p90\": {:.1f}, "
+      "\"p99\": {:.1f}, \"p999\": {:.1f}, \"max\": {:.1f}}}, "
+      "\"sessions\": {}}}\n",
+      json_string(options.form), options.clients, options.requests,
+      options.socket ? 0 : options.threads, options.reconnect,
+      latencies.size(), errors, wall.count(),
+      latencies.size() / (wall.count() / 1000), mean,
+      percentile(latencies, 0.5), percentile(latencies, 0.9),
+      percentile(latencies, 0.99), percentile(latencies, 0.999),
+      latencies.empty() ? 0 : latencies.back(), stats.sessions);
+}
@@ -0,0 +1,265 @@
+// Runs the gucilisp programs in bench/programs and reports, as JSON on
+// stdout, how long they take, how much memory they need and how many heap
+// allocations they make. Every program runs in its own child process so that
+// its peak RSS is not mixed up with the others'.
+//
+//   bench_suite [--repetitions N] [--no-jit] [--hash-cons] program.glisp...
+//
+// A repetition reads the whole program and evaluates every top-level form in
+// a fresh global context, with the printed results discarded. --hash-cons
+// has the reader intern what it reads in a fresh HashConsTable. Before that,
+// the printed results with every function compiled to native code as soon as
+// the JIT takes it are checked against those of the interpreter.
+
+#include <fmt/core.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "bench/json.hpp"
+#include "guci/eval/evaluator.hpp"
+#include "guci/parse/hash_cons.hpp"
+#include "guci/parse/reader.hpp"
+#include "guci/utils/mapped_file.hpp"
+
+namespace {
+
+std::atomic<std::uint64_t> allocations{0};
+std::atomic<std::uint64_t> allocated_bytes{0};
+bool hash_cons = false;
+
+}  // namespace
+
+void* operator new(std::size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+  if (void* p = std::malloc(size == 0 ? 1 : size)) return p;
+  throw std::bad_alloc{};
+}
+
+// kept out of line so that GCC does not pair inlined new and delete
+// expressions with malloc/free and flag them as mismatched
+[[gnu::noinline]] void operator delete(void* p) noexcept { std::free(p); }
+[[gnu::noinline]] void operator delete(void* p, std::size_t) noexcept {
+  std::free(p);
+}
+
+namespace {
+
+using guci::bench::json_string;
+struct Repetition {
+  double wall_ms;
+  std::uint64_t allocations;
+  std::uint64_t allocated_bytes;
+  std::size_t forms;
+  std::size_t errors;
+  guci::VirtualMachine::Stats vm;
+  guci::ValueHeap::Stats heap;
+  guci::HashConsTable::Stats hash_cons;
+  std::uint64_t memo_hits;
+  std::uint64_t memo_misses;
+  std::uint64_t tasks_submitted;
+  std::uint64_t tasks_stolen;
+};
+
+Repetition run_once(std::string_view source) {
+  allocations = 0;
+  allocated_bytes = 0;
+  guci::thread_vm().reset_stats();
+  auto const memo = guci::MemoCache::global().stats();
+  auto const tasks = guci::WorkStealingPool::global().stats();
+  auto const start = std::chrono::steady_clock::now();
+
+  Repetition r{};
+  guci::HashConsTable table;
+  guci::ReaderOptions options;
+  if (hash_cons) options.hash_cons = &table;
+  bool program_termination_requested = false;
+  guci::EvaluationContext ctx =
+      guci::make_global_context(program_termination_requested);
+  guci::Reader reader{guci::skip_shebang(source), options};
+  while (not program_termination_requested and not reader.at_end()) {
+    auto term = reader.read_term();
+    if (not term) {
+      ++r.errors;
+      break;
+    }
+    ++r.forms;
+    if (not guci::evaluate(ctx, term.value())) ++r.errors;
+  }
+
+  std::chrono::duration<double, std::milli> const d =
+      std::chrono::steady_clock::now() - start;
+  r.wall_ms = d.count();
+  r.allocations = allocations;
+  r.allocated_bytes = allocated_bytes;
+  r.vm = guci::thread_vm().stats();
+  r.heap = guci::ValueHeap::global().stats();
+  r.hash_cons = table.stats();
+  r.memo_hits = guci::MemoCache::global().stats().hits - memo.hits;
+  r.memo_misses = guci::MemoCache::global().stats().misses - memo.misses;
+  auto const pool = guci::WorkStealingPool::global().stats();
+  r.tasks_submitted = pool.submitted - tasks.submitted;
+  r.tasks_stolen = pool.stolen - tasks.stolen;
+  return r;
+}
+
+// The printed results of the forms of `source`, in a fresh global context.
+std::vector<std::string> results(std::string_view source) {
+  std::vector<std::string> out;
+  bool program_termination_requested = false;
+  guci::EvaluationContext ctx =
+      guci::make_global_context(program_termination_requested);
+  guci::Reader reader{guci::skip_shebang(source)};
+  while (not program_termination_requested and not reader.at_end()) {
+    auto term = reader.read_term();
+    if (not term) break;
+    out.push_back(guci::show_result(ctx, term.value()));
+  }
+  return out;
+}
+
+bool jit_matches_interpreter(std::string_view source) {
+  guci::VirtualMachine& vm = guci::thread_vm();
+  bool const jit = vm.jit();
+  vm.set_jit(false);
+  auto const interpreted = results(source);
+  vm.set_jit(true);
+  vm.set_jit_threshold(1);
+  auto const native = results(source);
+  vm.set_jit(jit);
+  vm.set_jit_threshold(guci::VirtualMachine::kDefaultJitThreshold);
+  return interpreted == native;
+}
+
+// Runs the repetitions of one program and returns its JSON fields, minus the
+// peak RSS that only the parent can see.
+std::string run_program(std::string const& path, int repetitions) {
+  auto const file = guci::MappedFile::open(path);
+  if (not file) {
+    return fmt::format("\"error\": {}",
+                       json_string(file.error().message()));
+  }
+  bool const verified = jit_matches_interpreter(file.value().view());
+
+  std::vector<Repetition> reps;
+  for (int i = 0; i < repetitions; ++i) {
+    reps.push_back(run_once(file.value().view()));
+  }
+
+  std::vector<double> times;
+  for (auto const& r : reps) times.push_back(r.wall_ms);
+  std::sort(times.begin(), times.end());
+  double const mean =
+      std::accumulate(times.begin(), times.end(), 0.0) / times.size();
+
+  // the first repetition also pays for interning the program's symbols, so
+  // the allocation counts are taken from the last one
+  Repetition const& last = reps.back();
+  return fmt::format(
+      "\"forms\": {}, \"errors\": {}, "
+      "\"wall_ms\": {{\"min\": {:.3f}, \"median\": {:.3f}, "
+      "\"mean\": {:.3f}, \"max\": {:.3f}}}, "
+      "\"allocations\": {}, \"allocated_bytes\": {}, "
+      "\"call_cache\": {{\"hits\": {}, \"misses\": {}}}, "
+      "\"tail_calls\": {}, "
+      "\"jit\": {{\"enabled\": {}, \"native_calls\": {}, "
+      "\"bailouts\": {}, \"matches_interpreter\": {}}}, "
+      "\"value_heap\": {{\"mapped_bytes\": {}, \"released_bytes\": {}}}, "
+      "\"hash_cons\": {{\"enabled\": {}, \"entries\": {}, "
+      "\"dedup_ratio\": {:.3f}, \"stored_bytes\": {}, "
+      "\"saved_bytes\": {}}}, "
+      "\"memo\": {{\"hits\": {}, \"misses\": {}}}, "
+      "\"tasks\": {{\"submitted\": {}, \"stolen\": {}}}",
+      last.forms, last.errors, times.front(), times[times.size() / 2], mean,
+      times.back(), last.allocations, last.allocated_bytes,
+      last.vm.call_cache_hits, last.vm.call_cache_misses,
+      last.vm.tail_calls, guci::thread_vm().jit(), last.vm.native_calls,
+      last.vm.jit_bailouts, verified, last.heap.mapped_bytes,
+      last.heap.released_bytes, hash_cons, last.hash_cons.entries,
+      last.hash_cons.dedup_ratio(), last.hash_cons.stored_bytes,
+      last.hash_cons.saved_bytes, last.memo_hits, last.memo_misses,
+      last.tasks_submitted, last.tasks_stolen);
+}
+
+// Forks a child to run `path`; returns the program's JSON object.
+std::string measure(std::string const& path, int repetitions) {
+  int fds[2];
+  if (pipe(fds) != 0) std::exit(1);
+
+  pid_t const pid = fork();
+  if (pid == 0) {
+    close(fds[0]);
+    std::string const fields = run_program(path, repetitions);
+    for (std::size_t done = 0; done < fields.size();) {
+      auto const n = write(fds[1], fields.data() + done, fields.size() - done);
+      if (n <= 0) _exit(1);
+      done += n;
+    }
+    _exit(0);
+  }
+
+  close(fds[1]);
+  std::string fields;
+  char buf[4096];
+  for (ssize_t n; (n = read(fds[0], buf, sizeof buf)) > 0;) {
+    fields.append(buf, n);
+  }
+  close(fds[0]);
+
+  int status = 0;
+  rusage usage{};
+  wait4(pid, &status, 0, &usage);
+  if (not WIFEXITED(status) or WEXITSTATUS(status) != 0) {
+    fields = "\"error\": \"benchmark process failed\"";
+  }
+
+  return fmt::format("{{\"program\": {}, {}, \"peak_rss_kb\": {}}}",
+                     json_string(path), fields, usage.ru_maxrss);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  int repetitions = 5;
+  std::vector<std::string> programs;
+  for (int i = 1; i < argc; ++i) {
+    std::string_view const arg = argv[i];
+    if (arg == "--repetitions" and i + 1 < argc) {
+      repetitions = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--no-jit") {
+      guci::thread_vm().set_jit(false);
+    } else if (arg == "--hash-cons") {
+      hash_cons = true;
+    } else {
+      programs.emplace_back(arg);
+    }
+  }
+
+  if (programs.empty()) {
+    fmt::print(stderr,
+               "usage: {} [--repetitions N] [--no-jit] [--hash-cons] "
+               "program.glisp...\n",
+               argv[0]);
+    return 1;
+  }
+
+  fmt::print("{{\"repetitions\": {}, \"benchmarks\": [\n", repetitions);
+  for (std::size_t i = 0; i < programs.size(); ++i) {
+    fmt::print("  {}{}\n", measure(programs[i], repetitions),
+               i + 1 < programs.size() ? "," : "");
+    std::fflush(stdout);
+  }
+  fmt::print("]}}\n");
+}
@@ -1,6 +1,5 @@
 #pragma once
 
-#include <string>
 #include <variant>
 
 #include "guci/parse/ast.hpp"
@@ -8,13 +7,20 @@
 namespace guci {
 class SetValue {
  public:
-  std::string id;
+  Identifier id;
   Term value;
 };
 
+// Makes `closure` the function `id`; see define_function().
+class DefineFunction {
+ public:
+  Identifier id;
+  Closure closure;
+};
+
 class Action {
  public:
-  using ActionType = std::variant<SetValue>;
+  using ActionType = std::variant<SetValue, DefineFunction>;
   ActionType a;
   ActionType& operator*() { return a; }
   ActionType const& operator*() const { return a; }
@@ -26,5 +32,6 @@ class Action {
 
   Action(SetValue& action) : a{action} {}
   Action(SetValue&& action) : a{std::move(action)} {}
+  Action(DefineFunction action) : a{std::move(action)} {}
 };
 }  // namespace guci
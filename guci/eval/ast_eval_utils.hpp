@@ -1,10 +1,17 @@
 #pragma once
 
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <span>
 #include <variant>
+#include <vector>
 
 #include "guci/eval/eval.hpp"
 #include "guci/eval/eval_error.hpp"
 #include "guci/parse/ast.hpp"
+#include "guci/parse/flat_ast.hpp"
+#include "guci/parse/symbol_table.hpp"
 
 namespace guci {
 inline eval_result<Identifier> as_identifier(Term const& t) {
@@ -14,13 +21,19 @@ inline eval_result<Identifier> as_identifier(Term const& t) {
   return std::get<Identifier>(*t);
 }
 
+// Everything but #f and NIL counts as true.
+inline bool is_true(Term const& t) {
+  if (auto const* b = std::get_if<Boolean>(&*t)) return b->value();
+  return not std::holds_alternative<Nil>(*t);
+}
+
 inline bool has_unbound_variables(EvaluationContext const& ctx, Term const& t) {
   if (std::holds_alternative<Identifier>(*t)) {
     return not ctx.contains(std::get<Identifier>(*t));
   }
 
   if (std::holds_alternative<List<Term>>(*t)) {
-    auto l = std::get<List<Term>>(*t);
+    auto const& l = std::get<List<Term>>(*t);
     return std::none_of(l.begin(), l.end(), [&](Term const& a_t) {
       return has_unbound_variables(ctx, a_t);
     });
@@ -28,4 +41,109 @@ inline bool has_unbound_variables(EvaluationContext const& ctx, Term const& t) {
 
   return false;
 }
+
+inline bool has_unbound_variables(EvaluationContext const& ctx, FlatNode n) {
+  switch (n.kind()) {
+    case NodeKind::Identifier:
+      return not ctx.contains(n.identifier());
+    case NodeKind::List:
+      return std::none_of(n.begin(), n.end(), [&](FlatNode child) {
+        return has_unbound_variables(ctx, child);
+      });
+    default:
+      return false;
+  }
+}
+
+namespace detail {
+inline bool contains(std::vector<SymbolId> const& ids, SymbolId id) {
+  return std::find(ids.begin(), ids.end(), id) != ids.end();
+}
+
+// Adds the variables `t` reads that are in neither `bound` nor `free` to
+// `free`. The `let`s in the scope of `t` add to `bound`.
+inline void collect_free_variables(EvaluationContext const& ctx, Term const& t,
+                                   std::vector<SymbolId>& bound,
+                                   std::vector<SymbolId>& free) {
+  if (auto const* id = std::get_if<Identifier>(&*t)) {
+    if (not contains(bound, id->id()) and not contains(free, id->id())) {
+      free.push_back(id->id());
+    }
+    return;
+  }
+  auto const* l = std::get_if<List<Term>>(&*t);
+  if (l == nullptr or l->empty()) return;
+  auto const* head = std::get_if<Identifier>(&*l->at(0));
+  if (head == nullptr) return;
+
+  Function const* f = ctx.find_function(*head);
+  auto const* builtin =
+      f != nullptr ? std::get_if<BuiltInFunction>(&(*f)()) : nullptr;
+  auto const args = l->tail();
+  auto const scope = bound.size();
+  auto const bind = [&](Term const& name) {
+    if (auto const* id = std::get_if<Identifier>(&*name)) {
+      bound.push_back(id->id());
+    }
+  };
+
+  switch (builtin != nullptr ? builtin->intrinsic() : Intrinsic::None) {
+    case Intrinsic::Let:
+      if (args.size() == 2) bind(args[0]);
+      return;
+    case Intrinsic::Eval:
+      if (args.empty()) return;
+      for (std::size_t i = 1; i < args.size(); i += 2) bind(args[i]);
+      collect_free_variables(ctx, args[0], bound, free);
+      bound.resize(scope);
+      return;
+    case Intrinsic::Lambda:
+      if (args.size() != 2) return;
+      if (auto const* params = std::get_if<List<Term>>(&*args[0])) {
+        for (Term const& p : *params) bind(p);
+      }
+      collect_free_variables(ctx, args[1], bound, free);
+      bound.resize(scope);
+      return;
+    // the first argument names the function
+    case Intrinsic::PCall:
+      for (Term const& a : args.subspan(args.empty() ? 0 : 1)) {
+        collect_free_variables(ctx, a, bound, free);
+      }
+      return;
+    default:
+      for (Term const& a : args) collect_free_variables(ctx, a, bound, free);
+  }
+}
+}  // namespace detail
+
+// The variables that the body of a function taking `params` reads without
+// binding them, in the order they are first read. Arguments that builtins
+// other than intrinsics receive count as read.
+inline std::vector<SymbolId> free_variables(EvaluationContext const& ctx,
+                                            std::span<SymbolId const> params,
+                                            Term const& body) {
+  std::vector<SymbolId> bound{params.begin(), params.end()};
+  std::vector<SymbolId> free;
+  detail::collect_free_variables(ctx, body, bound, free);
+  return free;
+}
+
+// The Lambda of `(lambda params body)` evaluated in `ctx`.
+inline eval_result<std::shared_ptr<Lambda const>> make_lambda(
+    EvaluationContext const& ctx, Term const& params, Term const& body) {
+  auto const* list = std::get_if<List<Term>>(&*params);
+  if (list == nullptr) return EvalError("parameters expected to be a list");
+
+  std::vector<SymbolId> ids;
+  for (Term const& p : *list) {
+    Identifier const id = OUTCOME_TRYX(as_identifier(p));
+    if (detail::contains(ids, id.id())) {
+      return EvalError("value already exists");
+    }
+    ids.push_back(id.id());
+  }
+  auto free = free_variables(ctx, ids, body);
+  return std::make_shared<Lambda const>(std::move(ids), std::move(free), body);
+}
 }  // namespace guci
@@ -1,5 +1,6 @@
 #include "guci/eval/ast_eval_utils.hpp"
 #include "catch2/catch.hpp"
+#include "guci/eval/evaluator.hpp"
 #include "guci/parse/parse.hpp"
 
 namespace guci {
@@ -19,4 +20,33 @@ TEST_CASE("expression with no variables") {
   bool result = has_unbound_variables(c, t);
   REQUIRE(result == false);
 }
+
+TEST_CASE("flat and tree representations agree") {
+  EvaluationContext c{{}, {{"x", Number(1)}}};
+  FlatAst const ast = read_flat("x y 3 (+ 1 2) (x) (y) (x y)").value();
+
+  for (FlatNode n : ast) {
+    REQUIRE(has_unbound_variables(c, n) ==
+            has_unbound_variables(c, n.to_term()));
+  }
+}
+
+TEST_CASE("free variables skip what the body binds") {
+  bool quit = false;
+  EvaluationContext const c = make_global_context(quit);
+  auto const free = [&](std::string_view body) {
+    std::vector<std::string> names;
+    SymbolId const x = Identifier("x").id();
+    for (SymbolId id : free_variables(c, {&x, 1}, parse(body).value())) {
+      names.push_back(Identifier::from_id(id).value());
+    }
+    return names;
+  };
+
+  REQUIRE(free("(+ x y y z)") == std::vector<std::string>{"y", "z"});
+  REQUIRE(free("(+ (let y 1) y z)") == std::vector<std::string>{"z"});
+  REQUIRE(free("(eval (+ a b c) a x b y)") == std::vector<std::string>{"c"});
+  REQUIRE(free("(lambda (a) (+ a b x))") == std::vector<std::string>{"b"});
+  REQUIRE(free("(f y (g z))") == std::vector<std::string>{"y", "z"});
+}
 }  // namespace guci
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "guci/eval/eval.hpp"
+#include "guci/parse/ast.hpp"
+#include "guci/parse/symbol_table.hpp"
+
+namespace guci {
+
+struct JitState;
+
+// Instructions of the stack machine. `a` and `b` are the operands of an
+// Instruction; "top" is the top of the value stack.
+enum class Op : std::uint8_t {
+  Const,        // push constants[a]
+  Fixnum,       // push the 64-bit integer whose low and high halves are a, b
+  LoadLocal,    // push slot b of the frame a levels up
+  LoadGlobal,   // push the global bound to symbol a, or the identifier itself
+  Lookup,       // push the first bound candidate of lookups[a], else global
+  CheckNumber,  // fail unless top is a Number or a Vector
+  Add,          // pop rhs and lhs, push lhs + rhs; Numbers or Vectors
+  Subtract,     // pop rhs and lhs, push lhs - rhs
+  Multiply,     // pop rhs and lhs, push lhs * rhs
+  Equal,        // pop rhs and lhs, push the Boolean lhs = rhs; both Numbers
+  Less,         // the same for lhs < rhs
+  Greater,      // lhs > rhs
+  LessEqual,    // lhs <= rhs
+  GreaterEqual, // lhs >= rhs
+  Let,          // bind global symbol a to constants[b], push it
+  LetLocal,     // bind slot a of the innermost frame to constants[b], push it
+  EnterScope,   // push a frame for scopes[a]
+  LeaveScope,   // pop the innermost frame
+  Call,         // apply call_sites[a] to the unevaluated list constants[b]
+  Jump,         // continue at code[a]
+  JumpIfFalse,  // pop top and continue at code[a] if it is #f or NIL
+  JumpIfBusy,   // continue at code[a] if the thread pool has no room
+  MakeClosure,  // push a closure of lambdas[a]
+  Callee,       // look up the user function of call_sites[a] for b arguments
+  CalleeValue,  // pop the closure on top, to be called with b arguments
+  Apply,        // call the last callee on the top a values, in a new frame
+  TailApply,    // the same, in place of the running function
+  Fail,         // stop with the error messages[a]
+};
+
+struct Instruction {
+  Op op;
+  std::uint32_t a = 0;
+  std::uint32_t b = 0;
+
+  static Instruction fixnum(std::int64_t n) {
+    auto const bits = static_cast<std::uint64_t>(n);
+    return {Op::Fixnum, static_cast<std::uint32_t>(bits),
+            static_cast<std::uint32_t>(bits >> 32)};
+  }
+  std::int64_t fixnum() const {
+    return static_cast<std::int64_t>(std::uint64_t{b} << 32 | a);
+  }
+};
+
+// Where a local variable lives: `depth` frames up from the innermost one.
+// kDynamic stands for the bindings a frame got from builtins outside the VM.
+struct LocalAddress {
+  static constexpr std::uint32_t kDynamic = UINT32_MAX;
+
+  std::uint32_t depth;
+  std::uint32_t slot;
+};
+
+// Compiled form of one top-level Term or function body. Intrinsics are
+// lowered for the EvaluationContext the Chunk was compiled in; other
+// functions are looked up through call sites. The frame of a function body is
+// scopes[0]: its parameters, then its free variables, then its `let`s.
+struct Chunk {
+  // The variables of one `eval`: slots[i] names slot i of its frame. The
+  // first arguments.size() slots are bound on entry, the others by `let`s.
+  struct Scope {
+    std::vector<SymbolId> slots;
+    std::vector<Term> arguments;
+  };
+
+  // A variable that may or may not be bound yet in some frames.
+  struct Lookup {
+    SymbolId id;
+    std::vector<LocalAddress> candidates;
+  };
+
+  // A monomorphic inline cache: the function `name` was last resolved to,
+  // valid while the context it was resolved from has the same
+  // function_owner() and the function epoch has not moved. For a user
+  // function, `code` is its body compiled for that function owner. Machines
+  // on several threads may share a chunk; what they store for one function
+  // owner is the same whatever the epoch, so the fields only need to be read
+  // and written whole, with `epoch` written last.
+  struct CallSite {
+    SymbolId name;
+    mutable std::atomic<Function const*> function;
+    mutable std::atomic<EvaluationContext const*> owner;
+    mutable std::atomic<std::uint64_t> epoch;
+    mutable std::atomic<Chunk const*> code = nullptr;
+
+    CallSite(SymbolId n, Function const* f, EvaluationContext const* o,
+             std::uint64_t e)
+        : name{n}, function{f}, owner{o}, epoch{e} {}
+    CallSite(CallSite const& other)
+        : name{other.name},
+          function{other.function.load(std::memory_order_relaxed)},
+          owner{other.owner.load(std::memory_order_relaxed)},
+          epoch{other.epoch.load(std::memory_order_relaxed)},
+          code{other.code.load(std::memory_order_relaxed)} {}
+  };
+
+  // A `lambda` and where to find its free variables, in the order of
+  // lambda->free.
+  struct LambdaSite {
+    std::shared_ptr<Lambda const> lambda;
+    std::vector<Lookup> captures;
+  };
+
+  std::vector<Instruction> code;
+  std::vector<Term> constants;
+  std::vector<CallSite> call_sites;
+  std::vector<Scope> scopes;
+  std::vector<Lookup> lookups;
+  std::vector<LambdaSite> lambdas;
+  std::vector<std::string> messages;
+  // for function bodies, how hot they are and their native code; see jit.hpp
+  std::shared_ptr<JitState> jit;
+};
+
+}  // namespace guci
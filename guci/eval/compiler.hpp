@@ -0,0 +1,378 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+#include "guci/eval/ast_eval_utils.hpp"
+#include "guci/eval/bytecode.hpp"
+#include "guci/eval/eval.hpp"
+#include "guci/eval/jit.hpp"
+#include "guci/eval/optimizer.hpp"
+#include "guci/eval/parallel.hpp"
+#include "guci/parse/ast.hpp"
+
+namespace guci {
+
+// Lowers a Term to bytecode that behaves exactly like EvaluatingVisitor:
+// arguments are evaluated left to right, and an error is raised at the point
+// where the visitor would raise it, after the side effects that precede it.
+// Errors that only depend on the shape of the program are found here and
+// compiled to Fail instructions.
+//
+// Variables bound by `eval` and by `let`s inside it get a slot in the frame of
+// that eval, so references resolve to a (depth, slot) address here. Only
+// globals are looked up by symbol at run time.
+//
+// Calls in tail position, the last thing a function body or top-level form
+// does, reuse the frame of the running function.
+//
+// In the parallel mode, arithmetic with arguments worth forking is left to
+// its builtin, which forks them, while the thread pool has room for more
+// tasks; see parallel.hpp.
+class Compiler {
+  // An eval scope as seen at the current point of the code.
+  struct ScopeState {
+    std::uint32_t index;
+    std::vector<SymbolId> slots;
+    // whether each slot is certainly bound once control gets here
+    std::vector<bool> bound;
+    // a builtin outside the VM ran here and may have bound anything
+    bool dynamic = false;
+
+    std::optional<std::uint32_t> find(SymbolId id) const {
+      auto const it = std::find(slots.begin(), slots.end(), id);
+      if (it == slots.end()) return std::nullopt;
+      return static_cast<std::uint32_t>(it - slots.begin());
+    }
+  };
+
+  EvaluationContext const& ctx_;
+  bool parallel_;
+  Chunk chunk_;
+  std::vector<ScopeState> scopes_;
+
+  void emit(Op op, std::uint32_t a = 0, std::uint32_t b = 0) {
+    chunk_.code.push_back({op, a, b});
+  }
+
+  template <typename T, typename V>
+  static std::uint32_t add(std::vector<T>& pool, V&& value) {
+    pool.push_back(std::forward<V>(value));
+    return static_cast<std::uint32_t>(pool.size() - 1);
+  }
+
+  void fail(std::string_view msg) {
+    emit(Op::Fail, add(chunk_.messages, std::string{msg}));
+  }
+
+  void compile_list(List<Term> const& l, bool tail) {
+    if (l.empty()) return emit(Op::Const, add(chunk_.constants, Term{NIL}));
+
+    Identifier const* head = std::get_if<Identifier>(&*l.at(0));
+    if (head == nullptr) return fail("not a function");
+
+    // anything but a builtin is a user function, which may also be defined
+    // after this is compiled
+    Function const* f = ctx_.find_function(*head);
+    auto const* builtin =
+        f != nullptr ? std::get_if<BuiltInFunction>(&(*f)()) : nullptr;
+    auto const args = l.tail();
+    if (builtin == nullptr) {
+      Chunk::CallSite site{head->id(), nullptr, nullptr, 0};
+      emit(Op::Callee, add(chunk_.call_sites, site), args.size());
+      return compile_apply(args, tail);
+    }
+
+    if (not builtin->acceptsArgumentNumber(args.size())) {
+      return fail("arity mismatch");
+    }
+
+    switch (builtin->intrinsic()) {
+      case Intrinsic::Add:
+        return compile_arithmetic(
+            l, f, [&] { compile_fold(args, Op::Add, 0); });
+      case Intrinsic::Multiply:
+        return compile_arithmetic(
+            l, f, [&] { compile_fold(args, Op::Multiply, 1); });
+      case Intrinsic::Subtract:
+        return compile_arithmetic(l, f, [&] {
+          compile(args[0]);
+          for (Term const& t : args.subspan(1)) {
+            compile(t);
+            emit(Op::Subtract);
+          }
+        });
+      case Intrinsic::Let:
+        return compile_let(args);
+      case Intrinsic::Eval:
+        return compile_eval(args, tail);
+      case Intrinsic::If:
+        return compile_if(args, tail);
+      case Intrinsic::Equal:
+        return compile_compare(args, Op::Equal);
+      case Intrinsic::Less:
+        return compile_compare(args, Op::Less);
+      case Intrinsic::Greater:
+        return compile_compare(args, Op::Greater);
+      case Intrinsic::LessEqual:
+        return compile_compare(args, Op::LessEqual);
+      case Intrinsic::GreaterEqual:
+        return compile_compare(args, Op::GreaterEqual);
+      case Intrinsic::Lambda:
+        return compile_lambda(args);
+      case Intrinsic::Funcall:
+        compile(args[0]);
+        emit(Op::CalleeValue, 0, args.size() - 1);
+        return compile_apply(args.subspan(1), tail);
+      case Intrinsic::PCall:
+      case Intrinsic::Future:
+      case Intrinsic::Pure:
+      case Intrinsic::None:
+        break;
+    }
+    compile_call(l, f);
+  }
+
+  // hands the unevaluated list `l` to the builtin `f`
+  void compile_call(List<Term> const& l, Function const* f) {
+    auto const& head = std::get<Identifier>(*l.at(0));
+    Chunk::CallSite site{head.id(), f, ctx_.function_owner(),
+                         EvaluationContext::function_epoch()};
+    emit(Op::Call, add(chunk_.call_sites, site),
+         add(chunk_.constants, Term{l}));
+    if (not scopes_.empty()) scopes_.back().dynamic = true;
+  }
+
+  // In the parallel mode, arithmetic with arguments worth forking calls its
+  // builtin `f`, which forks them, unless the pool is busy when it runs.
+  // Only `compile_inline` binds slots, so those it binds are not certainly
+  // bound after either.
+  template <typename CompileInline>
+  void compile_arithmetic(List<Term> const& l, Function const* f,
+                          CompileInline compile_inline) {
+    if (not parallel_ or not worth_forking(ctx_, l.tail())) {
+      return compile_inline();
+    }
+    auto const to_inline = chunk_.code.size();
+    emit(Op::JumpIfBusy);
+    compile_call(l, f);
+    auto const to_end = chunk_.code.size();
+    emit(Op::Jump);
+
+    std::vector<ScopeState> const before = scopes_;
+    chunk_.code[to_inline].a = static_cast<std::uint32_t>(chunk_.code.size());
+    compile_inline();
+    chunk_.code[to_end].a = static_cast<std::uint32_t>(chunk_.code.size());
+    for (std::size_t i = 0; i < scopes_.size(); ++i) {
+      scopes_[i].bound = before[i].bound;
+      scopes_[i].bound.resize(scopes_[i].slots.size(), false);
+    }
+  }
+
+  // the arguments of a user function are evaluated before it is called
+  void compile_apply(std::span<Term const> args, bool tail) {
+    for (Term const& t : args) compile(t);
+    emit(tail ? Op::TailApply : Op::Apply, args.size());
+  }
+
+  // (op a b c) as ((identity op a) op b) op c; the identity is only folded
+  // away after checking that `a` is a number
+  void compile_fold(std::span<Term const> args, Op op, int identity) {
+    if (args.empty()) {
+      return chunk_.code.push_back(Instruction::fixnum(identity));
+    }
+    compile(args[0]);
+    emit(Op::CheckNumber);
+    for (Term const& t : args.subspan(1)) {
+      compile(t);
+      emit(op);
+    }
+  }
+
+  void compile_let(std::span<Term const> args) {
+    auto const id = as_identifier(args[0]);
+    if (not id) return fail(id.error().msg());
+    auto const value = add(chunk_.constants, args[1]);
+    if (scopes_.empty()) return emit(Op::Let, id.value().id(), value);
+
+    ScopeState& scope = scopes_.back();
+    auto slot = scope.find(id.value().id());
+    if (not slot) {
+      slot = static_cast<std::uint32_t>(scope.slots.size());
+      scope.slots.push_back(id.value().id());
+      scope.bound.push_back(false);
+    }
+    emit(Op::LetLocal, *slot, value);
+    scope.bound[*slot] = true;
+  }
+
+  void compile_compare(std::span<Term const> args, Op op) {
+    compile(args[0]);
+    emit(Op::CheckNumber);
+    compile(args[1]);
+    emit(op);
+  }
+
+  // A variable is certainly bound after the `if` if it is after both
+  // branches.
+  void compile_if(std::span<Term const> args, bool tail) {
+    compile(args[0]);
+    auto const to_else = chunk_.code.size();
+    emit(Op::JumpIfFalse);
+
+    std::vector<ScopeState> const before = scopes_;
+    compile(args[1], tail);
+    auto const to_end = chunk_.code.size();
+    emit(Op::Jump);
+    std::vector<ScopeState> const after_then = scopes_;
+    for (std::size_t i = 0; i < scopes_.size(); ++i) {
+      scopes_[i].bound = before[i].bound;
+      scopes_[i].bound.resize(scopes_[i].slots.size(), false);
+      scopes_[i].dynamic = before[i].dynamic;
+    }
+
+    chunk_.code[to_else].a = static_cast<std::uint32_t>(chunk_.code.size());
+    compile(args[2], tail);
+    chunk_.code[to_end].a = static_cast<std::uint32_t>(chunk_.code.size());
+    for (std::size_t i = 0; i < scopes_.size(); ++i) {
+      auto& bound = scopes_[i].bound;
+      auto const& then_bound = after_then[i].bound;
+      for (std::size_t slot = 0; slot < bound.size(); ++slot) {
+        bound[slot] = bound[slot] and slot < then_bound.size() and
+                      then_bound[slot];
+      }
+      scopes_[i].dynamic = scopes_[i].dynamic or after_then[i].dynamic;
+    }
+  }
+
+  void compile_lambda(std::span<Term const> args) {
+    auto lambda = make_lambda(ctx_, args[0], args[1]);
+    if (not lambda) return fail(lambda.error().msg());
+
+    Chunk::LambdaSite site{std::move(lambda).value(), {}};
+    for (SymbolId id : site.lambda->free) {
+      site.captures.push_back({id, candidates(id)});
+    }
+    emit(Op::MakeClosure, add(chunk_.lambdas, std::move(site)));
+  }
+
+  void compile_eval(std::span<Term const> args, bool tail) {
+    if (args.size() % 2 != 1) {
+      return fail("mismatched number of local variables and values");
+    }
+
+    Chunk::Scope scope;
+    for (std::size_t i = 1; i < args.size(); i += 2) {
+      auto const id = as_identifier(args[i]);
+      if (not id) return fail(id.error().msg());
+      if (std::find(scope.slots.begin(), scope.slots.end(),
+                    id.value().id()) != scope.slots.end()) {
+        return fail("value already exists");
+      }
+      scope.slots.push_back(id.value().id());
+      scope.arguments.push_back(args[i + 1]);
+    }
+
+    auto const index = add(chunk_.scopes, std::move(scope));
+    emit(Op::EnterScope, index);
+    auto const& slots = chunk_.scopes[index].slots;
+    scopes_.push_back({index, slots, std::vector<bool>(slots.size(), true)});
+    compile(args[0], tail);
+    chunk_.scopes[index].slots = std::move(scopes_.back().slots);
+    scopes_.pop_back();
+    emit(Op::LeaveScope);
+  }
+
+  // the places `id` may be bound at, innermost first; a place where it is
+  // certainly bound ends the list
+  std::vector<LocalAddress> candidates(SymbolId id) const {
+    std::vector<LocalAddress> result;
+    for (std::uint32_t depth = 0; depth < scopes_.size(); ++depth) {
+      ScopeState const& scope = scopes_[scopes_.size() - 1 - depth];
+      if (auto const slot = scope.find(id)) {
+        result.push_back({depth, *slot});
+        if (scope.bound[*slot]) break;
+      }
+      if (scope.dynamic) {
+        result.push_back({depth, LocalAddress::kDynamic});
+      }
+    }
+    return result;
+  }
+
+  void compile_load(Identifier id) {
+    auto where = candidates(id.id());
+    if (where.empty()) return emit(Op::LoadGlobal, id.id());
+
+    LocalAddress const first = where.front();
+    if (first.slot != LocalAddress::kDynamic and
+        scopes_[scopes_.size() - 1 - first.depth].bound[first.slot]) {
+      return emit(Op::LoadLocal, first.depth, first.slot);
+    }
+    emit(Op::Lookup,
+         add(chunk_.lookups, Chunk::Lookup{id.id(), std::move(where)}));
+  }
+
+  void compile(Term const& t, bool tail = false) {
+    if (auto const* l = std::get_if<List<Term>>(&*t)) {
+      return compile_list(*l, tail);
+    }
+    if (auto const* id = std::get_if<Identifier>(&*t)) return compile_load(*id);
+    if (auto const* n = std::get_if<Number>(&*t); n and n->is_fixnum()) {
+      return chunk_.code.push_back(Instruction::fixnum(n->fixnum()));
+    }
+    emit(Op::Const, add(chunk_.constants, t));
+  }
+
+ public:
+  explicit Compiler(EvaluationContext const& ctx,
+                    bool parallel = parallel_mode())
+      : ctx_{ctx}, parallel_{parallel} {}
+
+  Chunk compile_term(Term const& t) && {
+    compile(t, true);
+    return std::move(chunk_);
+  }
+
+  // `body` is that of `lambda`, possibly optimized
+  Chunk compile_function(Lambda const& lambda, Term const& body) && {
+    Chunk::Scope frame;
+    frame.slots = lambda.params;
+    frame.slots.insert(frame.slots.end(), lambda.free.begin(),
+                       lambda.free.end());
+    std::vector<bool> bound(frame.slots.size(), false);
+    std::fill_n(bound.begin(), lambda.params.size(), true);
+
+    chunk_.scopes.push_back(std::move(frame));
+    scopes_.push_back({0, chunk_.scopes[0].slots, std::move(bound)});
+    compile(body, true);
+    chunk_.scopes[0].slots = std::move(scopes_.back().slots);
+    scopes_.pop_back();
+    chunk_.jit = std::make_shared<JitState>();
+    return std::move(chunk_);
+  }
+};
+
+inline Chunk compile(EvaluationContext const& ctx, Term const& t) {
+  return Compiler{ctx}.compile_term(t);
+}
+
+// The body of `lambda` compiled for the builtins seen from `ctx` in the
+// current parallel mode, which happens on its first call from there.
+inline Chunk const& compiled(EvaluationContext const& ctx,
+                             Lambda const& lambda) {
+  bool const parallel = parallel_mode();
+  if (Chunk const* code = lambda.code(ctx, parallel)) return *code;
+  return lambda.add_code(
+      ctx, parallel,
+      std::make_shared<Chunk const>(Compiler{ctx, parallel}.compile_function(
+          lambda, optimize(ctx, lambda.body))));
+}
+
+}  // namespace guci
@@ -1,30 +1,122 @@
 #pragma once
 
-#include <functional>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <shared_mutex>
 #include <span>
-#include <string>
+#include <string_view>
+#include <type_traits>
 #include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
 
+#include "guci/eval/actions.hpp"
 #include "guci/eval/eval_result.hpp"
 #include "guci/parse/ast.hpp"
+#include "guci/utils/value_heap.hpp"
+#include "guci/utils/work_stealing_pool.hpp"
 
 namespace guci {
 class EvaluationContext;
+struct Chunk;
 
+// Builtins the bytecode compiler knows how to lower to dedicated opcodes, and
+// those of parallel.hpp, which it leaves alone but whose arguments are seen
+// through like those of the others.
+enum class Intrinsic : std::uint8_t {
+  None,
+  Add,
+  Subtract,
+  Multiply,
+  Let,
+  Eval,
+  If,
+  Equal,
+  Less,
+  Greater,
+  LessEqual,
+  GreaterEqual,
+  Lambda,
+  Funcall,
+  // (pcall f args...), which is (f args...)
+  PCall,
+  // `future` and `touch`, which evaluate their argument and nothing else
+  Future,
+  // builtins that evaluate their arguments and have no effects otherwise,
+  // such as those of vectors.hpp
+  Pure,
+};
+
+// A builtin is a trivially copyable callable of at most kInlineSize bytes,
+// such as a function pointer or a lambda capturing a reference, stored in
+// place and called through a plain function pointer. A callable that can
+// also be called with one or two Terms after the context gets entry points
+// for those argument counts, which apply() takes over the generic one.
 class BuiltInFunction {
-  using Impl = std::function<EvaluationResult(EvaluationContext&,
-                                              std::span<Term const>)>;
+ public:
+  using Args = std::span<Term const>;
+  static constexpr std::size_t kInlineSize = 2 * sizeof(void*);
+  static constexpr auto kAnyArity = -1;
+  static constexpr auto kAnyPositiveArity = -2;
+
+ private:
+  using Entry = EvaluationResult (*)(void const*, EvaluationContext&, Args);
+  using UnaryEntry = EvaluationResult (*)(void const*, EvaluationContext&,
+                                          Term const&);
+  using BinaryEntry = EvaluationResult (*)(void const*, EvaluationContext&,
+                                           Term const&, Term const&);
 
   int arity_;
-  Impl fun_;
+  Intrinsic intrinsic_;
+  Entry entry_;
+  UnaryEntry unary_ = nullptr;
+  BinaryEntry binary_ = nullptr;
+  alignas(void*) std::byte fun_[kInlineSize];
+
+  template <typename F>
+  static F const& get(void const* fun) {
+    return *std::launder(static_cast<F const*>(fun));
+  }
 
  public:
-  static constexpr auto kAnyArity = -1;
-  static constexpr auto kAnyPositiveArity = -2;
-  BuiltInFunction(int arity, Impl fun) : arity_{arity}, fun_{fun} {}
+  template <typename F>
+    requires std::is_trivially_copyable_v<F> and
+             (sizeof(F) <= kInlineSize) and
+             (alignof(F) <= alignof(void*)) and
+             std::is_invocable_r_v<EvaluationResult, F const&,
+                                   EvaluationContext&, Args>
+  BuiltInFunction(int arity, F fun, Intrinsic intrinsic = Intrinsic::None)
+      : arity_{arity},
+        intrinsic_{intrinsic},
+        entry_{[](void const* f, EvaluationContext& ctx, Args args) {
+          return EvaluationResult{get<F>(f)(ctx, args)};
+        }} {
+    ::new (static_cast<void*>(fun_)) F(fun);
+    if constexpr (std::is_invocable_r_v<EvaluationResult, F const&,
+                                        EvaluationContext&, Term const&>) {
+      unary_ = [](void const* f, EvaluationContext& ctx, Term const& a) {
+        return EvaluationResult{get<F>(f)(ctx, a)};
+      };
+    }
+    if constexpr (std::is_invocable_r_v<EvaluationResult, F const&,
+                                        EvaluationContext&, Term const&,
+                                        Term const&>) {
+      binary_ = [](void const* f, EvaluationContext& ctx, Term const& a,
+                   Term const& b) {
+        return EvaluationResult{get<F>(f)(ctx, a, b)};
+      };
+    }
+  }
 
   int arity() const { return arity_; }
+  Intrinsic intrinsic() const { return intrinsic_; }
   bool acceptsArgumentNumber(std::size_t arg_num) const {
     if (arity_ == kAnyArity) {
       return true;
@@ -36,13 +128,91 @@ class BuiltInFunction {
 
     return static_cast<std::size_t>(arity_) == arg_num;
   }
-  EvaluationResult apply(EvaluationContext& ctx,
-                         std::span<Term const> args) const {
-    return fun_(ctx, args);
+  // does not check the arity
+  EvaluationResult apply(EvaluationContext& ctx, Args args) const {
+    if (args.size() == 1 and unary_ != nullptr) {
+      return unary_(fun_, ctx, args[0]);
+    }
+    if (args.size() == 2 and binary_ != nullptr) {
+      return binary_(fun_, ctx, args[0], args[1]);
+    }
+    return entry_(fun_, ctx, args);
+  }
+};
+
+// The parameters and body of a `lambda` or `define`, shared by all the
+// closures made from it. `free` are the variables the body reads without
+// binding them itself.
+class Lambda {
+  // The body compiled for the builtins seen from one function owner, in the
+  // parallel mode or not. Entries are never dropped, so a Chunk lives as
+  // long as its Lambda.
+  struct Code {
+    EvaluationContext const* owner;
+    std::uint64_t owner_epoch;
+    bool parallel;
+    std::shared_ptr<Chunk const> chunk;
+  };
+
+  mutable std::mutex mutex_;
+  mutable std::vector<std::unique_ptr<Code const>> code_;
+  mutable std::atomic<Code const*> last_{nullptr};
+
+  static bool compiled_for(Code const& c, EvaluationContext const& ctx,
+                           bool parallel);
+
+ public:
+  std::vector<SymbolId> params;
+  std::vector<SymbolId> free;
+  Term body;
+
+  Lambda(std::vector<SymbolId> params, std::vector<SymbolId> free, Term body)
+      : params{std::move(params)},
+        free{std::move(free)},
+        body{std::move(body)} {}
+
+  // the body compiled for the builtins seen from `ctx`, if it has been; see
+  // compiled() in compiler.hpp
+  Chunk const* code(EvaluationContext const& ctx, bool parallel) const {
+    Code const* last = last_.load(std::memory_order_acquire);
+    if (last != nullptr and compiled_for(*last, ctx, parallel)) {
+      return last->chunk.get();
+    }
+    std::lock_guard const lock{mutex_};
+    for (auto const& c : code_) {
+      if (compiled_for(*c, ctx, parallel)) return c->chunk.get();
+    }
+    return nullptr;
   }
+
+  // keeps the first chunk added for the builtins seen from `ctx`
+  Chunk const& add_code(EvaluationContext const& ctx, bool parallel,
+                        std::shared_ptr<Chunk const> chunk) const;
+};
+
+// What a closure holds: its Lambda and, for each of the Lambda's free
+// variables, the value it had where the closure was made if it was bound.
+// The results of calls of a memoized closure go to the MemoCache.
+struct ClosureData {
+  std::shared_ptr<Lambda const> lambda;
+  std::vector<std::optional<Term>> captures;
+  bool memoized = false;
 };
 
-class UserDefinedFunction {};
+// closures live on the ValueHeap, like the other runtime values
+inline Closure make_closure(std::shared_ptr<Lambda const> lambda,
+                            std::vector<std::optional<Term>> captures,
+                            bool memoized = false) {
+  return Closure{std::allocate_shared<ClosureData const>(
+      ValueAllocator<ClosureData>{},
+      ClosureData{std::move(lambda), std::move(captures), memoized})};
+}
+
+// A function made by `define`.
+class UserDefinedFunction {
+ public:
+  Closure closure;
+};
 
 class Function {
   std::variant<BuiltInFunction, UserDefinedFunction> fun_;
@@ -53,60 +223,324 @@ class Function {
 
   auto const& operator()() const { return fun_; }
 };
+// The values of a root context or an Overlay, indexed directly by SymbolId,
+// so a lookup is a bounds check and a load whatever the length of the name.
+// Its size follows the largest SymbolId bound, so it is not for the short
+// lived scopes of calls; see LocalValues. Pointers returned by find() are
+// invalidated by the next emplace().
+class ValueTable {
+  std::vector<std::optional<Term>> values_;
+
+ public:
+  Term const* find(SymbolId id) const {
+    if (id >= values_.size() or not values_[id]) return nullptr;
+    return std::addressof(*values_[id]);
+  }
+
+  bool contains(SymbolId id) const { return find(id) != nullptr; }
+
+  // false if `id` is already bound
+  bool emplace(SymbolId id, Term t) {
+    if (id >= values_.size()) values_.resize(id + 1);
+    if (values_[id]) return false;
+    values_[id] = std::move(t);
+    return true;
+  }
+};
+
+// The values of a LocalScope, which binds the parameters of one call or the
+// variables of one `eval`: few enough to be searched in order, and costing
+// no more than they hold however many symbols are interned. Pointers
+// returned by find() are invalidated by the next emplace().
+class LocalValues {
+  std::vector<std::pair<SymbolId, Term>> values_;
+
+ public:
+  Term const* find(SymbolId id) const {
+    for (auto const& [key, value] : values_) {
+      if (key == id) return std::addressof(value);
+    }
+    return nullptr;
+  }
+
+  bool contains(SymbolId id) const { return find(id) != nullptr; }
+
+  // false if `id` is already bound
+  bool emplace(SymbolId id, Term t) {
+    if (contains(id)) return false;
+    values_.emplace_back(id, std::move(t));
+    return true;
+  }
+};
+
+// Side effects that builtins defer to the end of their call. The caller
+// takes a mark before the call and, once it returns, commits what was
+// recorded since then to its context, or rolls it back if the call failed.
+// Marks nest, so one journal serves all calls; its storage is reused, so
+// calls without effects cost nothing.
+class EffectJournal {
+  std::vector<Action> entries_;
+
+ public:
+  using Mark = std::size_t;
+
+  Mark mark() const { return entries_.size(); }
+  void record(Action a) { entries_.push_back(std::move(a)); }
+
+  void rollback(Mark m) {
+    entries_.erase(entries_.begin() + m, entries_.end());
+  }
+  // applies the entries in order and stops at the first one that fails;
+  // all entries since `m` are gone afterwards
+  eval_result<void> commit(Mark m, EvaluationContext& ctx);
+};
+
+// Contexts other than LocalScopes may be read by the tasks of parallel.hpp,
+// on other threads, while the thread evaluating in them goes on. Tasks never
+// write them, and the threads running tasks read them under their lock,
+// which writes take; see SharedReads. Tasks capture the values they read, so
+// what they look up here are functions, which stay where they are.
 class EvaluationContext {
-  using FunctionContainer = std::unordered_map<std::string, Function>;
-  using ValueContainer = std::unordered_map<std::string, Term>;
+  using FunctionContainer = std::unordered_map<SymbolId, Function>;
+  using ValueContainer = ValueTable;
   FunctionContainer functions_;
   ValueContainer values_;
+  // the values of a LocalScope, which leaves values_ empty
+  LocalValues locals_;
   EvaluationContext const* parent_;
+  // the nearest context, this one or an ancestor, that defines functions
+  std::atomic<EvaluationContext const*> function_owner_;
+  // the nearest context, this one or an ancestor, that is not a LocalScope
+  EvaluationContext const* global_;
+  // the function epoch at which this context began to define functions
+  std::atomic<std::uint64_t> owner_epoch_ = 0;
+  // the root context's journal serves all contexts below it
+  EffectJournal own_journal_;
+  EffectJournal* journal_;
+  // an Overlay, which may not define functions
+  bool shares_functions_ = false;
+  mutable std::shared_mutex mutex_;
+  // tasks evaluating below this context, which waits for them to finish
+  mutable std::atomic<std::size_t> tasks_{0};
+
+  inline static std::atomic<std::uint64_t> function_epoch_{0};
+  inline static thread_local bool shared_reads_ = false;
+
+  template <typename Container, typename Entries>
+  static Container intern_all(Entries entries) {
+    Container c;
+    if constexpr (requires { c.reserve(0); }) c.reserve(entries.size());
+    for (auto const& [name, value] : entries) {
+      c.emplace(Identifier{name}.id(), value);
+    }
+    return c;
+  }
+
+  // runs `read` under the shared lock if other threads may write this
+  // context while it runs
+  template <typename Read>
+  auto read(Read read) const {
+    if (shared_reads_ and not is_local()) {
+      std::shared_lock const lock{mutex_};
+      return read();
+    }
+    return read();
+  }
+
+  std::unique_lock<std::shared_mutex> write_lock() {
+    if (is_local()) return {};
+    return std::unique_lock{mutex_};
+  }
 
  public:
-  using FunctionType = FunctionContainer::value_type;
-  using ValueType = ValueContainer::value_type;
+  using FunctionType = std::pair<std::string_view, Function>;
+  using ValueType = std::pair<std::string_view, Term>;
+
+  // Tags the scope of an `eval` or of a function call.
+  struct LocalScope {};
+  // Tags a context that binds variables of its own on top of a parent that
+  // other threads evaluate on top of too. It sees the functions of the
+  // parent but defines none, so that all contexts on top of the parent
+  // share its compiled code; nothing may write the parent meanwhile.
+  struct Overlay {};
+
+  // Marks the calling thread as one running a task for the thread that
+  // evaluates in the contexts it shares, until it goes out of scope.
+  class SharedReads {
+    bool previous_ = std::exchange(shared_reads_, true);
+
+   public:
+    SharedReads() = default;
+    SharedReads(SharedReads const&) = delete;
+    SharedReads& operator=(SharedReads const&) = delete;
+    ~SharedReads() { shared_reads_ = previous_; }
+  };
 
   EvaluationContext(std::initializer_list<FunctionType> functions,
                     std::initializer_list<ValueType> values)
-      : functions_{functions}, values_{values}, parent_{nullptr} {}
+      : EvaluationContext(nullptr, functions, values) {}
   EvaluationContext(EvaluationContext const* parent,
                     std::initializer_list<FunctionType> functions,
                     std::initializer_list<ValueType> values)
-      : functions_{functions}, values_{values}, parent_{parent} {}
+      : functions_{intern_all<FunctionContainer>(functions)},
+        values_{intern_all<ValueContainer>(values)},
+        parent_{parent},
+        function_owner_{functions_.empty() and parent != nullptr
+                            ? parent->function_owner()
+                            : this},
+        global_{this},
+        journal_{parent != nullptr ? parent->journal_ : &own_journal_} {
+    if (function_owner() == this) {
+      owner_epoch_ =
+          function_epoch_.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+  }
+  EvaluationContext(LocalScope, EvaluationContext const* parent)
+      : EvaluationContext(LocalScope{}, parent, *parent->journal_) {}
+  // a scope recording its effects in `journal` rather than its parent's
+  EvaluationContext(LocalScope, EvaluationContext const* parent,
+                    EffectJournal& journal)
+      : parent_{parent},
+        function_owner_{parent->function_owner()},
+        global_{parent->global_},
+        journal_{&journal} {}
+  EvaluationContext(Overlay, EvaluationContext const& parent)
+      : parent_{&parent},
+        function_owner_{parent.function_owner()},
+        global_{this},
+        journal_{&own_journal_},
+        shares_functions_{true} {}
+
+  // A context is identified by its address; see function_epoch().
+  EvaluationContext(EvaluationContext const&) = delete;
+  EvaluationContext& operator=(EvaluationContext const&) = delete;
 
-  Term const* find_value(std::string const& id) const {
-    auto const it = values_.find(id);
-    if (it == values_.end()) {
-      return parent_ != nullptr ? parent_->find_value(id) : nullptr;
+  ~EvaluationContext() {
+    if (tasks_.load(std::memory_order_acquire) != 0) {
+      WorkStealingPool::global().help_until(
+          [&] { return tasks_.load(std::memory_order_acquire) == 0; });
     }
+  }
 
-    return std::addressof(it->second);
+  // Changes whenever the functions visible from some context may have
+  // changed. A function found from a context stays valid as long as the
+  // epoch and that context's function_owner() are the same.
+  static std::uint64_t function_epoch() {
+    return function_epoch_.load(std::memory_order_relaxed);
+  }
+  EvaluationContext const* function_owner() const {
+    return function_owner_.load(std::memory_order_relaxed);
+  }
+  std::uint64_t owner_epoch() const {
+    return owner_epoch_.load(std::memory_order_relaxed);
   }
 
-  Function const* find_function(std::string const& id) const {
-    auto const it = functions_.find(id);
-    if (it == functions_.end()) {
-      return parent_ != nullptr ? parent_->find_function(id) : nullptr;
-    }
+  // Function bodies look up the variables they neither bind nor capture
+  // from here, whatever scope they are called from.
+  EvaluationContext const* global() const { return global_; }
+  bool is_local() const { return global_ != this; }
 
-    return std::addressof(it->second);
+  Term const* find_value(Identifier const& id) const {
+    Term const* t = is_local() ? locals_.find(id.id())
+                               : read([&] { return values_.find(id.id()); });
+    if (t == nullptr and parent_ != nullptr) return parent_->find_value(id);
+    return t;
   }
 
-  eval_result<void> set_value(std::string const& id, Term t) {
-    if (values_.contains(id)) {
+  Function const* find_function(Identifier const& id) const {
+    EvaluationContext const* owner = function_owner();
+    Function const* f = owner->read([&]() -> Function const* {
+      auto const it = owner->functions_.find(id.id());
+      return it != owner->functions_.end() ? std::addressof(it->second)
+                                           : nullptr;
+    });
+    if (f == nullptr and owner->parent_ != nullptr) {
+      return owner->parent_->find_function(id);
+    }
+    return f;
+  }
+
+  eval_result<void> set_value(Identifier const& id, Term t) {
+    auto const lock = write_lock();
+    bool const added = is_local() ? locals_.emplace(id.id(), std::move(t))
+                                  : values_.emplace(id.id(), std::move(t));
+    if (not added) {
       return EvalError("value already exists");
     }
-    values_.insert({id, t});
     return outcome::success();
   }
 
-  eval_result<void> set_value(Identifier const& id, Term t) {
-    return set_value(id.value(), std::move(t));
+  // Functions can neither be redefined nor shadowed, so a function found
+  // from a context stays the one found until the context is gone.
+  eval_result<void> define_function(Identifier const& id, Function f) {
+    if (shares_functions_) return EvalError("functions are read-only here");
+    if (find_function(id) != nullptr) {
+      return EvalError("function already exists");
+    }
+    {
+      auto const lock = write_lock();
+      functions_.emplace(id.id(), std::move(f));
+    }
+    auto const epoch =
+        function_epoch_.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (function_owner() != this) {
+      owner_epoch_.store(epoch, std::memory_order_relaxed);
+      function_owner_.store(this, std::memory_order_relaxed);
+    }
+    return outcome::success();
   }
 
-  bool contains(std::string const& id) const {
-    return functions_.contains(id) or values_.contains(id);
+  bool contains(Identifier const& id) const {
+    if (is_local()) {
+      return functions_.contains(id.id()) or locals_.contains(id.id());
+    }
+    return read([&] {
+      return functions_.contains(id.id()) or values_.contains(id.id());
+    });
   }
 
-  bool contains(Identifier const& id) const { return contains(id.value()); }
+  EffectJournal& journal() { return *journal_; }
+
+  // Counts a task evaluating below this context until task_done().
+  void add_task() const { tasks_.fetch_add(1, std::memory_order_relaxed); }
+  void task_done() const { tasks_.fetch_sub(1, std::memory_order_release); }
 };
 
+inline eval_result<void> EffectJournal::commit(Mark m,
+                                               EvaluationContext& ctx) {
+  eval_result<void> done = outcome::success();
+  for (auto it = entries_.begin() + m; done and it != entries_.end(); ++it) {
+    if (auto const* set = std::get_if<SetValue>(&**it)) {
+      done = ctx.set_value(set->id, set->value);
+    } else {
+      auto const& define = std::get<DefineFunction>(**it);
+      done =
+          ctx.define_function(define.id, UserDefinedFunction{define.closure});
+    }
+  }
+  rollback(m);
+  return done;
+}
+
+inline bool Lambda::compiled_for(Code const& c, EvaluationContext const& ctx,
+                                 bool parallel) {
+  EvaluationContext const* owner = ctx.function_owner();
+  return c.owner == owner and c.owner_epoch == owner->owner_epoch() and
+         c.parallel == parallel;
+}
+
+inline Chunk const& Lambda::add_code(EvaluationContext const& ctx,
+                                     bool parallel,
+                                     std::shared_ptr<Chunk const> chunk) const {
+  std::lock_guard const lock{mutex_};
+  for (auto const& c : code_) {
+    if (compiled_for(*c, ctx, parallel)) return *c->chunk;
+  }
+  EvaluationContext const* owner = ctx.function_owner();
+  code_.push_back(std::make_unique<Code const>(
+      Code{owner, owner->owner_epoch(), parallel, std::move(chunk)}));
+  last_.store(code_.back().get(), std::memory_order_release);
+  return *code_.back()->chunk;
+}
+
 }  // namespace guci
@@ -0,0 +1,131 @@
+#include "guci/eval/eval.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "catch2/catch.hpp"
+
+namespace guci {
+
+namespace {
+// Tells which entry point it was called through.
+struct Entries {
+  EvaluationResult operator()(EvaluationContext&, std::span<Term const>) const {
+    return Term{Number(0)};
+  }
+  EvaluationResult operator()(EvaluationContext&, Term const&) const {
+    return Term{Number(1)};
+  }
+  EvaluationResult operator()(EvaluationContext&, Term const&,
+                              Term const&) const {
+    return Term{Number(2)};
+  }
+};
+
+EvaluationResult generic_only(EvaluationContext&, std::span<Term const> args) {
+  return Term{Number(static_cast<std::int64_t>(args.size()))};
+}
+}  // namespace
+
+TEST_CASE("builtins take the entry point for the argument count", "[eval]") {
+  EvaluationContext ctx{{}, {}};
+  BuiltInFunction const f(BuiltInFunction::kAnyArity, Entries{});
+  std::vector<Term> const args{Number(7), Number(8), Number(9)};
+  auto const called = [&](std::size_t n) {
+    return f.apply(ctx, std::span{args}.first(n)).value().t;
+  };
+
+  REQUIRE(called(0) == Number(0));
+  REQUIRE(called(1) == Number(1));
+  REQUIRE(called(2) == Number(2));
+  REQUIRE(called(3) == Number(0));
+}
+
+TEST_CASE("builtins store function pointers and captures", "[eval]") {
+  EvaluationContext ctx{{}, {}};
+  std::vector<Term> const args{Number(7), Number(8)};
+
+  BuiltInFunction const pointer(BuiltInFunction::kAnyArity, generic_only);
+  REQUIRE(pointer.apply(ctx, args).value().t == Number(2));
+
+  int calls = 0;
+  BuiltInFunction const counting(
+      0, [&calls](EvaluationContext&, std::span<Term const>) {
+        ++calls;
+        return EvaluationResult{Term{NIL}};
+      });
+  BuiltInFunction const copy = counting;
+  REQUIRE(copy.apply(ctx, {}));
+  REQUIRE(counting.apply(ctx, {}));
+  REQUIRE(calls == 2);
+}
+
+TEST_CASE("journal commits and rolls back nested calls", "[eval]") {
+  EvaluationContext ctx{{}, {}};
+  EffectJournal& journal = ctx.journal();
+  Identifier const a{"a"};
+  Identifier const b{"b"};
+
+  auto const outer = journal.mark();
+  journal.record(SetValue{a, Number(1)});
+  auto const inner = journal.mark();
+  journal.record(SetValue{b, Number(2)});
+  journal.rollback(inner);
+  REQUIRE(journal.commit(outer, ctx));
+  REQUIRE(*ctx.find_value(a) == Number(1));
+  REQUIRE(ctx.find_value(b) == nullptr);
+
+  // the entry after a failing one is dropped too
+  journal.record(SetValue{a, Number(3)});
+  journal.record(SetValue{b, Number(4)});
+  REQUIRE(journal.commit(journal.mark() - 2, ctx).error().msg() ==
+          "value already exists");
+  REQUIRE(ctx.find_value(b) == nullptr);
+  REQUIRE(journal.mark() == 0);
+}
+
+TEST_CASE("defined functions are never shadowed", "[eval]") {
+  EvaluationContext global{{}, {}};
+  EvaluationContext child{&global, {}, {}};
+  Identifier const f{"f"};
+  auto const closure = Closure{std::make_shared<ClosureData const>(
+      ClosureData{std::make_shared<Lambda const>(
+                      std::vector<SymbolId>{}, std::vector<SymbolId>{},
+                      Term{Number(1)}),
+                  {}})};
+
+  auto const epoch = EvaluationContext::function_epoch();
+  REQUIRE(global.define_function(f, UserDefinedFunction{closure}));
+  REQUIRE(EvaluationContext::function_epoch() > epoch);
+  REQUIRE(global.function_owner() == &global);
+  REQUIRE(child.find_function(f) != nullptr);
+
+  REQUIRE(global.define_function(f, UserDefinedFunction{closure})
+              .error()
+              .msg() == "function already exists");
+  REQUIRE(child.define_function(f, UserDefinedFunction{closure})
+              .error()
+              .msg() == "function already exists");
+}
+
+TEST_CASE("local scopes bind values on top of their parent", "[eval]") {
+  Identifier const a{"a"};
+  Identifier const b{"b"};
+  EvaluationContext global{{}, {{"a", Number(1)}}};
+  EvaluationContext scope{EvaluationContext::LocalScope{}, &global};
+
+  REQUIRE(scope.set_value(a, Number(2)));
+  REQUIRE(scope.set_value(b, Number(3)));
+  REQUIRE(scope.set_value(b, Number(4)).error().msg() ==
+          "value already exists");
+  REQUIRE(*scope.find_value(a) == Number(2));
+  REQUIRE(*scope.find_value(b) == Number(3));
+  REQUIRE(*global.find_value(a) == Number(1));
+  REQUIRE(global.find_value(b) == nullptr);
+  REQUIRE(scope.contains(b));
+  REQUIRE(not global.contains(b));
+}
+
+}  // namespace guci
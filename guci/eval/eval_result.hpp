@@ -1,21 +1,18 @@
 #pragma once
 
-#include "guci/eval/actions.hpp"
+#include <utility>
+
 #include "guci/eval/eval_error.hpp"
+#include "guci/parse/ast.hpp"
 
 namespace guci {
+// Side effects are not part of a result; builtins record them in the
+// EffectJournal of their context.
 class EvaluationSuccess {
  public:
   Term t;
-  std::vector<Action> as;
-
-  EvaluationSuccess(Term term) : t{term}, as{} {}
-  EvaluationSuccess(Term term, std::vector<Action> actions)
-      : t{term}, as(std::move(actions)) {}
 
-  void merge_action_from(std::vector<Action>&& other) {
-    as.insert(as.end(), other.begin(), other.end());
-  }
+  EvaluationSuccess(Term term) : t{std::move(term)} {}
 };
 
 using EvaluationResult = eval_result<EvaluationSuccess>;
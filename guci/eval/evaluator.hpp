@@ -0,0 +1,780 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <span>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+#include "guci/eval/ast_eval_utils.hpp"
+#include "guci/eval/compiler.hpp"
+#include "guci/eval/eval.hpp"
+#include "guci/eval/eval_error.hpp"
+#include "guci/eval/memo.hpp"
+#include "guci/eval/optimizer.hpp"
+#include "guci/eval/parallel.hpp"
+#include "guci/eval/vectors.hpp"
+#include "guci/eval/vm.hpp"
+#include "guci/parse/ast.hpp"
+#include "guci/parse/reader.hpp"
+#include "guci/utils/outcome.hpp"
+#include "guci/utils/overload.hpp"
+
+namespace guci {
+
+inline EvaluationResult call_closure(Closure const& closure,
+                                     EvaluationContext& ctx,
+                                     std::span<Term const> args);
+
+inline EvaluationResult apply(Function const& fun, EvaluationContext& ctx,
+                              std::span<Term const> args) {
+  auto const v = overload(
+      [&](BuiltInFunction const& f) -> EvaluationResult {
+        if (not f.acceptsArgumentNumber(args.size())) {
+          return EvalError{"arity mismatch"};
+        }
+        return f.apply(ctx, args);
+      },
+      [&](UserDefinedFunction const& f) -> EvaluationResult {
+        return call_closure(f.closure, ctx, args);
+      });
+  return std::visit(v, fun());
+}
+
+class EvaluatingVisitor {
+  EvaluationContext* context_;
+
+ public:
+  EvaluatingVisitor(EvaluationContext& context)
+      : context_{std::addressof(context)} {}
+
+  EvaluationResult operator()(List<Term> const& l) {
+    if (l.empty()) return Term{Nil{}};
+
+    auto v = overload(
+        [this, &l](Identifier const& id) -> EvaluationResult {
+          Function const* f = context_->find_function(id);
+          if (f == nullptr) return EvalError{"function not found"};
+
+          return apply(*f, *context_, l.tail());
+        },
+        [](auto const&) -> EvaluationResult {
+          return EvalError{"not a function"};
+        });
+
+    EffectJournal& journal = context_->journal();
+    auto const mark = journal.mark();
+    EvaluationResult result = std::visit(v, l.at(0).term());
+    if (not result) {
+      journal.rollback(mark);
+      return result;
+    }
+    OUTCOME_TRYV(journal.commit(mark, *context_));
+    return result;
+  }
+
+  EvaluationResult operator()(Number const& n) { return Term{n}; }
+
+  EvaluationResult operator()(Identifier const& id) {
+    Term const* t = context_->find_value(id);
+    if (t == nullptr) {
+      return Term{id};
+    }
+
+    return *t;
+  }
+
+  EvaluationResult operator()(Nil const&) { return Term{NIL}; }
+
+  EvaluationResult operator()(String const& s) { return Term{s}; }
+
+  EvaluationResult operator()(Boolean const& b) { return Term{b}; }
+
+  EvaluationResult operator()(Closure const& c) { return Term{c}; }
+
+  EvaluationResult operator()(Future const& f) { return Term{f}; }
+
+  EvaluationResult operator()(Vector const& v) { return Term{v}; }
+};
+
+// The machine evaluate() runs on in the calling thread.
+inline VirtualMachine& thread_vm() {
+  thread_local VirtualMachine vm;
+  return vm;
+}
+
+// Runs the body of `closure` on the values `args` on the machine of this
+// thread, so that its tail calls run in constant space whichever builtin
+// calls it. The body gets a scope of its own below ctx.global(), so it sees
+// its parameters, the values it captured and the globals, but not the
+// locals of its caller; its effects go to the journal of `ctx`. The body of
+// a memoized closure only runs if the cache has no result yet.
+inline EvaluationResult apply_closure(Closure const& closure,
+                                      EvaluationContext& ctx,
+                                      std::vector<Term> args) {
+  EvaluationContext body{EvaluationContext::LocalScope{}, ctx.global(),
+                         ctx.journal()};
+  return thread_vm().run_closure(closure, std::move(args), body);
+}
+
+// Evaluates `args` in `ctx` and runs the body of `closure` on them.
+inline EvaluationResult call_closure(Closure const& closure,
+                                     EvaluationContext& ctx,
+                                     std::span<Term const> args) {
+  if (args.size() != closure.data().lambda->params.size()) {
+    return EvalError{"arity mismatch"};
+  }
+  std::vector<Term> values;
+  values.reserve(args.size());
+  for (Term const& a : args) {
+    EvaluationSuccess arg =
+        OUTCOME_TRYX(std::visit(EvaluatingVisitor{ctx}, *a));
+    values.push_back(std::move(arg.t));
+  }
+  return apply_closure(closure, ctx, std::move(values));
+}
+
+class PrintingVisitor {
+  std::stringstream s;
+
+ public:
+  std::string get() { return s.str(); }
+
+  void operator()(List<Term> const& l) {
+    s << '[';
+    const auto num_elements = l.size();
+    for (int i = 0; i < num_elements; ++i) {
+      if (i > 0) s << ' ';
+      std::visit(*this, l.at(i).term());
+    }
+    s << ']';
+  }
+
+  template <typename T>
+  void operator()(T const& t) {
+    s << t;
+  }
+};
+
+// Optimizes and compiles `t` to bytecode and runs it; same result as
+// EvaluatingVisitor.
+inline EvaluationResult evaluate(EvaluationContext& context, Term const& t) {
+  return thread_vm().run(compile(context, optimize(context, t)), context);
+}
+
+inline std::string show_result(EvaluationContext& context, Term const& t) {
+  EvaluationResult res = evaluate(context, t);
+
+  if (!res) {
+    return res.error().msg();
+  }
+  EvaluationSuccess es = res.value();
+  PrintingVisitor v;
+  std::visit(v, *es.t);
+
+  return v.get();
+}
+
+inline std::string show_result(EvaluationContext& context,
+                               std::string_view input) {
+  auto parsed = read(input);
+  if (not parsed) {
+    return parsed.error().msg;
+  }
+
+  return show_result(context, parsed.value());
+}
+
+namespace detail {
+inline simd::Arith vector_op(std::plus<>) { return simd::Arith::Add; }
+inline simd::Arith vector_op(std::minus<>) { return simd::Arith::Subtract; }
+inline simd::Arith vector_op(std::multiplies<>) {
+  return simd::Arith::Multiply;
+}
+
+// folds `arg` into `acc` with `op`; both must be Numbers or Vectors
+template <typename Op>
+eval_result<void> fold_value(EvaluationSuccess& acc, Term const& arg, Op op) {
+  auto const* lhs = std::get_if<Number>(&*acc.t);
+  auto const* rhs = std::get_if<Number>(&*arg);
+  if (lhs == nullptr or rhs == nullptr) {
+    acc.t = OUTCOME_TRYX(vector_arithmetic(vector_op(op), acc.t, arg));
+    return outcome::success();
+  }
+  acc.t = Term{op(*lhs, *rhs)};
+  return outcome::success();
+}
+
+// evaluates `t` and folds it into `acc` with `op`; both must be Numbers or
+// Vectors
+template <typename Op>
+eval_result<void> fold_argument(EvaluationContext& ctx, EvaluationSuccess& acc,
+                                Term const& t, Op op) {
+  EvaluationSuccess arg = OUTCOME_TRYX(std::visit(EvaluatingVisitor{ctx}, *t));
+  return fold_value(acc, arg.t, op);
+}
+
+// the value of args[i], from the pool if it was forked; otherwise a call is
+// compiled and run on this thread's machine, as a forked one is on the
+// task's, so that its tail calls run in constant space there too
+inline EvaluationResult argument(EvaluationContext& ctx,
+                                 std::span<Term const> args,
+                                 ForkedArguments const& forked,
+                                 std::size_t i) {
+  if (FutureData const* f = forked[i]) return f->get();
+  if (std::holds_alternative<List<Term>>(*args[i])) {
+    return evaluate(ctx, args[i]);
+  }
+  return std::visit(EvaluatingVisitor{ctx}, *args[i]);
+}
+
+// folds `args` into `acc` with `op` in turn, with those of them `forking`
+// chooses forked first
+template <typename Op>
+eval_result<void> fold_arguments(EvaluationContext& ctx,
+                                 EvaluationSuccess& acc,
+                                 std::span<Term const> args, Op op,
+                                 Forking forking) {
+  ForkedArguments const forked{ctx, args, forking};
+  for (std::size_t i = 0; i < args.size(); ++i) {
+    EvaluationSuccess arg = OUTCOME_TRYX(argument(ctx, args, forked, i));
+    OUTCOME_TRYV(fold_value(acc, arg.t, op));
+  }
+  return outcome::success();
+}
+
+// evaluates `t`, which must be a Number
+inline eval_result<Number> number_argument(EvaluationContext& ctx,
+                                           Term const& t) {
+  EvaluationSuccess arg = OUTCOME_TRYX(std::visit(EvaluatingVisitor{ctx}, *t));
+  auto const* n = std::get_if<Number>(&*arg.t);
+  if (n == nullptr) {
+    return EvalError("unbound variables in arithmetic expression");
+  }
+  return *n;
+}
+}  // namespace detail
+
+// Add, Subtract and Multiply fork their arguments as `forking` says; see
+// ForkedArguments. Called with two Terms, they only do in the parallel
+// mode.
+class Add {
+ public:
+  EvaluationResult operator()(EvaluationContext& ctx, std::span<Term const> ts,
+                              Forking forking = Forking::Auto) const {
+    EvaluationSuccess es{Number(0)};
+    OUTCOME_TRYV(
+        detail::fold_arguments(ctx, es, ts, std::plus<>{}, forking));
+    return es;
+  }
+
+  EvaluationResult operator()(EvaluationContext& ctx, Term const& a,
+                              Term const& b) const {
+    if (parallel_mode()) return (*this)(ctx, std::array{a, b});
+    EvaluationSuccess es{Number(0)};
+    OUTCOME_TRYV(detail::fold_argument(ctx, es, a, std::plus<>{}));
+    OUTCOME_TRYV(detail::fold_argument(ctx, es, b, std::plus<>{}));
+    return es;
+  }
+};
+
+class Subtract {
+ public:
+  EvaluationResult operator()(EvaluationContext& ctx,
+                              std::span<Term const> args,
+                              Forking forking = Forking::Auto) const {
+    ForkedArguments const forked{ctx, args, forking};
+    EvaluationSuccess es =
+        OUTCOME_TRYX(detail::argument(ctx, args, forked, 0));
+    for (std::size_t i = 1; i < args.size(); ++i) {
+      EvaluationSuccess arg =
+          OUTCOME_TRYX(detail::argument(ctx, args, forked, i));
+      OUTCOME_TRYV(detail::fold_value(es, arg.t, std::minus<>{}));
+    }
+    return es;
+  }
+
+  EvaluationResult operator()(EvaluationContext& ctx, Term const& a) const {
+    return std::visit(EvaluatingVisitor{ctx}, *a);
+  }
+
+  EvaluationResult operator()(EvaluationContext& ctx, Term const& a,
+                              Term const& b) const {
+    if (parallel_mode()) return (*this)(ctx, std::array{a, b});
+    EvaluationSuccess es = OUTCOME_TRYX((*this)(ctx, a));
+    OUTCOME_TRYV(detail::fold_argument(ctx, es, b, std::minus<>{}));
+    return es;
+  }
+};
+
+class Multiply {
+ public:
+  EvaluationResult operator()(EvaluationContext& ctx, std::span<Term const> ts,
+                              Forking forking = Forking::Auto) const {
+    EvaluationSuccess es{Number(1)};
+    OUTCOME_TRYV(
+        detail::fold_arguments(ctx, es, ts, std::multiplies<>{}, forking));
+    return es;
+  }
+
+  EvaluationResult operator()(EvaluationContext& ctx, Term const& a,
+                              Term const& b) const {
+    if (parallel_mode()) return (*this)(ctx, std::array{a, b});
+    EvaluationSuccess es{Number(1)};
+    OUTCOME_TRYV(detail::fold_argument(ctx, es, a, std::multiplies<>{}));
+    OUTCOME_TRYV(detail::fold_argument(ctx, es, b, std::multiplies<>{}));
+    return es;
+  }
+};
+
+class Let {
+ public:
+  EvaluationResult operator()(EvaluationContext& ctx,
+                              std::span<Term const> args) const {
+    return (*this)(ctx, args[0], args[1]);
+  }
+
+  EvaluationResult operator()(EvaluationContext& ctx, Term const& name,
+                              Term const& value) const {
+    Identifier id = OUTCOME_TRYX(as_identifier(name));
+    ctx.journal().record(SetValue(id, value));
+    return value;
+  }
+};
+
+inline constexpr Let builtin_let{};
+
+inline EvaluationResult builtin_if(EvaluationContext& ctx,
+                                   std::span<Term const> args) {
+  EvaluationSuccess condition =
+      OUTCOME_TRYX(std::visit(EvaluatingVisitor{ctx}, *args[0]));
+  return std::visit(EvaluatingVisitor{ctx},
+                    *args[is_true(condition.t) ? 1 : 2]);
+}
+
+// (op a b) on two Numbers, as a Boolean
+template <typename Op>
+class Compare {
+ public:
+  EvaluationResult operator()(EvaluationContext& ctx,
+                              std::span<Term const> args) const {
+    return (*this)(ctx, args[0], args[1]);
+  }
+
+  EvaluationResult operator()(EvaluationContext& ctx, Term const& a,
+                              Term const& b) const {
+    Number const lhs = OUTCOME_TRYX(detail::number_argument(ctx, a));
+    Number const rhs = OUTCOME_TRYX(detail::number_argument(ctx, b));
+    return Term{Boolean{Op{}(lhs, rhs)}};
+  }
+};
+
+// A closure of `lambda` with the values its free variables have in `ctx`.
+inline Closure make_closure(EvaluationContext const& ctx,
+                            std::shared_ptr<Lambda const> lambda,
+                            bool memoized = false) {
+  std::vector<std::optional<Term>> captures;
+  captures.reserve(lambda->free.size());
+  for (SymbolId id : lambda->free) {
+    Term const* t = ctx.find_value(Identifier::from_id(id));
+    captures.push_back(t != nullptr ? std::optional{*t} : std::nullopt);
+  }
+  return make_closure(std::move(lambda), std::move(captures), memoized);
+}
+
+inline EvaluationResult builtin_lambda(EvaluationContext& ctx,
+                                       std::span<Term const> args) {
+  auto lambda = OUTCOME_TRYX(make_lambda(ctx, args[0], args[1]));
+  return Term{make_closure(ctx, std::move(lambda))};
+}
+
+inline EvaluationResult builtin_funcall(EvaluationContext& ctx,
+                                        std::span<Term const> args) {
+  EvaluationSuccess f =
+      OUTCOME_TRYX(std::visit(EvaluatingVisitor{ctx}, *args[0]));
+  auto const* closure = std::get_if<Closure>(&*f.t);
+  if (closure == nullptr) return EvalError("not a function");
+  return call_closure(*closure, ctx, args.subspan(1));
+}
+
+// (define name params body) makes a function of the global scope; it takes
+// effect once the call returns.
+inline EvaluationResult builtin_define(EvaluationContext& ctx,
+                                       std::span<Term const> args) {
+  Identifier const name = OUTCOME_TRYX(as_identifier(args[0]));
+  if (ctx.is_local()) return EvalError("define outside the global scope");
+  auto lambda = OUTCOME_TRYX(make_lambda(ctx, args[1], args[2]));
+  ctx.journal().record(DefineFunction{name, make_closure(ctx, lambda)});
+  return Term{name};
+}
+
+// (memoize f) is a closure like `f` whose results are cached; fails unless
+// they depend only on the arguments, see check_memoizable().
+inline EvaluationResult builtin_memoize(EvaluationContext& ctx,
+                                        std::span<Term const> args) {
+  EvaluationSuccess f =
+      OUTCOME_TRYX(std::visit(EvaluatingVisitor{ctx}, *args[0]));
+  auto const* closure = std::get_if<Closure>(&*f.t);
+  if (closure == nullptr) return EvalError("not a function");
+  ClosureData const& data = closure->data();
+  if (data.memoized) return f;
+  OUTCOME_TRYV(check_memoizable(ctx, data));
+  return Term{make_closure(data.lambda, data.captures, true)};
+}
+
+// (defmemo name params body) is `define` for a memoized function.
+inline EvaluationResult builtin_defmemo(EvaluationContext& ctx,
+                                        std::span<Term const> args) {
+  Identifier const name = OUTCOME_TRYX(as_identifier(args[0]));
+  if (ctx.is_local()) return EvalError("define outside the global scope");
+  auto lambda = OUTCOME_TRYX(make_lambda(ctx, args[1], args[2]));
+  Closure closure = make_closure(ctx, std::move(lambda), true);
+  OUTCOME_TRYV(check_memoizable(ctx, closure.data(), name));
+  ctx.journal().record(DefineFunction{name, std::move(closure)});
+  return Term{name};
+}
+
+// (memo-capacity n) keeps at most n results in the memo cache, evicting the
+// least recently used ones; returns n.
+inline EvaluationResult builtin_memo_capacity(EvaluationContext& ctx,
+                                              std::span<Term const> args) {
+  Number const n = OUTCOME_TRYX(detail::number_argument(ctx, args[0]));
+  if (not n.is_fixnum() or n.fixnum() < 0) {
+    return EvalError("capacity expected to be a fixnum of at least 0");
+  }
+  MemoCache::global().set_capacity(n.fixnum());
+  return Term{n};
+}
+
+// (memo-stats) is (hits n misses n evictions n size n capacity n).
+inline EvaluationResult builtin_memo_stats(EvaluationContext&,
+                                           std::span<Term const>) {
+  MemoCache::Stats const stats = MemoCache::global().stats();
+  auto const count = [](std::uint64_t n) {
+    return Term{Number(static_cast<std::int64_t>(n))};
+  };
+  return Term{List<Term>{Identifier("hits"), count(stats.hits),
+                         Identifier("misses"), count(stats.misses),
+                         Identifier("evictions"), count(stats.evictions),
+                         Identifier("size"), count(stats.size),
+                         Identifier("capacity"), count(stats.capacity)}};
+}
+
+// (jit on) switches the JIT of this thread's machine off for 0 and anything
+// false, and on otherwise; returns whether it is on, which it never is where
+// it is not available.
+inline EvaluationResult builtin_jit(EvaluationContext& ctx,
+                                    std::span<Term const> args) {
+  EvaluationSuccess on =
+      OUTCOME_TRYX(std::visit(EvaluatingVisitor{ctx}, *args[0]));
+  auto const* n = std::get_if<Number>(&*on.t);
+  thread_vm().set_jit(is_true(on.t) and not(n and *n == Number(0)));
+  return Term{Boolean{thread_vm().jit()}};
+}
+
+// (parallel on) switches the parallel mode off for 0 and anything false, and
+// on otherwise; returns whether it is on. See parallel_mode().
+inline EvaluationResult builtin_parallel(EvaluationContext& ctx,
+                                         std::span<Term const> args) {
+  EvaluationSuccess on =
+      OUTCOME_TRYX(std::visit(EvaluatingVisitor{ctx}, *args[0]));
+  auto const* n = std::get_if<Number>(&*on.t);
+  set_parallel_mode(is_true(on.t) and not(n and *n == Number(0)));
+  return Term{Boolean{parallel_mode()}};
+}
+
+// (pcall f args...) is (f args...), with the arguments that another thread
+// can evaluate with the same result forked first, see ForkedArguments.
+// Builtins only get their arguments that way if they evaluate all of them,
+// as Add, Subtract and Multiply do; other builtins are just called.
+inline EvaluationResult builtin_pcall(EvaluationContext& ctx,
+                                      std::span<Term const> args) {
+  Identifier const name = OUTCOME_TRYX(as_identifier(args[0]));
+  Function const* f = ctx.find_function(name);
+  if (f == nullptr) return EvalError{"function not found"};
+  auto const call_args = args.subspan(1);
+
+  if (auto const* user = std::get_if<UserDefinedFunction>(&(*f)())) {
+    if (call_args.size() != user->closure.data().lambda->params.size()) {
+      return EvalError{"arity mismatch"};
+    }
+    ForkedArguments const forked{ctx, call_args, Forking::Always};
+    std::vector<Term> values;
+    values.reserve(call_args.size());
+    for (std::size_t i = 0; i < call_args.size(); ++i) {
+      EvaluationSuccess arg =
+          OUTCOME_TRYX(detail::argument(ctx, call_args, forked, i));
+      values.push_back(std::move(arg.t));
+    }
+    return apply_closure(user->closure, ctx, std::move(values));
+  }
+
+  auto const& builtin = std::get<BuiltInFunction>((*f)());
+  if (not builtin.acceptsArgumentNumber(call_args.size())) {
+    return EvalError{"arity mismatch"};
+  }
+  switch (builtin.intrinsic()) {
+    case Intrinsic::Add:
+      return Add{}(ctx, call_args, Forking::Always);
+    case Intrinsic::Subtract:
+      return Subtract{}(ctx, call_args, Forking::Always);
+    case Intrinsic::Multiply:
+      return Multiply{}(ctx, call_args, Forking::Always);
+    default:
+      return builtin.apply(ctx, call_args);
+  }
+}
+
+// (future x) is a future of the value of x: forked if another thread can
+// evaluate x with the same result, see forkable(), and evaluated right here
+// otherwise. Errors are kept for `touch`.
+inline EvaluationResult builtin_future(EvaluationContext& ctx,
+                                       std::span<Term const> args) {
+  if (auto captures = forkable(ctx, args[0])) {
+    return Term{Future{fork(ctx, args[0], std::move(*captures))}};
+  }
+  return Term{Future{std::make_shared<FutureData const>(
+      std::visit(EvaluatingVisitor{ctx}, *args[0]))}};
+}
+
+// (touch x) is the value of x, or the value of the future x once it has
+// one.
+inline EvaluationResult builtin_touch(EvaluationContext& ctx,
+                                      std::span<Term const> args) {
+  EvaluationSuccess x =
+      OUTCOME_TRYX(std::visit(EvaluatingVisitor{ctx}, *args[0]));
+  if (auto const* f = std::get_if<Future>(&*x.t)) return f->data().get();
+  return x;
+}
+
+// (release-memory) gives the pages of the value heap that hold no values
+// back to the system. Nothing is traced: values are freed by their reference
+// counts as soon as nothing refers to them. Returns (released n mapped n used n),
+// in bytes.
+inline EvaluationResult builtin_release_memory(EvaluationContext&,
+                                              std::span<Term const>) {
+  ValueHeap& heap = ValueHeap::global();
+  std::uint64_t const released = heap.release_free_pages();
+  ValueHeap::Stats const stats = heap.stats();
+  auto const bytes = [](std::uint64_t n) {
+    return Term{Number(static_cast<std::int64_t>(n))};
+  };
+  return Term{List<Term>{Identifier("released"), bytes(released),
+                         Identifier("mapped"), bytes(stats.mapped_bytes),
+                         Identifier("used"), bytes(stats.used_bytes)}};
+}
+
+namespace detail {
+// evaluates `t`, which must be a Vector
+inline eval_result<Vector> vector_argument(EvaluationContext& ctx,
+                                           Term const& t) {
+  EvaluationSuccess arg = OUTCOME_TRYX(std::visit(EvaluatingVisitor{ctx}, *t));
+  auto const* v = std::get_if<Vector>(&*arg.t);
+  if (v == nullptr) return EvalError("vector expected");
+  return *v;
+}
+
+// evaluates `t`, which must be a fixnum
+inline eval_result<std::int64_t> fixnum_argument(EvaluationContext& ctx,
+                                                 Term const& t) {
+  Number const n = OUTCOME_TRYX(number_argument(ctx, t));
+  if (not n.is_fixnum()) return EvalError("fixnum expected");
+  return n.fixnum();
+}
+}  // namespace detail
+
+// (vector x...) is a Vector of the fixnums x. Vectors take part in `+`, `-`
+// and `*`, see vector_arithmetic().
+inline EvaluationResult builtin_vector(EvaluationContext& ctx,
+                                       std::span<Term const> args) {
+  std::vector<std::int64_t> elements;
+  elements.reserve(args.size());
+  for (Term const& t : args) {
+    elements.push_back(OUTCOME_TRYX(detail::fixnum_argument(ctx, t)));
+  }
+  return Term{OUTCOME_TRYX(build_vector(
+      elements.size(),
+      [&](std::int64_t* out) { std::ranges::copy(elements, out); }))};
+}
+
+// (list->vector l) is a Vector of the fixnums of the list l.
+inline EvaluationResult builtin_list_to_vector(EvaluationContext& ctx,
+                                               std::span<Term const> args) {
+  EvaluationSuccess l =
+      OUTCOME_TRYX(std::visit(EvaluatingVisitor{ctx}, *args[0]));
+  if (std::holds_alternative<Nil>(*l.t)) return Term{Vector{}};
+  auto const* list = std::get_if<List<Term>>(&*l.t);
+  if (list == nullptr) return EvalError("list expected");
+  bool fixnums = true;
+  auto const fill = [&](std::int64_t* out) {
+    for (int i = 0; i < list->size(); ++i) {
+      auto const* n = std::get_if<Number>(&*list->at(i));
+      fixnums = fixnums and n != nullptr and n->is_fixnum();
+      out[i] = fixnums ? n->fixnum() : 0;
+    }
+  };
+  Vector v = OUTCOME_TRYX(build_vector(list->size(), fill));
+  if (not fixnums) return EvalError("vector elements must be fixnums");
+  return Term{std::move(v)};
+}
+
+// (range n) is the Vector 0, 1, ... n - 1, and (range start end) the one
+// from start up to end, not including it.
+inline EvaluationResult builtin_range(EvaluationContext& ctx,
+                                      std::span<Term const> args) {
+  if (args.size() > 2) return EvalError{"arity mismatch"};
+  std::int64_t start = 0;
+  if (args.size() == 2) {
+    start = OUTCOME_TRYX(detail::fixnum_argument(ctx, args[0]));
+  }
+  std::int64_t const end =
+      OUTCOME_TRYX(detail::fixnum_argument(ctx, args.back()));
+  return Term{OUTCOME_TRYX(vector_range(start, end))};
+}
+
+inline EvaluationResult builtin_vector_length(EvaluationContext& ctx,
+                                              std::span<Term const> args) {
+  Vector const v = OUTCOME_TRYX(detail::vector_argument(ctx, args[0]));
+  return Term{Number(static_cast<std::int64_t>(v.size()))};
+}
+
+// (vector-ref v i) is element i of v, counting from 0.
+inline EvaluationResult builtin_vector_ref(EvaluationContext& ctx,
+                                           std::span<Term const> args) {
+  Vector const v = OUTCOME_TRYX(detail::vector_argument(ctx, args[0]));
+  std::int64_t const i = OUTCOME_TRYX(detail::fixnum_argument(ctx, args[1]));
+  if (i < 0 or i >= v.size()) return EvalError("index out of range");
+  return Term{Number(v.view()[i])};
+}
+
+inline EvaluationResult builtin_vector_sum(EvaluationContext& ctx,
+                                           std::span<Term const> args) {
+  Vector const v = OUTCOME_TRYX(detail::vector_argument(ctx, args[0]));
+  return Term{vector_sum(v)};
+}
+
+inline EvaluationResult builtin_vector_product(EvaluationContext& ctx,
+                                               std::span<Term const> args) {
+  Vector const v = OUTCOME_TRYX(detail::vector_argument(ctx, args[0]));
+  return Term{vector_product(v)};
+}
+
+inline EvaluationResult builtin_vector_dot(EvaluationContext& ctx,
+                                           std::span<Term const> args) {
+  Vector const a = OUTCOME_TRYX(detail::vector_argument(ctx, args[0]));
+  Vector const b = OUTCOME_TRYX(detail::vector_argument(ctx, args[1]));
+  return Term{OUTCOME_TRYX(vector_dot(a, b))};
+}
+
+template <bool kMax>
+EvaluationResult builtin_vector_extremum(EvaluationContext& ctx,
+                                         std::span<Term const> args) {
+  Vector const v = OUTCOME_TRYX(detail::vector_argument(ctx, args[0]));
+  return Term{OUTCOME_TRYX(vector_extremum(v, kMax))};
+}
+
+inline EvaluationResult builtin_vector_sort(EvaluationContext& ctx,
+                                            std::span<Term const> args) {
+  Vector const v = OUTCOME_TRYX(detail::vector_argument(ctx, args[0]));
+  return Term{OUTCOME_TRYX(vector_sort(v))};
+}
+
+inline EvaluationResult builtin_eval(EvaluationContext& ctx,
+                                     std::span<Term const> args) {
+  if (args.size() % 2 != 1) {
+    return EvalError("mismatched number of local variables and values");
+  }
+  EvaluationContext local_ctx{EvaluationContext::LocalScope{}, &ctx};
+  for (auto i = 1u; i < args.size(); i += 2) {
+    OUTCOME_TRYV(
+        local_ctx.set_value(OUTCOME_TRYX(as_identifier(args[i])), args[i + 1]));
+  }
+  return std::visit(EvaluatingVisitor{local_ctx}, *args[0]);
+}
+
+inline EvaluationContext make_global_context(
+    bool& program_termination_requested) {
+  return EvaluationContext{
+      {
+          {"+", BuiltInFunction(BuiltInFunction::kAnyArity, Add{},
+                                Intrinsic::Add)},
+          {"-",
+           BuiltInFunction(BuiltInFunction::kAnyPositiveArity, Subtract{},
+                           Intrinsic::Subtract)},
+          {"*", BuiltInFunction(BuiltInFunction::kAnyArity, Multiply{},
+                                Intrinsic::Multiply)},
+          {"quit",
+           BuiltInFunction(0,
+                           [&program_termination_requested](
+                               EvaluationContext&,
+                               std::span<Term const>) -> EvaluationResult {
+                             program_termination_requested = true;
+                             return EvaluationSuccess(NIL);
+                           })},
+          {"let", BuiltInFunction(2, builtin_let, Intrinsic::Let)},
+          {"eval",
+           BuiltInFunction(BuiltInFunction::kAnyPositiveArity, builtin_eval,
+                           Intrinsic::Eval)},
+          {"if", BuiltInFunction(3, builtin_if, Intrinsic::If)},
+          {"=", BuiltInFunction(2, Compare<std::equal_to<>>{},
+                                Intrinsic::Equal)},
+          {"<", BuiltInFunction(2, Compare<std::less<>>{}, Intrinsic::Less)},
+          {">", BuiltInFunction(2, Compare<std::greater<>>{},
+                                Intrinsic::Greater)},
+          {"<=", BuiltInFunction(2, Compare<std::less_equal<>>{},
+                                 Intrinsic::LessEqual)},
+          {">=", BuiltInFunction(2, Compare<std::greater_equal<>>{},
+                                 Intrinsic::GreaterEqual)},
+          {"lambda", BuiltInFunction(2, builtin_lambda, Intrinsic::Lambda)},
+          {"funcall",
+           BuiltInFunction(BuiltInFunction::kAnyPositiveArity,
+                           builtin_funcall, Intrinsic::Funcall)},
+          {"define", BuiltInFunction(3, builtin_define)},
+          {"jit", BuiltInFunction(1, builtin_jit)},
+          {"parallel", BuiltInFunction(1, builtin_parallel)},
+          {"pcall",
+           BuiltInFunction(BuiltInFunction::kAnyPositiveArity, builtin_pcall,
+                           Intrinsic::PCall)},
+          {"future", BuiltInFunction(1, builtin_future, Intrinsic::Future)},
+          {"touch", BuiltInFunction(1, builtin_touch, Intrinsic::Future)},
+          {"release-memory", BuiltInFunction(0, builtin_release_memory)},
+          {"memoize", BuiltInFunction(1, builtin_memoize)},
+          {"defmemo", BuiltInFunction(3, builtin_defmemo)},
+          {"memo-capacity", BuiltInFunction(1, builtin_memo_capacity)},
+          {"memo-stats", BuiltInFunction(0, builtin_memo_stats)},
+          {"vector",
+           BuiltInFunction(BuiltInFunction::kAnyArity, builtin_vector,
+                           Intrinsic::Pure)},
+          {"list->vector",
+           BuiltInFunction(1, builtin_list_to_vector, Intrinsic::Pure)},
+          {"range",
+           BuiltInFunction(BuiltInFunction::kAnyPositiveArity, builtin_range,
+                           Intrinsic::Pure)},
+          {"vector-length",
+           BuiltInFunction(1, builtin_vector_length, Intrinsic::Pure)},
+          {"vector-ref",
+           BuiltInFunction(2, builtin_vector_ref, Intrinsic::Pure)},
+          {"vector-sum",
+           BuiltInFunction(1, builtin_vector_sum, Intrinsic::Pure)},
+          {"vector-product",
+           BuiltInFunction(1, builtin_vector_product, Intrinsic::Pure)},
+          {"vector-dot",
+           BuiltInFunction(2, builtin_vector_dot, Intrinsic::Pure)},
+          {"vector-min", BuiltInFunction(1, builtin_vector_extremum<false>,
+                                         Intrinsic::Pure)},
+          {"vector-max", BuiltInFunction(1, builtin_vector_extremum<true>,
+                                         Intrinsic::Pure)},
+          {"vector-sort",
+           BuiltInFunction(1, builtin_vector_sort, Intrinsic::Pure)},
+      },
+
+      {}};
+}
+
+}  // namespace guci
@@ -0,0 +1,405 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <initializer_list>
+#include <optional>
+#include <variant>
+#include <vector>
+
+#include "guci/eval/bytecode.hpp"
+#include "guci/eval/eval.hpp"
+#include "guci/parse/ast.hpp"
+#include "guci/utils/executable_memory.hpp"
+
+#if defined(__x86_64__) and defined(__linux__)
+#define GUCI_JIT_X86_64 1
+#else
+#define GUCI_JIT_X86_64 0
+#endif
+
+namespace guci {
+
+inline constexpr bool kJitAvailable = GUCI_JIT_X86_64;
+
+// Native code for a function body, called with its arguments as fixnums. It
+// returns false, leaving `result` alone, when the call has to be run by the
+// interpreter instead: when a result does not fit a fixnum, or when it
+// recurses deeper than the native stack is allowed to grow. Native code has
+// no effects, so the interpreter can start the call over.
+using NativeEntry = bool (*)(std::int64_t const* args, std::int64_t* result);
+
+// The tier of one function body, shared by every machine that runs it.
+struct JitState {
+  enum class Tier : std::uint8_t { Interpreted, Compiling, Native, Rejected };
+
+  // lost updates only delay the compilation a little
+  std::atomic<std::uint32_t> calls{0};
+  std::atomic<Tier> tier{Tier::Interpreted};
+  std::atomic<NativeEntry> entry{nullptr};
+  // written by the compiling thread before `entry` is published, and kept
+  // after a bailout since other threads may still be running it
+  std::optional<ExecutableMemory> code;
+
+  // back to the interpreter for good
+  void give_up() {
+    tier.store(Tier::Rejected, std::memory_order_relaxed);
+    entry.store(nullptr, std::memory_order_relaxed);
+  }
+};
+
+namespace jit {
+
+inline constexpr std::size_t kMaxParams = 6;
+// native frames one call from the interpreter may nest
+inline constexpr std::int32_t kMaxDepth = 10000;
+
+// The few x86-64 instructions the JIT needs. Jumps and calls take rel32
+// displacements, patched once their target is known.
+class Assembler {
+  std::vector<std::uint8_t> code_;
+
+ public:
+  std::size_t size() const { return code_.size(); }
+  std::vector<std::uint8_t> const& code() const { return code_; }
+
+  void bytes(std::initializer_list<std::uint8_t> b) {
+    code_.insert(code_.end(), b);
+  }
+  void imm32(std::int32_t v) {
+    for (int i = 0; i < 4; ++i) code_.push_back(std::uint8_t(v >> (8 * i)));
+  }
+  void imm64(std::int64_t v) {
+    for (int i = 0; i < 8; ++i) code_.push_back(std::uint8_t(v >> (8 * i)));
+  }
+
+  // `opcode` followed by a displacement to `target`; when the target is not
+  // known yet (0), returns where the displacement is to be patched
+  std::size_t branch(std::initializer_list<std::uint8_t> opcode,
+                     std::size_t target = 0) {
+    bytes(opcode);
+    std::size_t const at = size();
+    imm32(0);
+    if (target != 0) patch(at, target);
+    return at;
+  }
+  void patch(std::size_t at, std::size_t target) {
+    auto const rel = static_cast<std::int32_t>(target - (at + 4));
+    for (int i = 0; i < 4; ++i) code_[at + i] = std::uint8_t(rel >> (8 * i));
+  }
+
+  void push_rax() { bytes({0x50}); }
+  void pop_rax() { bytes({0x58}); }
+  void pop_rcx() { bytes({0x59}); }
+  void mov_rax(std::int64_t v) {
+    if (v == static_cast<std::int32_t>(v)) {
+      bytes({0x48, 0xC7, 0xC0});  // mov rax, simm32
+      return imm32(static_cast<std::int32_t>(v));
+    }
+    bytes({0x48, 0xB8});  // movabs rax, imm64
+    imm64(v);
+  }
+  // parameter i lives at [r12 - 8 * i]
+  void load_param(std::uint32_t i) {
+    bytes({0x49, 0x8B, 0x84, 0x24});  // mov rax, [r12 + disp32]
+    imm32(-8 * static_cast<std::int32_t>(i));
+  }
+  void store_param(std::uint32_t i) {
+    bytes({0x49, 0x89, 0x84, 0x24});  // mov [r12 + disp32], rax
+    imm32(-8 * static_cast<std::int32_t>(i));
+  }
+  void load_stack(std::size_t offset) {
+    bytes({0x48, 0x8B, 0x84, 0x24});  // mov rax, [rsp + disp32]
+    imm32(static_cast<std::int32_t>(offset));
+  }
+  void drop(std::size_t n) {
+    if (n == 0) return;
+    bytes({0x48, 0x81, 0xC4});  // add rsp, imm32
+    imm32(static_cast<std::int32_t>(n));
+  }
+};
+
+// Translates a function body that only does fixnum arithmetic and
+// comparisons on its parameters, branches on them and calls itself. Values
+// are 64-bit integers or booleans, kept as an operand stack with its top in
+// rax and the rest on the machine stack. r12 points to the parameters of the
+// running call and r13 counts down the nesting left; r14 and r15 hold the
+// stack pointer and result address of the entry, for the bailout.
+class Compiler {
+  enum class Kind : std::uint8_t { Int, Bool };
+  using Stack = std::vector<Kind>;
+
+  EvaluationContext const& ctx_;
+  Lambda const& lambda_;
+  Chunk const& chunk_;
+  Assembler a_;
+  std::size_t pc_ = 0;
+  std::size_t bail_ = 0;
+  std::size_t body_ = 0;
+  // the operand stack jumps to each instruction arrive with, and the
+  // displacements waiting for its address
+  std::vector<std::optional<Stack>> arriving_;
+  std::vector<std::vector<std::size_t>> patches_;
+  // argument counts of the calls whose arguments are being computed
+  std::vector<std::uint32_t> calls_;
+
+  bool calls_itself(Chunk::CallSite const& site) const {
+    Function const* f = ctx_.find_function(Identifier::from_id(site.name));
+    if (f == nullptr) return false;
+    auto const* user = std::get_if<UserDefinedFunction>(&(*f)());
+    return user != nullptr and user->closure.data().lambda.get() == &lambda_;
+  }
+
+  bool jump_to(std::uint32_t target, Stack const& stack,
+               std::initializer_list<std::uint8_t> opcode) {
+    // the bytecode compiler only jumps forward
+    if (target <= pc_ or target >= arriving_.size()) return false;
+    auto& arriving = arriving_[target];
+    if (arriving and *arriving != stack) return false;
+    arriving = stack;
+    patches_[target].push_back(a_.branch(opcode));
+    return true;
+  }
+
+  static bool all_ints(Stack const& s, std::size_t n) {
+    if (s.size() < n) return false;
+    for (std::size_t i = s.size() - n; i < s.size(); ++i) {
+      if (s[i] != Kind::Int) return false;
+    }
+    return true;
+  }
+
+  // lhs on the machine stack, rhs in rax
+  bool binary(Stack& s, Kind result) {
+    if (not all_ints(s, 2)) return false;
+    s.pop_back();
+    s.back() = result;
+    a_.pop_rcx();
+    return true;
+  }
+
+  bool compare(Stack& s, std::uint8_t setcc) {
+    if (not binary(s, Kind::Bool)) return false;
+    a_.bytes({0x48, 0x39, 0xC1});  // cmp rcx, rax
+    a_.bytes({0x0F, setcc, 0xC0});  // setcc al
+    a_.bytes({0x0F, 0xB6, 0xC0});  // movzx eax, al
+    return true;
+  }
+
+  void push_value(Stack& s) {
+    if (not s.empty()) a_.push_rax();
+    s.push_back(Kind::Int);
+  }
+
+  bool instruction(Instruction i, std::optional<Stack>& stack) {
+    Stack& s = *stack;
+    switch (i.op) {
+      case Op::Fixnum:
+        push_value(s);
+        a_.mov_rax(i.fixnum());
+        return true;
+      case Op::LoadLocal:
+        if (i.a != 0 or i.b >= lambda_.params.size()) return false;
+        push_value(s);
+        a_.load_param(i.b);
+        return true;
+      case Op::CheckNumber:
+        return not s.empty() and s.back() == Kind::Int;
+      case Op::Add:
+        if (not binary(s, Kind::Int)) return false;
+        a_.bytes({0x48, 0x01, 0xC8});  // add rax, rcx
+        a_.branch({0x0F, 0x80}, bail_);  // jo bail
+        return true;
+      case Op::Subtract:
+        if (not binary(s, Kind::Int)) return false;
+        a_.bytes({0x48, 0x29, 0xC1});  // sub rcx, rax
+        a_.branch({0x0F, 0x80}, bail_);
+        a_.bytes({0x48, 0x89, 0xC8});  // mov rax, rcx
+        return true;
+      case Op::Multiply:
+        if (not binary(s, Kind::Int)) return false;
+        a_.bytes({0x48, 0x0F, 0xAF, 0xC1});  // imul rax, rcx
+        a_.branch({0x0F, 0x80}, bail_);
+        return true;
+      case Op::Equal:
+        return compare(s, 0x94);
+      case Op::Less:
+        return compare(s, 0x9C);
+      case Op::Greater:
+        return compare(s, 0x9F);
+      case Op::LessEqual:
+        return compare(s, 0x9E);
+      case Op::GreaterEqual:
+        return compare(s, 0x9D);
+      case Op::Jump:
+        if (not jump_to(i.a, s, {0xE9})) return false;
+        stack.reset();
+        return true;
+      case Op::JumpIfFalse: {
+        if (s.empty()) return false;
+        Kind const condition = s.back();
+        s.pop_back();
+        // a number is never false
+        if (condition == Kind::Bool) a_.bytes({0x48, 0x85, 0xC0});  // test
+        if (not s.empty()) a_.pop_rax();
+        return condition == Kind::Int or jump_to(i.a, s, {0x0F, 0x84});
+      }
+      case Op::Callee:
+        if (i.b != lambda_.params.size() or
+            not calls_itself(chunk_.call_sites[i.a])) {
+          return false;
+        }
+        calls_.push_back(i.b);
+        return true;
+      case Op::Apply:
+        return call(i.a, s);
+      case Op::TailApply:
+        if (not tail_call(i.a, s)) return false;
+        stack.reset();
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  bool call(std::uint32_t argc, Stack& s) {
+    if (calls_.empty() or calls_.back() != argc or not all_ints(s, argc)) {
+      return false;
+    }
+    calls_.pop_back();
+    if (not s.empty()) a_.push_rax();
+    a_.bytes({0x41, 0x54});  // push r12
+    a_.bytes({0x4C, 0x8D, 0xA4, 0x24});  // lea r12, [rsp + 8 * argc]
+    a_.imm32(static_cast<std::int32_t>(8 * argc));
+    a_.bytes({0x49, 0xFF, 0xCD});  // dec r13
+    a_.branch({0x0F, 0x84}, bail_);  // jz bail
+    a_.branch({0xE8}, body_);  // call body
+    a_.bytes({0x49, 0xFF, 0xC5});  // inc r13
+    a_.bytes({0x41, 0x5C});  // pop r12
+    a_.drop(8 * argc);
+    s.resize(s.size() - argc);
+    s.push_back(Kind::Int);
+    return true;
+  }
+
+  // the arguments are all that is on the stack, so after they are copied
+  // over the parameters the stack is as it was on entry
+  bool tail_call(std::uint32_t argc, Stack const& s) {
+    if (calls_.empty() or calls_.back() != argc or s.size() != argc or
+        not all_ints(s, argc)) {
+      return false;
+    }
+    calls_.pop_back();
+    if (argc > 0) a_.push_rax();
+    for (std::uint32_t p = 0; p < argc; ++p) {
+      a_.load_stack(8 * (argc - 1 - p));
+      a_.store_param(p);
+    }
+    a_.drop(8 * argc);
+    a_.branch({0xE9}, body_);
+    return true;
+  }
+
+  // the entry from C++, followed by the bailout and then the body
+  void entry() {
+    auto const params = static_cast<std::int32_t>(lambda_.params.size());
+    a_.bytes({0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57});  // push r12-15
+    a_.bytes({0x49, 0x89, 0xE6});  // mov r14, rsp
+    a_.bytes({0x49, 0x89, 0xF7});  // mov r15, rsi
+    a_.bytes({0x49, 0xC7, 0xC5});  // mov r13, kMaxDepth
+    a_.imm32(kMaxDepth);
+    for (std::int32_t p = 0; p < params; ++p) {
+      a_.bytes({0xFF, 0xB7});  // push qword [rdi + 8 * p]
+      a_.imm32(8 * p);
+    }
+    a_.bytes({0x4C, 0x8D, 0xA4, 0x24});  // lea r12, [rsp + 8 * (params - 1)]
+    a_.imm32(8 * (params - 1));
+    std::size_t const to_body = a_.branch({0xE8});  // call body
+    a_.bytes({0x49, 0x89, 0x07});  // mov [r15], rax
+    a_.bytes({0xB8, 0x01, 0x00, 0x00, 0x00});  // mov eax, 1
+    std::size_t const restore = a_.size();
+    a_.bytes({0x4C, 0x89, 0xF4});  // mov rsp, r14
+    a_.bytes({0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C});  // pop r15-12
+    a_.bytes({0xC3});  // ret
+    bail_ = a_.size();
+    a_.bytes({0x31, 0xC0});  // xor eax, eax
+    a_.branch({0xE9}, restore);
+    body_ = a_.size();
+    a_.patch(to_body, body_);
+  }
+
+ public:
+  Compiler(EvaluationContext const& ctx, Lambda const& lambda,
+           Chunk const& chunk)
+      : ctx_{ctx},
+        lambda_{lambda},
+        chunk_{chunk},
+        arriving_(chunk.code.size() + 1),
+        patches_(chunk.code.size() + 1) {}
+
+  // nullopt if the body does anything but the above
+  std::optional<ExecutableMemory> compile() && {
+    if (lambda_.params.size() > kMaxParams) return std::nullopt;
+    entry();
+
+    std::optional<Stack> stack = Stack{};
+    for (pc_ = 0; pc_ <= chunk_.code.size(); ++pc_) {
+      for (std::size_t at : patches_[pc_]) a_.patch(at, a_.size());
+      if (auto const& arriving = arriving_[pc_]) {
+        if (stack and *stack != *arriving) return std::nullopt;
+        stack = arriving;
+      }
+      if (not stack) continue;
+      if (pc_ == chunk_.code.size()) break;
+      if (not instruction(chunk_.code[pc_], stack)) return std::nullopt;
+    }
+    if (stack) {
+      if (*stack != Stack{Kind::Int}) return std::nullopt;
+      a_.bytes({0xC3});  // ret
+    }
+    if (not calls_.empty()) return std::nullopt;
+
+    auto memory = ExecutableMemory::copy_of(a_.code());
+    if (not memory) return std::nullopt;
+    return std::move(memory).value();
+  }
+};
+
+}  // namespace jit
+
+// The native code of `chunk`, the body of `lambda` as compiled for `ctx`,
+// compiling it once the body has been called `threshold` times; null while
+// it is interpreted.
+inline NativeEntry tier_up(JitState& jit, EvaluationContext const& ctx,
+                           Lambda const& lambda, Chunk const& chunk,
+                           std::uint32_t threshold) {
+  if (NativeEntry entry = jit.entry.load(std::memory_order_acquire)) {
+    return entry;
+  }
+  if (not kJitAvailable or
+      jit.tier.load(std::memory_order_relaxed) !=
+          JitState::Tier::Interpreted) {
+    return nullptr;
+  }
+  auto const calls = jit.calls.load(std::memory_order_relaxed) + 1;
+  jit.calls.store(calls, std::memory_order_relaxed);
+  if (calls < threshold) return nullptr;
+
+  auto expected = JitState::Tier::Interpreted;
+  if (not jit.tier.compare_exchange_strong(expected,
+                                           JitState::Tier::Compiling)) {
+    return nullptr;
+  }
+  jit.code = jit::Compiler{ctx, lambda, chunk}.compile();
+  if (not jit.code) {
+    jit.tier.store(JitState::Tier::Rejected, std::memory_order_relaxed);
+    return nullptr;
+  }
+  auto const entry = reinterpret_cast<NativeEntry>(
+      const_cast<void*>(jit.code->data()));
+  jit.tier.store(JitState::Tier::Native, std::memory_order_relaxed);
+  jit.entry.store(entry, std::memory_order_release);
+  return entry;
+}
+
+}  // namespace guci
@@ -0,0 +1,109 @@
+#include "guci/eval/jit.hpp"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "guci/eval/compiler.hpp"
+#include "guci/eval/evaluator.hpp"
+#include "guci/eval/test_helpers.hpp"
+#include "guci/eval/vm.hpp"
+#include "guci/parse/reader.hpp"
+
+namespace guci {
+
+using testing::show;
+
+namespace {
+// The printed results of the forms of `program`, run on `vm` in a fresh
+// global context.
+std::vector<std::string> run(VirtualMachine& vm, std::string_view program) {
+  bool quit = false;
+  EvaluationContext ctx = make_global_context(quit);
+  std::vector<std::string> results;
+  auto const forms = read_all(program).value();
+  for (Term const& t : forms) {
+    results.push_back(show(vm.run(compile(ctx, optimize(ctx, t)), ctx)));
+  }
+  return results;
+}
+}  // namespace
+
+TEST_CASE("native code matches the interpreter", "[jit]") {
+  if (not kJitAvailable) return;
+  auto const program = GENERATE(as<std::string_view>{},
+      "(define fib (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2))))) "
+      "(fib 20) (fib 0) (fib -3) (fib x) (fib \"a\")",
+      "(define tak (x y z) (if (< y x) (tak (tak (- x 1) y z) "
+      "(tak (- y 1) z x) (tak (- z 1) x y)) z)) (tak 12 8 4)",
+      "(define ack (m n) (if (= m 0) (+ n 1) (if (= n 0) (ack (- m 1) 1) "
+      "(ack (- m 1) (ack m (- n 1)))))) (ack 2 9) (ack 3 4)",
+      "(define loop (n acc) (if (= n 0) acc (loop (- n 1) (+ acc n)))) "
+      "(loop 100000 0) (loop 10 9223372036854775800) (loop 3 (* 1 x))",
+      "(define pow (b n) (if (= n 0) 1 (* b (pow b (- n 1))))) "
+      "(pow 2 10) (pow 2 62) (pow 2 63) (pow -2 63) (pow 3 50) (pow 2 3)",
+      "(define sum (n) (if (<= n 0) 0 (+ n (sum (- n 1))))) "
+      "(sum 100) (sum 30000) (sum 100)",
+      "(define ev (n) (if (= n 0) (= 0 0) (od (- n 1)))) "
+      "(define od (n) (if (= n 0) (= 0 1) (ev (- n 1)))) (ev 3001)",
+      "(define k (n) (if n 1 2)) (k 5) (define g (a b) (>= a b)) (g 2 1)",
+      "(define adder (n) (lambda (x) (+ x n))) (funcall (adder 1) 2) "
+      "(define c (n) (if (> n 0) (funcall (adder n) (c (- n 1))) 0)) (c 2000)",
+      "(define big () 99999999999999999999) (big) (define w (x) (let y x)) "
+      "(w 1) (define m (x y) (- x y)) (m 5 9) (m -9223372036854775807 2)");
+
+  VirtualMachine interpreter;
+  interpreter.set_jit(false);
+  VirtualMachine native;
+  native.set_jit_threshold(1);
+
+  REQUIRE(run(native, program) == run(interpreter, program));
+  REQUIRE(interpreter.stats().native_calls == 0);
+}
+
+TEST_CASE("hot functions run natively until they bail out", "[jit]") {
+  if (not kJitAvailable) return;
+  bool quit = false;
+  EvaluationContext ctx = make_global_context(quit);
+  VirtualMachine vm;
+  vm.set_jit_threshold(10);
+  auto const eval = [&](std::string_view source) {
+    return show(vm.run(compile(ctx, read(source).value()), ctx));
+  };
+
+  eval("(define fib (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))");
+  REQUIRE(eval("(fib 3)") == "2");
+  REQUIRE(vm.stats().native_calls == 0);
+  REQUIRE(eval("(fib 25)") == "75025");
+  // once it is native, the recursion stays in native code
+  REQUIRE(vm.stats().native_calls > 0);
+  REQUIRE(vm.stats().native_calls < 100);
+
+  // a result out of fixnum range sends the function back to the interpreter
+  eval("(define pow (b n) (if (= n 0) 1 (* b (pow b (- n 1)))))");
+  for (int i = 0; i < 10; ++i) eval("(pow 2 3)");
+  vm.reset_stats();
+  REQUIRE(eval("(pow 2 3)") == "8");
+  REQUIRE(vm.stats().native_calls == 1);
+  REQUIRE(eval("(pow 2 64)") == "18446744073709551616");
+  REQUIRE(vm.stats().jit_bailouts == 1);
+  REQUIRE(eval("(pow 2 3)") == "8");
+  REQUIRE(vm.stats().native_calls == 1);
+
+  // arguments that are not fixnums are interpreted without giving up
+  vm.reset_stats();
+  REQUIRE(eval("(fib -99999999999999999999)") == "-99999999999999999999");
+  REQUIRE(eval("(fib \"a\")") ==
+          "error: unbound variables in arithmetic expression");
+  REQUIRE(vm.stats().native_calls == 0);
+  REQUIRE(eval("(fib 10)") == "55");
+  REQUIRE(vm.stats().native_calls == 1);
+
+  vm.set_jit(false);
+  vm.reset_stats();
+  REQUIRE(eval("(fib 10)") == "55");
+  REQUIRE(vm.stats().native_calls == 0);
+}
+
+}  // namespace guci
@@ -0,0 +1,224 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "guci/eval/eval.hpp"
+#include "guci/eval/eval_error.hpp"
+#include "guci/parse/ast.hpp"
+
+namespace guci {
+
+// Results of the calls of memoized functions, keyed on the function and the
+// values of the arguments, with the least recently used entry evicted once
+// the cache is full. Keys keep their function alive, so its address is not
+// reused for another one while they may be looked up. Shared by all threads.
+class MemoCache {
+ public:
+  static constexpr std::size_t kDefaultCapacity = 4096;
+
+  struct Key {
+    Closure function;
+    std::vector<Term> args;
+    std::uint64_t hash;
+
+    Key(Closure f, std::vector<Term> a)
+        : function{std::move(f)}, args{std::move(a)}, hash{function.hash()} {
+      for (Term const& t : args) hash = hash_combine(hash, t.hash());
+    }
+
+    bool operator==(Key const&) const = default;
+  };
+
+  struct Stats {
+    std::uint64_t hits = 0;
+    std::uint64_t misses = 0;
+    std::uint64_t evictions = 0;
+    std::size_t size = 0;
+    std::size_t capacity = 0;
+  };
+
+ private:
+  struct Entry {
+    Key key;
+    Term result;
+  };
+
+  struct Hash {
+    std::size_t operator()(Key const* k) const { return k->hash; }
+  };
+  struct Equal {
+    bool operator()(Key const* a, Key const* b) const { return *a == *b; }
+  };
+
+  mutable std::mutex mutex_;
+  // the most recently used first
+  std::list<Entry> entries_;
+  std::unordered_map<Key const*, std::list<Entry>::iterator, Hash, Equal>
+      index_;
+  std::size_t capacity_ = kDefaultCapacity;
+  Stats stats_;
+
+  // the lock is held
+  void evict_to(std::size_t size) {
+    while (entries_.size() > size) {
+      index_.erase(&entries_.back().key);
+      entries_.pop_back();
+      ++stats_.evictions;
+    }
+  }
+
+ public:
+  // Never destroyed, like the values its entries hold.
+  static MemoCache& global() {
+    static MemoCache* const cache = new MemoCache;
+    return *cache;
+  }
+
+  std::optional<Term> find(Key const& key) {
+    std::lock_guard const lock{mutex_};
+    auto const it = index_.find(&key);
+    if (it == index_.end()) {
+      ++stats_.misses;
+      return std::nullopt;
+    }
+    ++stats_.hits;
+    entries_.splice(entries_.begin(), entries_, it->second);
+    return it->second->result;
+  }
+
+  // keeps the result stored first if `key` is there already
+  void insert(Key key, Term result) {
+    std::lock_guard const lock{mutex_};
+    if (capacity_ == 0 or index_.contains(&key)) return;
+    evict_to(capacity_ - 1);
+    entries_.push_front({std::move(key), std::move(result)});
+    index_.emplace(&entries_.front().key, entries_.begin());
+  }
+
+  void set_capacity(std::size_t capacity) {
+    std::lock_guard const lock{mutex_};
+    capacity_ = capacity;
+    evict_to(capacity);
+  }
+
+  void clear() {
+    std::lock_guard const lock{mutex_};
+    index_.clear();
+    entries_.clear();
+  }
+
+  Stats stats() const {
+    std::lock_guard const lock{mutex_};
+    Stats s = stats_;
+    s.size = entries_.size();
+    s.capacity = capacity_;
+    return s;
+  }
+};
+
+namespace detail {
+// Whether the results of a closure depend on nothing but its arguments: all
+// its free variables are captured, since those that are not may still be
+// bound later, and every function its body calls is an intrinsic that
+// records no action, `self`, the function being defined, or a user function
+// of which the same holds. Builtins without an intrinsic and `funcall` may
+// do anything, and so may functions not defined yet.
+class PurityCheck {
+  EvaluationContext const& ctx_;
+  SymbolId self_;
+  std::vector<Lambda const*> seen_;
+
+  bool pure_args(std::span<Term const> args) {
+    return std::ranges::all_of(args, [&](Term const& a) { return pure(a); });
+  }
+
+  bool pure_call(Identifier const& head, std::span<Term const> args) {
+    Function const* f = ctx_.find_function(head);
+    if (f == nullptr) return head.id() == self_ and pure_args(args);
+    if (auto const* user = std::get_if<UserDefinedFunction>(&(*f)())) {
+      return pure(user->closure.data()) and pure_args(args);
+    }
+
+    switch (std::get<BuiltInFunction>((*f)()).intrinsic()) {
+      case Intrinsic::Add:
+      case Intrinsic::Subtract:
+      case Intrinsic::Multiply:
+      case Intrinsic::If:
+      case Intrinsic::Equal:
+      case Intrinsic::Less:
+      case Intrinsic::Greater:
+      case Intrinsic::LessEqual:
+      case Intrinsic::GreaterEqual:
+      case Intrinsic::Future:
+      case Intrinsic::Pure:
+        return pure_args(args);
+      // the bindings of an eval and the parameters of a lambda are data
+      case Intrinsic::Eval:
+        return args.empty() or pure(args[0]);
+      case Intrinsic::Lambda:
+        return args.size() != 2 or pure(args[1]);
+      case Intrinsic::PCall: {
+        auto const* g =
+            args.empty() ? nullptr : std::get_if<Identifier>(&*args[0]);
+        return g == nullptr or pure_call(*g, args.subspan(1));
+      }
+      case Intrinsic::Let:
+      case Intrinsic::Funcall:
+      case Intrinsic::None:
+        return false;
+    }
+    return false;
+  }
+
+ public:
+  PurityCheck(EvaluationContext const& ctx, SymbolId self)
+      : ctx_{ctx}, self_{self} {}
+
+  // whether evaluating `t` has no effects and calls only functions of which
+  // that holds
+  bool pure(Term const& t) {
+    auto const* l = std::get_if<List<Term>>(&*t);
+    if (l == nullptr or l->empty()) return true;
+    auto const* head = std::get_if<Identifier>(&*l->at(0));
+    return head == nullptr or pure_call(*head, l->tail());
+  }
+
+  bool pure(ClosureData const& closure) {
+    // a function already being checked is pure unless the rest of the
+    // bodies being checked are not
+    Lambda const* lambda = closure.lambda.get();
+    if (std::ranges::find(seen_, lambda) != seen_.end()) return true;
+    seen_.push_back(lambda);
+    return std::ranges::all_of(closure.captures,
+                               [](auto const& c) { return c.has_value(); }) and
+           pure(lambda->body);
+  }
+};
+}  // namespace detail
+
+// Fails unless the results of `closure` may be cached; see
+// detail::PurityCheck. `self` is the name it is being defined under, if any.
+inline eval_result<void> check_memoizable(
+    EvaluationContext const& ctx, ClosureData const& closure,
+    std::optional<Identifier> self = std::nullopt) {
+  SymbolId const self_id =
+      self ? self->id() : std::numeric_limits<SymbolId>::max();
+  if (not detail::PurityCheck{ctx, self_id}.pure(closure)) {
+    return EvalError(
+        "cannot memoize a function with side effects or unbound variables");
+  }
+  return outcome::success();
+}
+
+}  // namespace guci
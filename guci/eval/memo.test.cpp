@@ -0,0 +1,124 @@
+#include "guci/eval/memo.hpp"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "catch2/catch.hpp"
+#include "guci/eval/evaluator.hpp"
+#include "guci/parse/reader.hpp"
+
+namespace guci {
+
+namespace {
+MemoCache::Key key(Closure const& f, std::int64_t arg) {
+  return {f, {Term{Number(arg)}}};
+}
+}  // namespace
+
+TEST_CASE("the memo cache evicts the least recently used", "[memo]") {
+  MemoCache cache;
+  cache.set_capacity(2);
+  Closure const f = make_closure(nullptr, {});
+  Closure const g = make_closure(nullptr, {});
+
+  cache.insert(key(f, 1), Number(10));
+  cache.insert(key(g, 1), Number(20));
+  REQUIRE(cache.find(key(f, 1)) == Term{Number(10)});
+  REQUIRE(cache.find(key(g, 1)) == Term{Number(20)});
+  REQUIRE_FALSE(cache.find(key(f, 2)));
+
+  // g was used last, so f goes
+  cache.insert(key(f, 2), Number(11));
+  REQUIRE_FALSE(cache.find(key(f, 1)));
+  REQUIRE(cache.find(key(g, 1)));
+  REQUIRE(cache.find(key(f, 2)));
+
+  auto const stats = cache.stats();
+  REQUIRE(stats.hits == 4);
+  REQUIRE(stats.misses == 2);
+  REQUIRE(stats.evictions == 1);
+  REQUIRE(stats.size == 2);
+  REQUIRE(stats.capacity == 2);
+
+  cache.set_capacity(0);
+  cache.insert(key(f, 3), Number(12));
+  REQUIRE(cache.stats().size == 0);
+}
+
+TEST_CASE("memoized functions run once per argument", "[memo]") {
+  bool quit = false;
+  EvaluationContext ctx = make_global_context(quit);
+  auto const run = [&](std::string_view source) {
+    return show_result(ctx, read(source).value());
+  };
+  MemoCache::global().clear();
+
+  run("(defmemo fib (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))");
+  auto const before = MemoCache::global().stats();
+  // far out of reach without the cache
+  REQUIRE(run("(fib 90)") == "2880067194370816120");
+  auto const after = MemoCache::global().stats();
+  REQUIRE(after.misses - before.misses == 91);
+  REQUIRE(after.size == 91);
+
+  REQUIRE(run("(fib 90)") == "2880067194370816120");
+  REQUIRE(MemoCache::global().stats().hits == after.hits + 1);
+
+  // values bound by `let` are not evaluated, so closures are passed on as
+  // arguments
+  run("(define sq (x) (* x x))");
+  run("(define twice (f x) (+ (funcall f x) (funcall (memoize f) x)))");
+  auto const hits = MemoCache::global().stats().hits;
+  REQUIRE(run("(twice (memoize (lambda (x) (sq x))) 12)") == "288");
+  REQUIRE(MemoCache::global().stats().hits == hits + 1);
+  REQUIRE(run("(twice (lambda (x) (sq x)) 12)") == "288");
+  REQUIRE(MemoCache::global().stats().hits == hits + 1);
+  REQUIRE(run("(memoize 1)") == "not a function");
+
+  // a memoized call has to return to store its result, so it is never a
+  // tail call; the machine keeps such calls on the heap
+  run("(defmemo count (n acc) (if (= n 0) acc (count (- n 1) (+ acc 1))))");
+  REQUIRE(run("(count 100000 0)") == "100000");
+
+  // errors are not cached
+  auto const size = MemoCache::global().stats().size;
+  REQUIRE(run("(twice (memoize (lambda (x) (sq x))) x)") ==
+          "unbound variables in arithmetic expression");
+  REQUIRE(MemoCache::global().stats().size == size);
+}
+
+TEST_CASE("functions with effects are not memoized", "[memo]") {
+  bool quit = false;
+  EvaluationContext ctx = make_global_context(quit);
+  auto const run = [&](std::string_view source) {
+    return show_result(ctx, read(source).value());
+  };
+  std::string const refused =
+      "cannot memoize a function with side effects or unbound variables";
+
+  REQUIRE(run("(defmemo f (x) (let y x))") == refused);
+  REQUIRE(run("(f 1)") == "function not found");
+  REQUIRE(run("(define setter (x) (+ 1 (let z x)))") == "setter");
+  REQUIRE(run("(defmemo g (x) (setter x))") == refused);
+  REQUIRE(run("(memoize (lambda (x) (setter x)))") == refused);
+  REQUIRE(run("(memoize (lambda (x) (funcall x)))") == refused);
+  REQUIRE(run("(memoize (lambda (x) (quit)))") == refused);
+  REQUIRE(run("(defmemo h (x) (later x))") == refused);
+  // `w` may still be bound
+  REQUIRE(run("(defmemo k (x) (+ x w))") == refused);
+
+  REQUIRE(run("(let w 2)") == "2");
+  REQUIRE(run("(defmemo k (x) (+ x w))") == "k");
+  REQUIRE(run("(k 1)") == "3");
+  REQUIRE(run("(define ev (n) (if (= n 0) 1 (od (- n 1))))") == "ev");
+  REQUIRE(run("(define od (n) (if (= n 0) 0 (ev (- n 1))))") == "od");
+  REQUIRE(run("(defmemo parity (n) (+ (ev n) (eval (ev m) m 4)))") ==
+          "parity");
+  REQUIRE(run("(parity 7)") == "1");
+  REQUIRE(run("(memoize (lambda (x) (lambda (y) (+ x y))))") == "#<lambda>");
+  REQUIRE(run("(memo-capacity (- 0 1))") ==
+          "capacity expected to be a fixnum of at least 0");
+}
+
+}  // namespace guci
@@ -0,0 +1,236 @@
+#pragma once
+
+#include <functional>
+#include <optional>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "guci/eval/eval.hpp"
+#include "guci/parse/ast.hpp"
+
+namespace guci {
+
+// Rewrites a Term into one that evaluates to the same result with the same
+// effects, with its closed parts computed once ahead of time: arithmetic on
+// constants, and `eval`s whose body folds to a constant once the constant
+// bindings are substituted. Terms that a builtin receives unevaluated, like
+// the value of a `let`, the bindings of an `eval` and the arguments of
+// builtins that are not intrinsics, are left alone.
+class Optimizer {
+  struct Scope {
+    // nullopt: bound to something that does not evaluate to itself
+    std::vector<std::pair<SymbolId, std::optional<Term>>> bindings;
+    // a builtin that is not an intrinsic ran here and may have bound
+    // anything, which would shadow the scopes around it
+    bool dynamic = false;
+
+    bool binds(SymbolId id) const {
+      for (auto const& [name, value] : bindings) {
+        if (name == id) return true;
+      }
+      return false;
+    }
+  };
+
+  EvaluationContext const& ctx_;
+  std::vector<Scope> scopes_;
+
+  static bool evaluates_to_itself(Term const& t) {
+    return std::holds_alternative<Number>(*t) or
+           std::holds_alternative<String>(*t) or
+           std::holds_alternative<Nil>(*t) or
+           std::holds_alternative<Boolean>(*t);
+  }
+
+  // the constant an identifier certainly refers to at this point
+  Term const* constant(SymbolId id) const {
+    for (auto s = scopes_.rbegin(); s != scopes_.rend(); ++s) {
+      for (auto const& [name, value] : s->bindings) {
+        if (name == id) return value ? &*value : nullptr;
+      }
+      if (s->dynamic) return nullptr;
+    }
+    return nullptr;
+  }
+
+  static Term with_arguments(List<Term> const& l, std::vector<Term> args) {
+    List<Term> result{l.at(0)};
+    for (Term& t : args) result.append(std::move(t));
+    return result;
+  }
+
+  // nullopt if `t` stays as it is
+  std::optional<Term> optimize(Term const& t) {
+    if (auto const* id = std::get_if<Identifier>(&*t)) {
+      if (Term const* c = constant(id->id())) return *c;
+      return std::nullopt;
+    }
+    if (auto const* l = std::get_if<List<Term>>(&*t)) return optimize(*l);
+    return std::nullopt;
+  }
+
+  std::optional<Term> optimize(List<Term> const& l) {
+    // anything that fails here fails the same way at run time
+    if (l.empty()) return std::nullopt;
+    auto const* head = std::get_if<Identifier>(&*l.at(0));
+    if (head == nullptr) return std::nullopt;
+    // anything but a builtin is a user function, which evaluates its
+    // arguments in a scope of its own
+    Function const* f = ctx_.find_function(*head);
+    auto const* builtin =
+        f != nullptr ? std::get_if<BuiltInFunction>(&(*f)()) : nullptr;
+    if (builtin == nullptr) return optimize_arguments(l);
+    if (not builtin->acceptsArgumentNumber(l.tail().size())) {
+      return std::nullopt;
+    }
+
+    switch (builtin->intrinsic()) {
+      case Intrinsic::Add:
+        return fold(l, Number(0), std::plus<>{});
+      case Intrinsic::Subtract:
+        return fold(l, std::nullopt, std::minus<>{});
+      case Intrinsic::Multiply:
+        return fold(l, Number(1), std::multiplies<>{});
+      case Intrinsic::Let:
+        return note_let(l);
+      case Intrinsic::Eval:
+        return optimize_eval(l);
+      case Intrinsic::If:
+      case Intrinsic::Equal:
+      case Intrinsic::Less:
+      case Intrinsic::Greater:
+      case Intrinsic::LessEqual:
+      case Intrinsic::GreaterEqual:
+      case Intrinsic::Funcall:
+      case Intrinsic::Pure:
+        return optimize_arguments(l);
+      case Intrinsic::Lambda:
+        return optimize_lambda(l);
+      case Intrinsic::PCall:
+      case Intrinsic::Future:
+      case Intrinsic::None:
+        if (not scopes_.empty()) scopes_.back().dynamic = true;
+        return std::nullopt;
+    }
+    return std::nullopt;
+  }
+
+  std::optional<Term> optimize_arguments(List<Term> const& l) {
+    auto const args = l.tail();
+    std::vector<Term> optimized;
+    for (std::size_t i = 0; i < args.size(); ++i) {
+      auto o = optimize(args[i]);
+      if (o and optimized.empty()) {
+        optimized.assign(args.begin(), args.begin() + i);
+      }
+      if (o or not optimized.empty()) {
+        optimized.push_back(o ? std::move(*o) : args[i]);
+      }
+    }
+    if (optimized.empty()) return std::nullopt;
+    return with_arguments(l, std::move(optimized));
+  }
+
+  // (op a b c) as ((identity op a) op b) op c; without an identity, as
+  // Subtract does, (op a) is a whatever it is. A leading run of numbers is
+  // folded into one, so only arguments after it are collected.
+  template <typename Op>
+  std::optional<Term> fold(List<Term> const& l, std::optional<Number> acc,
+                           Op op) {
+    auto const args = l.tail();
+    std::size_t numbers = 0;
+    std::vector<Term> rest;
+    bool changed = false;
+    for (Term const& t : args) {
+      auto o = optimize(t);
+      changed = changed or o.has_value();
+      Term const& arg = o ? *o : t;
+      auto const* n = std::get_if<Number>(&*arg);
+      if (rest.empty() and n != nullptr) {
+        acc = acc ? op(*acc, *n) : *n;
+        ++numbers;
+        continue;
+      }
+      rest.push_back(o ? std::move(*o) : t);
+    }
+
+    if (rest.empty() and acc) return Term{*acc};
+    if (not acc and rest.size() == 1 and evaluates_to_itself(rest[0])) {
+      return rest[0];
+    }
+    if (not changed and numbers < 2) return std::nullopt;
+    if (numbers > 0) rest.insert(rest.begin(), Term{*acc});
+    return with_arguments(l, std::move(rest));
+  }
+
+  // a `let` inside an eval shadows the scopes around it from here on
+  std::optional<Term> note_let(List<Term> const& l) {
+    auto const* id = std::get_if<Identifier>(&*l.at(1));
+    if (id != nullptr and not scopes_.empty() and
+        not scopes_.back().binds(id->id())) {
+      scopes_.back().bindings.push_back({id->id(), std::nullopt});
+    }
+    return std::nullopt;
+  }
+
+  // The body reads the variables around it through captures, which a `let`
+  // in the body may clash with, so they are left as they are.
+  std::optional<Term> optimize_lambda(List<Term> const& l) {
+    auto const* params = std::get_if<List<Term>>(&*l.at(1));
+    if (params == nullptr) return std::nullopt;
+
+    Scope scope{{}, true};
+    for (Term const& p : *params) {
+      auto const* id = std::get_if<Identifier>(&*p);
+      if (id == nullptr) return std::nullopt;
+      scope.bindings.push_back({id->id(), std::nullopt});
+    }
+
+    scopes_.push_back(std::move(scope));
+    auto body = optimize(l.at(2));
+    scopes_.pop_back();
+
+    if (not body) return std::nullopt;
+    return with_arguments(l, {l.at(1), std::move(*body)});
+  }
+
+  std::optional<Term> optimize_eval(List<Term> const& l) {
+    auto const args = l.tail();
+    if (args.size() % 2 != 1) return std::nullopt;
+
+    Scope scope;
+    for (std::size_t i = 1; i < args.size(); i += 2) {
+      auto const* id = std::get_if<Identifier>(&*args[i]);
+      if (id == nullptr or scope.binds(id->id())) return std::nullopt;
+      Term const& value = args[i + 1];
+      scope.bindings.push_back(
+          {id->id(), evaluates_to_itself(value) ? std::optional{value}
+                                                : std::nullopt});
+    }
+
+    scopes_.push_back(std::move(scope));
+    auto body = optimize(args[0]);
+    scopes_.pop_back();
+
+    if (not body) return std::nullopt;
+    if (evaluates_to_itself(*body)) return body;
+    std::vector<Term> rest{std::move(*body)};
+    rest.insert(rest.end(), args.begin() + 1, args.end());
+    return with_arguments(l, std::move(rest));
+  }
+
+ public:
+  explicit Optimizer(EvaluationContext const& ctx) : ctx_{ctx} {}
+
+  Term optimize_term(Term const& t) && {
+    auto o = optimize(t);
+    return o ? std::move(*o) : t;
+  }
+};
+
+inline Term optimize(EvaluationContext const& ctx, Term const& t) {
+  return Optimizer{ctx}.optimize_term(t);
+}
+
+}  // namespace guci
@@ -0,0 +1,77 @@
+#include "guci/eval/optimizer.hpp"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "guci/eval/evaluator.hpp"
+#include "guci/eval/test_helpers.hpp"
+#include "guci/parse/reader.hpp"
+
+namespace guci {
+
+using testing::show;
+using testing::with_generic_builtins;
+
+TEST_CASE("optimized terms evaluate like the originals", "[optimizer]") {
+  auto const program = GENERATE(as<std::string_view>{},
+      "(+ 1 2 3) (* 2 (- 10 1 2)) (- 5) (- \"s\") (- x) (+ 1 \"a\") (+)",
+      "(+ 9223372036854775807 1) (* 4294967296 4294967296 -1) (+ x (* 2 3))",
+      "(eval (+ a b) a 1 b 2) (eval a a (1 2)) (eval s s \"x\") (eval b a 1)",
+      "(eval (+ a 1) a (+ 1 2)) (eval (+ a 1) a b) (eval 1 2 3)",
+      "(eval a a 1 a 2) (- 9 (+ 1 2) 1 x 2) (+ 1 2 \"a\" 3) (* 2 x)",
+      "(eval (* a (eval (+ a b) b 3)) a 2) (eval (eval (+ a b) b 2) a 1)",
+      "(eval (eval (+ (let a 5) a)) a 1) (eval (+ a (let a 2)) a 1)",
+      "(eval (+ a (eval (let a 5) q 0) a) a 1) (eval (+ (let b 2) b) a 1)",
+      "(eval (eval (+ (bind a 5) a) q 0) a 1) (eval (+ (sum 1) a) a 1)",
+      "(eval (+ (bind b 1) (eval (+ b 1) q 0)) a 1) (let y (+ 1 2)) y",
+      "(eval (- a) a \"s\") (eval (- (+ a 1) b) a 1 b 2) (+ (let z 1) z)");
+
+  bool quit_tree = false;
+  bool quit_optimized = false;
+  EvaluationContext const tree_global = make_global_context(quit_tree);
+  EvaluationContext const optimized_global =
+      make_global_context(quit_optimized);
+  EvaluationContext tree_ctx = with_generic_builtins(tree_global);
+  EvaluationContext optimized_ctx = with_generic_builtins(optimized_global);
+
+  auto const forms = read_all(program).value();
+  for (Term const& t : forms) {
+    Term const o = optimize(optimized_ctx, t);
+    REQUIRE(show(std::visit(EvaluatingVisitor{tree_ctx}, *t)) ==
+            show(std::visit(EvaluatingVisitor{optimized_ctx}, *o)));
+  }
+}
+
+TEST_CASE("closed subexpressions are folded", "[optimizer]") {
+  bool quit = false;
+  EvaluationContext const global = make_global_context(quit);
+  EvaluationContext const ctx = with_generic_builtins(global);
+  auto const optimized = [&](std::string_view in) {
+    return optimize(ctx, read(in).value());
+  };
+  auto const term = [](std::string_view in) { return read(in).value(); };
+
+  REQUIRE(optimized("(+ 1 (* 2 3))") == Number(7));
+  REQUIRE(optimized("(- \"s\")") == String("s"));
+  REQUIRE(optimized("(eval (+ a (eval (* a b) b 3)) a 2)") == Number(8));
+  REQUIRE(optimized("(+ x (* 2 3))") == term("(+ x 6)"));
+  REQUIRE(optimized("(- 9 (+ 1 2) 1 x 2)") == term("(- 5 x 2)"));
+  REQUIRE(optimized("(* 2 x)") == term("(* 2 x)"));
+  REQUIRE(optimized("(eval (+ a c) a 1)") == term("(eval (+ 1 c) a 1)"));
+
+  // unevaluated arguments stay as they are
+  REQUIRE(optimized("(let y (+ 1 2))") == term("(let y (+ 1 2))"));
+  REQUIRE(optimized("(eval (+ a 1) a (+ 1 2))") ==
+          term("(eval (+ a 1) a (+ 1 2))"));
+  REQUIRE(optimized("(sum 1 (+ 1 2))") == term("(sum 1 (+ 1 2))"));
+
+  // a binding made at run time may shadow a constant
+  REQUIRE(optimized("(eval (eval (+ (let a 5) a)) a 1)") ==
+          term("(eval (eval (+ (let a 5) a)) a 1)"));
+  REQUIRE(optimized("(eval (eval (+ (bind a 5) a) q 0) a 1)") ==
+          term("(eval (eval (+ (bind a 5) a) q 0) a 1)"));
+}
+
+}  // namespace guci
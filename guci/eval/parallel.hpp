@@ -0,0 +1,241 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <span>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "guci/eval/ast_eval_utils.hpp"
+#include "guci/eval/eval.hpp"
+#include "guci/eval/memo.hpp"
+#include "guci/parse/ast.hpp"
+#include "guci/utils/work_stealing_pool.hpp"
+
+namespace guci {
+
+// defined in evaluator.hpp
+inline EvaluationResult evaluate(EvaluationContext& context, Term const& t);
+
+// The values of the free variables of a term that is forked.
+using Captures = std::vector<std::pair<SymbolId, Term>>;
+
+// A term evaluated by a task of the global WorkStealingPool, in a scope of
+// its own below the global context it was forked from, with its free
+// variables bound to the values they had there. Whichever thread claims it
+// first evaluates it: the task, or a thread that needs its value before the
+// task got to run. A future made by a thread that evaluated the term itself
+// is done from the start.
+struct FutureData {
+  enum class State : std::uint8_t { Queued, Running, Done };
+
+  Term term;
+  Captures captures;
+  EvaluationContext const* global;
+  mutable std::atomic<State> state;
+  // set before the state becomes Done
+  mutable std::optional<EvaluationResult> result;
+
+  FutureData(Term t, Captures c, EvaluationContext const* g)
+      : term{std::move(t)},
+        captures{std::move(c)},
+        global{g},
+        state{State::Queued} {
+    global->add_task();
+  }
+  explicit FutureData(EvaluationResult r)
+      : term{NIL}, global{nullptr}, state{State::Done}, result{std::move(r)} {}
+
+  // Evaluates the term unless a thread claimed it already.
+  void run() const {
+    if (not claim()) return;
+    {
+      EvaluationContext::SharedReads const shared;
+      EffectJournal journal;
+      EvaluationContext scope{EvaluationContext::LocalScope{}, global,
+                              journal};
+      for (auto const& [id, value] : captures) {
+        (void)scope.set_value(Identifier::from_id(id), value);
+      }
+      result = evaluate(scope, term);
+    }
+    finish();
+  }
+
+  // Drops the term unless a thread claimed it already.
+  void cancel() const {
+    if (claim()) finish();
+  }
+
+  // the value of the term, once it is evaluated; by this thread if no other
+  // has claimed it yet
+  EvaluationResult const& get() const {
+    run();
+    WorkStealingPool::global().help_until(
+        [&] { return state.load(std::memory_order_acquire) == State::Done; });
+    return *result;
+  }
+
+ private:
+  bool claim() const {
+    auto expected = State::Queued;
+    return state.compare_exchange_strong(expected, State::Running);
+  }
+
+  void finish() const {
+    state.store(State::Done, std::memory_order_release);
+    global->task_done();
+    WorkStealingPool::global().notify();
+  }
+};
+
+namespace detail {
+inline std::atomic<bool> parallel_mode{false};
+
+// Terms of at least this many nodes are worth a task, and so are those that
+// call a user function, which may recurse.
+inline constexpr std::size_t kForkNodes = 64;
+
+// counts the nodes of `t` off `budget`, down to 0 once it calls a user
+// function
+inline void weigh(EvaluationContext const& ctx, Term const& t,
+                  std::size_t& budget) {
+  if (budget == 0) return;
+  --budget;
+  auto const* l = std::get_if<List<Term>>(&*t);
+  if (l == nullptr or l->empty()) return;
+  if (auto const* head = std::get_if<Identifier>(&*l->at(0))) {
+    Function const* f = ctx.find_function(*head);
+    if (f == nullptr or std::holds_alternative<UserDefinedFunction>((*f)())) {
+      budget = 0;
+      return;
+    }
+  }
+  for (Term const& e : l->tail()) weigh(ctx, e, budget);
+}
+
+inline bool pure(EvaluationContext const& ctx, Term const& t) {
+  return PurityCheck{ctx, std::numeric_limits<SymbolId>::max()}.pure(t);
+}
+}  // namespace detail
+
+// Whether Add, Subtract and Multiply fork the arguments worth it, on every
+// thread; off by default. Code compiled while it is off keeps evaluating
+// their arguments in turn.
+inline bool parallel_mode() {
+  return detail::parallel_mode.load(std::memory_order_relaxed);
+}
+inline void set_parallel_mode(bool on) {
+  detail::parallel_mode.store(on, std::memory_order_relaxed);
+}
+
+// Whether `t` is a call big enough for a task, which evaluates the same
+// on any thread as far as the functions visible from `ctx` tell.
+inline bool worth_forking(EvaluationContext const& ctx, Term const& t) {
+  if (not std::holds_alternative<List<Term>>(*t)) return false;
+  std::size_t budget = detail::kForkNodes;
+  detail::weigh(ctx, t, budget);
+  return budget == 0 and detail::pure(ctx, t);
+}
+
+// Whether at least two of `args` are worth forking, so that one of them is
+// left to evaluate while the others are forked.
+inline bool worth_forking(EvaluationContext const& ctx,
+                          std::span<Term const> args) {
+  std::size_t n = 0;
+  for (Term const& a : args) {
+    if (worth_forking(ctx, a) and ++n == 2) return true;
+  }
+  return false;
+}
+
+// The values of the free variables of `t` in `ctx` if another thread may
+// evaluate `t` with the same result as this one: `t` is a call without
+// effects of functions defined already (see detail::PurityCheck), and its
+// free variables are bound, since those that are not may be bound by the
+// time it would be evaluated here. Functions are never redefined, and
+// variables are never rebound.
+inline std::optional<Captures> forkable(EvaluationContext const& ctx,
+                                        Term const& t) {
+  if (not std::holds_alternative<List<Term>>(*t) or not detail::pure(ctx, t)) {
+    return std::nullopt;
+  }
+  Captures captures;
+  for (SymbolId id : free_variables(ctx, {}, t)) {
+    Term const* value = ctx.find_value(Identifier::from_id(id));
+    if (value == nullptr) return std::nullopt;
+    captures.emplace_back(id, *value);
+  }
+  return captures;
+}
+
+// Queues `t`, which is forkable() with `captures`, on the global pool.
+inline std::shared_ptr<FutureData const> fork(EvaluationContext const& ctx,
+                                              Term const& t,
+                                              Captures captures) {
+  auto future = std::make_shared<FutureData const>(t, std::move(captures),
+                                                   ctx.global());
+  WorkStealingPool::global().submit([future] { future->run(); });
+  return future;
+}
+
+// Which of the arguments of a call that evaluates all of them in order,
+// such as Add, fork.
+enum class Forking : std::uint8_t {
+  // those worth it, in the parallel mode, unless the pool has a task queued
+  // for each worker already
+  Auto,
+  // all that can be
+  Always,
+};
+
+// The arguments of a call forked before the caller evaluates them in turn,
+// all but the last of those chosen by `Forking`, which it evaluates itself.
+// Those that are not forked are null. As the values of forked arguments do
+// not depend on when they are evaluated, the results are those of
+// evaluating all arguments in turn. Forked arguments that are never asked
+// for, after an error, are dropped if no thread started on them yet.
+class ForkedArguments {
+  std::vector<std::shared_ptr<FutureData const>> forked_;
+
+ public:
+  ForkedArguments(EvaluationContext const& ctx, std::span<Term const> args,
+                  Forking forking = Forking::Auto) {
+    if (forking == Forking::Auto) {
+      if (not parallel_mode() or WorkStealingPool::global().busy()) return;
+    }
+    std::vector<std::optional<Captures>> chosen(args.size());
+    std::size_t last = args.size();
+    for (std::size_t i = 0; i < args.size(); ++i) {
+      if (forking == Forking::Auto and not worth_forking(ctx, args[i])) {
+        continue;
+      }
+      chosen[i] = forkable(ctx, args[i]);
+      if (chosen[i]) last = i;
+    }
+    forked_.resize(args.size());
+    for (std::size_t i = 0; i < last; ++i) {
+      if (chosen[i]) forked_[i] = fork(ctx, args[i], std::move(*chosen[i]));
+    }
+  }
+
+  ForkedArguments(ForkedArguments const&) = delete;
+  ForkedArguments& operator=(ForkedArguments const&) = delete;
+
+  ~ForkedArguments() {
+    for (auto const& f : forked_) {
+      if (f != nullptr) f->cancel();
+    }
+  }
+
+  FutureData const* operator[](std::size_t i) const {
+    return i < forked_.size() ? forked_[i].get() : nullptr;
+  }
+};
+
+}  // namespace guci
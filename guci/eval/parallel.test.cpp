@@ -0,0 +1,178 @@
+#include "guci/eval/parallel.hpp"
+
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "guci/eval/evaluator.hpp"
+#include "guci/parse/reader.hpp"
+
+namespace guci {
+
+namespace {
+constexpr std::string_view kFib =
+    "(define fib (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))";
+
+// The printed results of the forms of `program` in a fresh global context,
+// in the parallel mode or not, and with the tree-walking evaluator or not.
+std::vector<std::string> results(std::string_view program, bool parallel,
+                                 bool tree) {
+  set_parallel_mode(parallel);
+  bool quit = false;
+  EvaluationContext ctx = make_global_context(quit);
+  std::vector<std::string> out;
+  auto const forms = read_all(program).value();
+  for (Term const& t : forms) {
+    EvaluationResult r = tree ? std::visit(EvaluatingVisitor{ctx}, *t)
+                              : evaluate(ctx, t);
+    if (not r) {
+      out.push_back(r.error().msg());
+      continue;
+    }
+    PrintingVisitor v;
+    std::visit(v, *r.value().t);
+    out.push_back(v.get());
+  }
+  set_parallel_mode(false);
+  return out;
+}
+
+std::uint64_t submitted() {
+  return WorkStealingPool::global().stats().submitted;
+}
+}  // namespace
+
+TEST_CASE("parallel evaluation matches sequential evaluation", "[parallel]") {
+  auto const program = GENERATE(as<std::string_view>{},
+      "(+ (fib 15) (fib 16) (fib 17)) (- (fib 18) (fib 15) 3) "
+      "(* (fib 5) (fib 6) (fib 7)) (- (fib 12))",
+      // effects before a forked argument are seen by those after it
+      "(+ (let y 2) (fib y) (fib 10) (fib (+ y 9))) y",
+      "(define setter (x) (+ 1 (let z x))) "
+      "(+ (setter 1) (fib 12) (fib 13) z) z",
+      // the first error in argument order wins
+      "(+ x (fib 12) (fib 13)) (+ (fib 12) (eval z) (fib 13)) "
+      "(* (fib 12) (fib 13) (unknown 1)) (- (fib 10) (fib 11) \"s\")",
+      "(define sq (x) (* x x)) "
+      "(eval (+ (fib a) (sq (fib b)) (fib (sq 3))) a 11 b 12)",
+      // arguments forked inside forked arguments
+      "(define pfib (n) (if (< n 10) (fib n) "
+      "(+ (pfib (- n 1)) (pfib (- n 2))))) (pfib 22) (* (pfib 15) (pfib 16))",
+      "(defmemo mf (n) (if (< n 2) n (+ (mf (- n 1)) (mf (- n 2))))) "
+      "(+ (mf 60) (mf 61) (fib 14))",
+      "(define twice (f x) (+ (funcall f x) (funcall f (fib x)))) "
+      "(twice (lambda (x) (+ x 1)) 10)");
+
+  auto const with_fib = std::string{kFib} + std::string{program};
+  auto const sequential = results(with_fib, false, false);
+  REQUIRE(results(with_fib, true, false) == sequential);
+  REQUIRE(results(with_fib, true, true) == sequential);
+  REQUIRE(results(with_fib, false, true) == sequential);
+}
+
+TEST_CASE("the parallel mode forks arguments worth a task", "[parallel]") {
+  bool quit = false;
+  EvaluationContext ctx = make_global_context(quit);
+  auto const run = [&](std::string_view source) {
+    return show_result(ctx, read(source).value());
+  };
+
+  run(kFib);
+  run("(define g (n) (+ n (let v 1)))");
+  REQUIRE(run("(parallel 1)") == "#t");
+  auto before = submitted();
+  REQUIRE(run("(+ (fib 20) (fib 21))") == "17711");
+  REQUIRE(submitted() > before);
+  // too small, or with effects
+  before = submitted();
+  REQUIRE(run("(+ (+ 1 2) (* 3 4) 5)") == "20");
+  REQUIRE(run("(+ (g 20) (g 21))") == "43");
+  REQUIRE(submitted() == before);
+  // functions compiled in the parallel mode are compiled again without it
+  REQUIRE(run("(parallel 0)") == "#f");
+  REQUIRE(run("(+ (fib 20) (fib 21))") == "17711");
+  REQUIRE(submitted() == before);
+}
+
+TEST_CASE("pcall and futures evaluate like plain calls", "[parallel]") {
+  bool quit = false;
+  EvaluationContext ctx = make_global_context(quit);
+  auto const run = [&](std::string_view source) {
+    return show_result(ctx, read(source).value());
+  };
+  run(kFib);
+
+  auto const before = submitted();
+  REQUIRE(run("(pcall + (fib 15) (fib 16) 1)") == "1598");
+  REQUIRE(run("(pcall - (fib 15) (fib 16))") == "-377");
+  REQUIRE(run("(define add3 (a b c) (+ a b c))") == "add3");
+  REQUIRE(run("(pcall add3 (fib 10) (fib 11) (fib 12))") == "288");
+  // all arguments that can be forked but the last
+  REQUIRE(submitted() == before + 4);
+  REQUIRE(run("(pcall if (< 1 2) (fib 5) (fib 6))") == "5");
+  REQUIRE(run("(pcall add3 1 2)") == "arity mismatch");
+  REQUIRE(run("(pcall nothing 1)") == "function not found");
+  REQUIRE(run("(pcall add3 x (fib 10) (let u 3))") ==
+          "unbound variables in arithmetic expression");
+  // as with a plain call, the arguments are all evaluated before the body
+  REQUIRE(run("u") == "3");
+  REQUIRE(run("(add3 y (fib 10) (let t 3))") ==
+          "unbound variables in arithmetic expression");
+  REQUIRE(run("t") == "3");
+  REQUIRE(run("(pcall add3 (let s 3) (fib 10) s)") == "61");
+
+  REQUIRE(run("(future (fib 10))") == "#<future>");
+  REQUIRE(run("(touch (future (fib 20)))") == "6765");
+  REQUIRE(run("(touch 7)") == "7");
+  REQUIRE(run("(touch (future (+ 1 x)))") ==
+          "unbound variables in arithmetic expression");
+  // evaluated right away, since it has an effect
+  REQUIRE(run("(touch (future (let w 4)))") == "4");
+  REQUIRE(run("w") == "4");
+  REQUIRE(run("(define both (f g) (+ (touch f) (touch g)))") == "both");
+  REQUIRE(run("(both (future (fib 18)) (future (fib 19)))") == "6765");
+
+  // functions that fork are as pure as what they fork
+  REQUIRE(run("(defmemo pm (n) (if (< n 2) n "
+              "(pcall + (pm (- n 1)) (pm (- n 2)))))") == "pm");
+  REQUIRE(run("(pm 80)") == "23416728348467685");
+}
+
+TEST_CASE("forked and pcalled functions keep their tail calls",
+          "[parallel]") {
+  bool quit = false;
+  EvaluationContext ctx = make_global_context(quit);
+  auto const run = [&](std::string_view source) {
+    return show_result(ctx, read(source).value());
+  };
+  bool const jit = thread_vm().jit();
+  thread_vm().set_jit(false);
+
+  run("(define loop (n acc) (if (= n 0) acc (loop (- n 1) (+ acc 1))))");
+  run("(define deep (n) (if (= n 0) 0 (+ 1 (deep (- n 1)))))");
+  REQUIRE(run("(parallel 1)") == "#t");
+  REQUIRE(run("(+ (loop 1000000 0) (loop 1000000 0))") == "2000000");
+  REQUIRE(run("(pcall loop 1000000 0)") == "1000000");
+  REQUIRE(run("(pcall + (loop 1000000 0) (loop 1000000 0))") == "2000000");
+  // not a tail call, but one the machine keeps on the heap
+  REQUIRE(run("(pcall deep 1000000)") == "1000000");
+  REQUIRE(run("(parallel 0)") == "#f");
+  thread_vm().set_jit(jit);
+}
+
+TEST_CASE("contexts outlive the tasks they forked", "[parallel]") {
+  std::optional<Term> future;
+  {
+    bool quit = false;
+    EvaluationContext ctx = make_global_context(quit);
+    (void)show_result(ctx, read(kFib).value());
+    future = evaluate(ctx, read("(future (fib 22))").value()).value().t;
+  }
+  FutureData const& data = std::get<Future>(**future).data();
+  REQUIRE(data.state == FutureData::State::Done);
+  REQUIRE(data.get().value().t == Term{Number(17711)});
+}
+
+}  // namespace guci
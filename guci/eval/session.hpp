@@ -0,0 +1,92 @@
+#pragma once
+
+#include <span>
+#include <string>
+#include <string_view>
+
+#include "guci/eval/eval.hpp"
+#include "guci/eval/eval_error.hpp"
+#include "guci/eval/evaluator.hpp"
+#include "guci/parse/ast.hpp"
+#include "guci/parse/reader.hpp"
+#include "guci/utils/outcome.hpp"
+
+namespace guci {
+
+namespace detail {
+// set by `quit` on the thread evaluating for a Session
+inline thread_local bool session_quit = false;
+
+inline EvaluationResult quit_session(EvaluationContext&,
+                                     std::span<Term const>) {
+  session_quit = true;
+  return EvaluationSuccess(NIL);
+}
+
+// for the builtins that change settings of the whole process
+inline EvaluationResult not_in_session(EvaluationContext&,
+                                       std::span<Term const>) {
+  return EvalError("not available in a session");
+}
+}  // namespace detail
+
+// The global environment the Sessions of a server share: the builtins, with
+// `quit` ending the session that calls it, and what was load()ed before the
+// first session started. Sessions never write it, so any number of threads
+// read it without locks. `jit`, `parallel` and `memo-capacity`, which would
+// change the process for every session, fail here.
+class SharedEnvironment {
+  // what the builtins' own `quit` sets; it is shadowed in shared_
+  bool quit_requested_ = false;
+  EvaluationContext builtins_;
+  EvaluationContext shared_;
+
+ public:
+  SharedEnvironment()
+      : builtins_{make_global_context(quit_requested_)},
+        shared_{&builtins_,
+                {{"quit", BuiltInFunction(0, detail::quit_session)},
+                 {"jit", BuiltInFunction(1, detail::not_in_session)},
+                 {"parallel", BuiltInFunction(1, detail::not_in_session)},
+                 {"memo-capacity",
+                  BuiltInFunction(1, detail::not_in_session)}},
+                {}} {}
+
+  // Evaluates the top-level forms of `source` here, up to the first that
+  // fails. Only before sessions start.
+  eval_result<void> load(std::string_view source) {
+    Reader reader{skip_shebang(source)};
+    while (not reader.at_end()) {
+      auto term = reader.read_term();
+      if (not term) return EvalError(term.error().msg);
+      OUTCOME_TRYV(evaluate(shared_, term.value()));
+    }
+    return outcome::success();
+  }
+
+  EvaluationContext const& context() const { return shared_; }
+};
+
+// One client's view of a SharedEnvironment, which binds its `let`s in an
+// overlay of its own and cannot define functions. Used by one thread at a
+// time, but not necessarily the same one.
+class Session {
+  EvaluationContext context_;
+  bool quit_requested_ = false;
+
+ public:
+  explicit Session(SharedEnvironment const& env)
+      : context_{EvaluationContext::Overlay{}, env.context()} {}
+
+  // the printed result of the form read from `input`, or its error
+  std::string evaluate(std::string_view input) {
+    detail::session_quit = false;
+    std::string result = show_result(context_, input);
+    quit_requested_ = quit_requested_ or detail::session_quit;
+    return result;
+  }
+
+  bool quit_requested() const { return quit_requested_; }
+};
+
+}  // namespace guci
@@ -0,0 +1,98 @@
+#include "guci/eval/session.hpp"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "catch2/catch.hpp"
+
+namespace guci {
+
+namespace {
+SharedEnvironment& environment() {
+  static SharedEnvironment* const env = [] {
+    auto* e = new SharedEnvironment;
+    REQUIRE(e->load("(define fib (n) (if (< n 2) n (+ (fib (- n 1)) "
+                    "(fib (- n 2))))) (let base 100)"));
+    return e;
+  }();
+  return *env;
+}
+}  // namespace
+
+TEST_CASE("sessions see the shared environment", "[session]") {
+  Session s{environment()};
+  REQUIRE(s.evaluate("(fib 15)") == "610");
+  REQUIRE(s.evaluate("(+ base 1)") == "101");
+  REQUIRE(s.evaluate("(funcall (lambda (x) (* x base)) 3)") == "300");
+  REQUIRE(s.evaluate("(define g (x) x)") == "functions are read-only here");
+  REQUIRE(s.evaluate("(eval (define g (x) x))") ==
+          "define outside the global scope");
+  REQUIRE(s.evaluate("(g 1)") == "function not found");
+  REQUIRE(s.evaluate("(") == "list should end with ')'");
+
+  REQUIRE_FALSE(environment().load("(define fib (n) n)"));
+  REQUIRE_FALSE(environment().load("(+ 1"));
+}
+
+TEST_CASE("sessions bind variables of their own", "[session]") {
+  Session a{environment()};
+  Session b{environment()};
+  REQUIRE(a.evaluate("(let x 1)") == "1");
+  REQUIRE(b.evaluate("x") == "x");
+  REQUIRE(b.evaluate("(let x 2)") == "2");
+  REQUIRE(a.evaluate("(+ x 10)") == "11");
+  REQUIRE(b.evaluate("(+ x 10)") == "12");
+  REQUIRE(a.evaluate("(let base 7)") == "7");
+  REQUIRE(a.evaluate("base") == "7");
+  REQUIRE(b.evaluate("base") == "100");
+  REQUIRE(Session{environment()}.evaluate("x") == "x");
+}
+
+TEST_CASE("quit ends the session that calls it", "[session]") {
+  Session a{environment()};
+  Session b{environment()};
+  REQUIRE_FALSE(a.quit_requested());
+  REQUIRE(a.evaluate("(quit)") == "NIL");
+  REQUIRE(a.quit_requested());
+  REQUIRE(b.evaluate("(fib 5)") == "5");
+  REQUIRE_FALSE(b.quit_requested());
+}
+
+TEST_CASE("sessions leave process-wide settings alone", "[session]") {
+  Session s{environment()};
+  std::size_t const capacity = MemoCache::global().stats().capacity;
+  bool const jit = thread_vm().jit();
+  REQUIRE(s.evaluate("(memo-capacity 1)") == "not available in a session");
+  REQUIRE(s.evaluate("(parallel 1)") == "not available in a session");
+  REQUIRE(s.evaluate("(jit 0)") == "not available in a session");
+  REQUIRE(MemoCache::global().stats().capacity == capacity);
+  REQUIRE_FALSE(parallel_mode());
+  REQUIRE(thread_vm().jit() == jit);
+  REQUIRE(s.evaluate("(fib 10)") == "55");
+}
+
+TEST_CASE("sessions evaluate on several threads at once", "[session]") {
+  std::vector<std::vector<std::string>> results(8);
+  {
+    std::vector<std::jthread> threads;
+    for (std::size_t t = 0; t < results.size(); ++t) {
+      threads.emplace_back([&, t] {
+        Session s{environment()};
+        auto const n = std::to_string(t);
+        results[t].push_back(s.evaluate("(let n " + n + ")"));
+        for (int i = 0; i < 20; ++i) {
+          results[t].push_back(s.evaluate("(+ (fib 12) n base)"));
+        }
+      });
+    }
+  }
+  for (std::size_t t = 0; t < results.size(); ++t) {
+    REQUIRE(results[t].front() == std::to_string(t));
+    for (std::size_t i = 1; i < results[t].size(); ++i) {
+      REQUIRE(results[t][i] == std::to_string(144 + 100 + t));
+    }
+  }
+}
+
+}  // namespace guci
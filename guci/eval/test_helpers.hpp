@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+
+#include "guci/eval/evaluator.hpp"
+
+namespace guci::testing {
+
+// The printed value of `r`, or its message prefixed with "error: ".
+inline std::string show(EvaluationResult const& r) {
+  if (not r) return "error: " + r.error().msg();
+  PrintingVisitor v;
+  std::visit(v, *r.value().t);
+  return v.get();
+}
+
+// Builtins without an intrinsic tag, which the VM has to call through the
+// generic path: `sum` evaluates its arguments with the visitor and `bind`
+// binds a variable through an action.
+inline EvaluationContext with_generic_builtins(
+    EvaluationContext const& global) {
+  return EvaluationContext{
+      &global,
+      {{"sum", BuiltInFunction(BuiltInFunction::kAnyArity, Add{})},
+       {"bind", BuiltInFunction(2, builtin_let)}},
+      {}};
+}
+
+}  // namespace guci::testing
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <variant>
+
+#include "guci/eval/eval_error.hpp"
+#include "guci/parse/ast.hpp"
+#include "guci/utils/simd_numeric.hpp"
+
+// Arithmetic on Vectors, run by the kernels of simd_numeric.hpp. Elements
+// are fixnums, so whatever does not fit one fails, except for the
+// reductions to a single Number, which go on with Number arithmetic when
+// the kernels overflow.
+namespace guci {
+
+// Vector::build(n, fill), with its exceptions for too many elements and a
+// failed allocation turned into errors
+template <typename Fill>
+eval_result<Vector> build_vector(std::uint64_t n, Fill fill) {
+  try {
+    return Vector::build(n, std::move(fill));
+  } catch (std::length_error const&) {
+    return EvalError("vector too large");
+  } catch (std::bad_alloc const&) {
+    return EvalError("out of memory");
+  }
+}
+
+namespace detail {
+inline EvalError vector_overflow() {
+  return EvalError("vector element out of fixnum range");
+}
+
+// the fixnum `op` leaves the other operand as it is with, on either side
+// for Add and Multiply and on the right for Subtract
+inline std::int64_t identity(simd::Arith op) {
+  return op == simd::Arith::Multiply ? 1 : 0;
+}
+
+template <typename L, typename R>
+eval_result<Term> elementwise(simd::Arith op, L lhs, R rhs,
+                              std::uint32_t n) {
+  bool fits = true;
+  Vector v = OUTCOME_TRYX(build_vector(n, [&](std::int64_t* out) {
+    fits = simd::elementwise(op, lhs, rhs, out, n);
+  }));
+  if (not fits) return vector_overflow();
+  return Term{std::move(v)};
+}
+}  // namespace detail
+
+// lhs op rhs, where one of them is a Vector, elementwise; a Number stands
+// for a vector of the right size that holds only it. Both have to be
+// Numbers or Vectors, and two Vectors of the same size.
+inline eval_result<Term> vector_arithmetic(simd::Arith op, Term const& lhs,
+                                           Term const& rhs) {
+  auto const* lv = std::get_if<Vector>(&*lhs);
+  auto const* rv = std::get_if<Vector>(&*rhs);
+  auto const* ln = std::get_if<Number>(&*lhs);
+  auto const* rn = std::get_if<Number>(&*rhs);
+  if ((lv == nullptr and ln == nullptr) or (rv == nullptr and rn == nullptr) or
+      (lv == nullptr and rv == nullptr)) {
+    return EvalError("unbound variables in arithmetic expression");
+  }
+  if ((ln and not ln->is_fixnum()) or (rn and not rn->is_fixnum())) {
+    return detail::vector_overflow();
+  }
+
+  if (lv and rv) {
+    if (lv->size() != rv->size()) {
+      return EvalError("vectors of different sizes");
+    }
+    return detail::elementwise(op, simd::Elements{lv->view().data()},
+                               simd::Elements{rv->view().data()},
+                               lv->size());
+  }
+  std::int64_t const identity = detail::identity(op);
+  if (rn) {
+    if (rn->fixnum() == identity) return lhs;
+    return detail::elementwise(op, simd::Elements{lv->view().data()},
+                               simd::Broadcast{rn->fixnum()}, lv->size());
+  }
+  if (op != simd::Arith::Subtract and ln->fixnum() == identity) return rhs;
+  return detail::elementwise(op, simd::Broadcast{ln->fixnum()},
+                             simd::Elements{rv->view().data()}, rv->size());
+}
+
+inline Number vector_sum(Vector const& v) {
+  if (auto const s = simd::sum(v.view())) return *s;
+  Number acc{0};
+  for (std::int64_t const x : v.view()) acc = acc + Number{x};
+  return acc;
+}
+
+inline Number vector_product(Vector const& v) {
+  if (auto const p = simd::product(v.view())) return *p;
+  if (std::ranges::find(v.view(), 0) != v.view().end()) return Number{0};
+  Number acc{1};
+  for (std::int64_t const x : v.view()) acc = acc * Number{x};
+  return acc;
+}
+
+inline eval_result<Number> vector_dot(Vector const& a, Vector const& b) {
+  if (a.size() != b.size()) return EvalError("vectors of different sizes");
+  if (auto const d = simd::dot(a.view(), b.view())) return Number{*d};
+  Number acc{0};
+  for (std::uint32_t i = 0; i < a.size(); ++i) {
+    acc = acc + Number{a.view()[i]} * Number{b.view()[i]};
+  }
+  return acc;
+}
+
+// the least element of `v` for `max` false, else the greatest
+inline eval_result<Number> vector_extremum(Vector const& v, bool max) {
+  if (v.size() == 0) return EvalError("empty vector");
+  return Number{max ? simd::max(v.view()) : simd::min(v.view())};
+}
+
+inline eval_result<Vector> vector_sort(Vector const& v) {
+  return build_vector(v.size(), [&](std::int64_t* out) {
+    std::ranges::copy(v.view(), out);
+    simd::sort({out, v.size()});
+  });
+}
+
+// [start, start + 1, ..., end - 1], or an empty vector unless start < end
+inline eval_result<Vector> vector_range(std::int64_t start,
+                                        std::int64_t end) {
+  if (end <= start) return Vector{};
+  // computed without overflowing, as the difference may not fit; build_vector()
+  // refuses the sizes that are too large
+  std::uint64_t const n = static_cast<std::uint64_t>(end) -
+                          static_cast<std::uint64_t>(start);
+  return build_vector(n, [&](std::int64_t* out) {
+    for (std::uint64_t i = 0; i < n; ++i) out[i] = start + i;
+  });
+}
+
+}  // namespace guci
@@ -0,0 +1,111 @@
+#include "guci/eval/vectors.hpp"
+
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include "catch2/catch.hpp"
+#include "guci/eval/evaluator.hpp"
+#include "guci/parse/reader.hpp"
+
+namespace guci {
+
+TEST_CASE("arithmetic on vectors is elementwise", "[vectors]") {
+  Vector const v{1, 2, 3};
+  Vector const w{10, 20, 30};
+  REQUIRE(vector_arithmetic(simd::Arith::Add, v, w).value() ==
+          Term{Vector{11, 22, 33}});
+  REQUIRE(vector_arithmetic(simd::Arith::Subtract, Number(1), v).value() ==
+          Term{Vector{0, -1, -2}});
+  REQUIRE(vector_arithmetic(simd::Arith::Multiply, w, Number(2)).value() ==
+          Term{Vector{20, 40, 60}});
+
+  // operands that leave the other one as it is are not copied
+  auto const same = vector_arithmetic(simd::Arith::Multiply, Number(1), v);
+  REQUIRE(std::get<Vector>(*same.value()).view().data() == v.view().data());
+
+  REQUIRE_FALSE(vector_arithmetic(simd::Arith::Add, v, Vector{1}));
+  REQUIRE_FALSE(vector_arithmetic(simd::Arith::Add, v, Identifier("x")));
+  REQUIRE_FALSE(vector_arithmetic(simd::Arith::Multiply, Vector{1 << 20},
+                                  Number(std::int64_t{1} << 50)));
+}
+
+TEST_CASE("reductions go on past a fixnum", "[vectors]") {
+  std::int64_t const big = std::int64_t{1} << 62;
+  REQUIRE(vector_sum(Vector{big, big, -big}) == Number(big));
+  REQUIRE(vector_sum(Vector{big, big, big}) ==
+          Number(big) + Number(big) + Number(big));
+  REQUIRE(vector_product(Vector{big, big, 0}) == Number(0));
+  REQUIRE(vector_product(Vector{big, 4}) == Number(big) * Number(4));
+  REQUIRE(vector_dot(Vector{big, 1}, Vector{2, 3}).value() ==
+          Number(big) * Number(2) + Number(3));
+  REQUIRE_FALSE(vector_dot(Vector{1}, Vector{}));
+  REQUIRE_FALSE(vector_extremum(Vector{}, true));
+  REQUIRE(vector_sort(Vector{3, -1, 2}).value() == Vector{-1, 2, 3});
+  REQUIRE(vector_range(-2, 2).value() == Vector{-2, -1, 0, 1});
+  REQUIRE(vector_range(5, 1).value() == Vector{});
+}
+
+TEST_CASE("vector builtins", "[vectors]") {
+  bool quit = false;
+  EvaluationContext ctx = make_global_context(quit);
+  auto const run = [&](std::string_view source) {
+    return show_result(ctx, read(source).value());
+  };
+
+  REQUIRE(run("(vector 1 (+ 1 1) 3)") == "#[1 2 3]");
+  REQUIRE(run("(let xs (4 5 6))") == "[4 5 6]");
+  REQUIRE(run("(list->vector xs)") == "#[4 5 6]");
+  REQUIRE(run("(range 1 5)") == "#[1 2 3 4]");
+  REQUIRE(run("(+ (range 4) (range 4) 1)") == "#[1 3 5 7]");
+  REQUIRE(run("(- (* (range 3) 10) 1)") == "#[-1 9 19]");
+  REQUIRE(run("(vector-sum (range 1000001))") == "500000500000");
+  REQUIRE(run("(vector-product (range 1 21))") == "2432902008176640000");
+  REQUIRE(run("(vector-dot (range 4) (range 4))") == "14");
+  REQUIRE(run("(vector-min (- 3 (range 10)))") == "-6");
+  REQUIRE(run("(vector-max (vector 2 9 4))") == "9");
+  REQUIRE(run("(vector-sort (- 0 (range 5)))") == "#[-4 -3 -2 -1 0]");
+  REQUIRE(run("(vector-length (range 300))") == "300");
+  REQUIRE(run("(vector-ref (range 10 20) 3)") == "13");
+
+  // the bytecode and the builtins agree
+  REQUIRE(run("(define scale (v k) (+ (* v k) 1))") == "scale");
+  REQUIRE(run("(scale (range 3) 2)") == "#[1 3 5]");
+  REQUIRE(run("(funcall (lambda (v) (vector-sum (* v v))) (range 4))") ==
+          "14");
+
+  REQUIRE(run("(vector-ref (range 3) 3)") == "index out of range");
+  REQUIRE(run("(vector-sum 1)") == "vector expected");
+  REQUIRE(run("(list->vector xs 1)") == "arity mismatch");
+  REQUIRE(run("(range 1 2 3)") == "arity mismatch");
+  REQUIRE(run("(+ (range 2) (range 3))") == "vectors of different sizes");
+  REQUIRE(run("(* (vector 4611686018427387904) 2)") ==
+          "vector element out of fixnum range");
+  REQUIRE(run("(< (range 2) 1)") ==
+          "unbound variables in arithmetic expression");
+}
+
+TEST_CASE("vectors too large to allocate are an error", "[vectors]") {
+  bool filled = false;
+  REQUIRE_THROWS_AS(Vector::build(Vector::kMaxSize + 1,
+                                  [&](std::int64_t*) { filled = true; }),
+                    std::length_error);
+  REQUIRE_FALSE(filled);
+  auto const too_large = build_vector(
+      Vector::kMaxSize + 1, [&](std::int64_t*) { filled = true; });
+  REQUIRE_FALSE(too_large);
+  REQUIRE(too_large.error().msg() == "vector too large");
+  REQUIRE_FALSE(filled);
+  REQUIRE_FALSE(vector_range(0, 3000000000));
+  REQUIRE_FALSE(vector_range(std::numeric_limits<std::int64_t>::min(),
+                             std::numeric_limits<std::int64_t>::max()));
+
+  bool quit = false;
+  EvaluationContext ctx = make_global_context(quit);
+  REQUIRE(show_result(ctx, read("(range 3000000000)").value()) ==
+          "vector too large");
+  REQUIRE(show_result(ctx, read("(vector-length (range 3))").value()) == "3");
+}
+
+}  // namespace guci
@@ -0,0 +1,618 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <variant>
+#include <vector>
+
+#include "guci/eval/ast_eval_utils.hpp"
+#include "guci/eval/bytecode.hpp"
+#include "guci/eval/compiler.hpp"
+#include "guci/eval/eval.hpp"
+#include "guci/eval/eval_error.hpp"
+#include "guci/eval/eval_result.hpp"
+#include "guci/eval/jit.hpp"
+#include "guci/eval/memo.hpp"
+#include "guci/eval/vectors.hpp"
+#include "guci/parse/ast.hpp"
+
+namespace guci {
+
+// Stack machine running Chunks. Local variables live in frames, which are
+// ranges of one slot stack, so entering an `eval` does not allocate once the
+// stacks have grown. Calling a user function pushes an Activation rather than
+// recursing, and a tail call replaces the running one, so loops written as
+// tail calls run in constant space. The stacks are kept between runs; run()
+// only touches what lies above the state it was entered with, so it may be
+// re-entered from a builtin.
+//
+// Builtins that call closures run them here too, with run_closure(), so
+// their tail calls stay in constant space as well.
+//
+// Function bodies that get hot are handed to the JIT, and their calls run the
+// native code when the arguments are fixnums. Calls of memoized functions
+// look their result up in the MemoCache first and store it on return.
+class VirtualMachine {
+ public:
+  struct Stats {
+    std::uint64_t call_cache_hits = 0;
+    std::uint64_t call_cache_misses = 0;
+    std::uint64_t tail_calls = 0;
+    std::uint64_t native_calls = 0;
+    std::uint64_t jit_bailouts = 0;
+  };
+
+  static constexpr std::uint32_t kDefaultJitThreshold = 1000;
+
+ private:
+  struct Frame {
+    std::uint32_t base;
+    std::uint32_t scope;
+    // Bindings made by builtins that run outside the VM. Created on the
+    // first such call in this frame; see materialize().
+    std::unique_ptr<EvaluationContext> dynamic;
+  };
+
+  // A Chunk being run: the one passed to run() or the body of a function.
+  struct Activation {
+    Chunk const* chunk;
+    std::size_t pc;
+    // the first of its frames; the frame of a function body is created with
+    // the activation
+    std::size_t frame_base;
+    // keeps a closure that was called as a value alive
+    Term closure;
+    // where the result goes, for the body of a memoized function
+    std::unique_ptr<MemoCache::Key> memo;
+  };
+
+  // A user function about to be called, once its arguments are evaluated.
+  struct Callee {
+    ClosureData const* closure;
+    Chunk const* code;
+    Term keep;
+  };
+
+  std::vector<Term> stack_;
+  std::vector<std::optional<Term>> slots_;
+  std::vector<Frame> frames_;
+  std::vector<Activation> activations_;
+  std::vector<Callee> callees_;
+  Stats stats_;
+  bool jit_ = kJitAvailable;
+  std::uint32_t jit_threshold_ = kDefaultJitThreshold;
+
+  static EvalError arithmetic_error() {
+    return EvalError("unbound variables in arithmetic expression");
+  }
+
+  // false unless both operands are Numbers
+  template <typename F>
+  bool arithmetic(F&& f) {
+    Term& lhs = stack_[stack_.size() - 2];
+    auto const* l = std::get_if<Number>(&*lhs);
+    auto const* r = std::get_if<Number>(&*stack_.back());
+    if (l == nullptr or r == nullptr) return false;
+    lhs = Term{f(*l, *r)};
+    stack_.pop_back();
+    return true;
+  }
+
+  // the same when an operand is a Vector, see vector_arithmetic()
+  eval_result<void> vector_operation(simd::Arith op) {
+    Term& lhs = stack_[stack_.size() - 2];
+    lhs = OUTCOME_TRYX(vector_arithmetic(op, lhs, stack_.back()));
+    stack_.pop_back();
+    return outcome::success();
+  }
+
+  template <typename Op>
+  bool compare(Op op) {
+    return arithmetic(
+        [op](auto& l, auto& r) { return Boolean{op(l, r)}; });
+  }
+
+  std::optional<Term>& slot(LocalAddress address) {
+    return slots_[frames_[frames_.size() - 1 - address.depth].base +
+                  address.slot];
+  }
+
+  Term const* find(LocalAddress address, SymbolId id) {
+    if (address.slot != LocalAddress::kDynamic) {
+      auto& s = slot(address);
+      return s ? std::addressof(*s) : nullptr;
+    }
+    auto const& dynamic = frames_[frames_.size() - 1 - address.depth].dynamic;
+    Identifier const identifier = Identifier::from_id(id);
+    if (dynamic == nullptr or not dynamic->contains(identifier)) {
+      return nullptr;
+    }
+    return dynamic->find_value(identifier);
+  }
+
+  Term const* lookup(Chunk::Lookup const& lookup, EvaluationContext& root) {
+    for (auto address : lookup.candidates) {
+      if (Term const* t = find(address, lookup.id)) return t;
+    }
+    return root.find_value(Identifier::from_id(lookup.id));
+  }
+
+  // Builtins outside the VM see variables through EvaluationContexts, so the
+  // frames of this run are mirrored into a chain of them; the innermost one
+  // is returned. Slots are immutable once bound, so this only adds what was
+  // bound since the last call.
+  EvaluationContext& materialize(Chunk const& chunk, EvaluationContext& root,
+                                 std::size_t frame_base) {
+    EvaluationContext* parent = &root;
+    for (std::size_t f = frame_base; f < frames_.size(); ++f) {
+      Frame& frame = frames_[f];
+      if (frame.dynamic == nullptr) {
+        frame.dynamic = std::make_unique<EvaluationContext>(
+            EvaluationContext::LocalScope{}, parent);
+      }
+      auto const& ids = chunk.scopes[frame.scope].slots;
+      for (std::size_t i = 0; i < ids.size(); ++i) {
+        auto const& value = slots_[frame.base + i];
+        Identifier const id = Identifier::from_id(ids[i]);
+        if (value and not frame.dynamic->contains(id)) {
+          (void)frame.dynamic->set_value(id, *value);
+        }
+      }
+      parent = frame.dynamic.get();
+    }
+    return *parent;
+  }
+
+  // copies what a builtin bound in the innermost frame back into its slots
+  void write_back(Chunk const& chunk) {
+    Frame const& frame = frames_.back();
+    auto const& ids = chunk.scopes[frame.scope].slots;
+    for (std::size_t i = 0; i < ids.size(); ++i) {
+      auto& value = slots_[frame.base + i];
+      Identifier const id = Identifier::from_id(ids[i]);
+      if (not value and frame.dynamic->contains(id)) {
+        value = *frame.dynamic->find_value(id);
+      }
+    }
+  }
+
+  // the function of `site` as seen from `ctx` for `argc` arguments,
+  // refreshing the cache on a miss
+  eval_result<Function const*> resolve(Chunk::CallSite const& site,
+                                       EvaluationContext const& ctx,
+                                       std::size_t argc) {
+    auto const epoch = EvaluationContext::function_epoch();
+    constexpr auto relaxed = std::memory_order_relaxed;
+    if (site.epoch.load(std::memory_order_acquire) == epoch and
+        site.owner.load(relaxed) == ctx.function_owner()) {
+      ++stats_.call_cache_hits;
+      return site.function.load(relaxed);
+    }
+
+    ++stats_.call_cache_misses;
+    Function const* f = ctx.find_function(Identifier::from_id(site.name));
+    if (f == nullptr) return EvalError("function not found");
+    if (auto const* builtin = std::get_if<BuiltInFunction>(&(*f)())) {
+      if (not builtin->acceptsArgumentNumber(argc)) {
+        return EvalError("arity mismatch");
+      }
+    } else {
+      Lambda const& lambda =
+          *std::get<UserDefinedFunction>((*f)()).closure.data().lambda;
+      if (lambda.params.size() != argc) return EvalError("arity mismatch");
+      site.code.store(&compiled(ctx, lambda), relaxed);
+    }
+    site.function.store(f, relaxed);
+    site.owner.store(ctx.function_owner(), relaxed);
+    site.epoch.store(epoch, std::memory_order_release);
+    return f;
+  }
+
+  eval_result<void> call(Chunk const& chunk, Instruction i,
+                         EvaluationContext& root, std::size_t frame_base) {
+    auto const& l = std::get<List<Term>>(*chunk.constants[i.b]);
+    // frames never define functions, so they resolve like `root`
+    Function const* f =
+        OUTCOME_TRYX(resolve(chunk.call_sites[i.a], root, l.size() - 1));
+    auto const* builtin = std::get_if<BuiltInFunction>(&(*f)());
+    if (builtin == nullptr) return EvalError("not defined");
+
+    bool const local = frames_.size() > frame_base;
+    EvaluationContext& env =
+        local ? materialize(chunk, root, frame_base) : root;
+    EffectJournal& journal = env.journal();
+    auto const mark = journal.mark();
+    EvaluationResult result = builtin->apply(env, l.tail());
+    if (not result) {
+      journal.rollback(mark);
+      return result.error();
+    }
+    auto const done = journal.commit(mark, env);
+    if (local) write_back(chunk);
+    if (not done) return done.error();
+    stack_.push_back(std::move(result.value().t));
+    return outcome::success();
+  }
+
+  eval_result<void> push_callee(Chunk const& chunk, Instruction i,
+                                EvaluationContext& root) {
+    Chunk::CallSite const& site = chunk.call_sites[i.a];
+    Function const* f = OUTCOME_TRYX(resolve(site, root, i.b));
+    auto const* user = std::get_if<UserDefinedFunction>(&(*f)());
+    if (user == nullptr) return EvalError("not defined");
+    // memoized functions are part of the keys of their results
+    ClosureData const& data = user->closure.data();
+    callees_.push_back(
+        {&data, site.code.load(std::memory_order_relaxed),
+         data.memoized ? Term{user->closure} : Term{NIL}});
+    return outcome::success();
+  }
+
+  eval_result<void> push_callee_value(Instruction i,
+                                      EvaluationContext& root) {
+    auto const* closure = std::get_if<Closure>(&*stack_.back());
+    if (closure == nullptr) return EvalError("not a function");
+    ClosureData const& data = closure->data();
+    if (data.lambda->params.size() != i.b) return EvalError("arity mismatch");
+    Chunk const& code = compiled(root, *data.lambda);
+    callees_.push_back({&data, &code, std::move(stack_.back())});
+    stack_.pop_back();
+    return outcome::success();
+  }
+
+  // Moves the top `argc` values and the captures of the last callee into a
+  // new frame at the top of the slot stack and starts running its body,
+  // either in a new activation or, for a tail call, in place of the running
+  // one, whose frames are dropped first.
+  void apply(std::size_t argc, bool tail) {
+    Callee callee = std::move(callees_.back());
+    callees_.pop_back();
+
+    std::size_t frame = frames_.size();
+    std::size_t base = slots_.size();
+    if (tail) {
+      ++stats_.tail_calls;
+      frame = activations_.back().frame_base;
+      if (frame < frames_.size()) base = frames_[frame].base;
+      frames_.resize(frame);
+    }
+
+    // the slots of dropped frames are overwritten in place
+    auto const& captures = callee.closure->captures;
+    slots_.resize(base + callee.code->scopes[0].slots.size());
+    auto const args = stack_.end() - argc;
+    auto const lets = std::copy(
+        captures.begin(), captures.end(),
+        std::move(args, stack_.end(), slots_.begin() + base));
+    std::fill(lets, slots_.end(), std::nullopt);
+    stack_.erase(args, stack_.end());
+    frames_.push_back({static_cast<std::uint32_t>(base), 0, nullptr});
+
+    Activation next{callee.code, 0, frame, std::move(callee.keep), nullptr};
+    if (tail) {
+      activations_.back() = std::move(next);
+    } else {
+      activations_.push_back(std::move(next));
+    }
+  }
+
+  // Calls the last callee through its native code, if the JIT has it or
+  // compiles it now, and pushes the result like a builtin would; false if
+  // the call has to be interpreted.
+  bool call_native(std::size_t argc, EvaluationContext const& root) {
+    Callee const& callee = callees_.back();
+    JitState* const jit = callee.code->jit.get();
+    if (jit == nullptr) return false;
+    NativeEntry const entry = tier_up(*jit, root, *callee.closure->lambda,
+                                      *callee.code, jit_threshold_);
+    if (entry == nullptr) return false;
+
+    std::int64_t args[jit::kMaxParams];
+    auto const first = stack_.end() - argc;
+    for (std::size_t p = 0; p < argc; ++p) {
+      auto const* n = std::get_if<Number>(&*first[p]);
+      if (n == nullptr or not n->is_fixnum()) return false;
+      args[p] = n->fixnum();
+    }
+    std::int64_t result;
+    if (not entry(args, &result)) {
+      ++stats_.jit_bailouts;
+      jit->give_up();
+      return false;
+    }
+
+    ++stats_.native_calls;
+    stack_.erase(first, stack_.end());
+    callees_.pop_back();
+    stack_.push_back(Term{Number(result)});
+    return true;
+  }
+
+  // Looks the call of the last callee, which is memoized, up in the cache.
+  // On a hit, pushes the result like a builtin would and returns null;
+  // otherwise returns the key to store the result under.
+  std::unique_ptr<MemoCache::Key> recall(std::size_t argc) {
+    Callee const& callee = callees_.back();
+    auto const first = stack_.end() - argc;
+    auto key = std::make_unique<MemoCache::Key>(
+        std::get<Closure>(*callee.keep),
+        std::vector<Term>{first, stack_.end()});
+    auto hit = MemoCache::global().find(*key);
+    if (not hit) return key;
+
+    stack_.erase(first, stack_.end());
+    callees_.pop_back();
+    stack_.push_back(std::move(*hit));
+    return nullptr;
+  }
+
+  // Drops the frames of the running activation, whose result is on top.
+  void leave() {
+    Activation& a = activations_.back();
+    if (a.memo != nullptr) {
+      MemoCache::global().insert(std::move(*a.memo), stack_.back());
+    }
+    if (a.frame_base < frames_.size()) {
+      slots_.resize(frames_[a.frame_base].base);
+      frames_.resize(a.frame_base);
+    }
+    activations_.pop_back();
+  }
+
+  // The state run() and run_closure() are entered with, which they leave
+  // the machine in; everything above it is theirs.
+  struct Marks {
+    std::size_t stack;
+    std::size_t slots;
+    std::size_t frames;
+    std::size_t activations;
+    std::size_t callees;
+  };
+
+  Marks mark() const {
+    return {stack_.size(), slots_.size(), frames_.size(), activations_.size(),
+            callees_.size()};
+  }
+
+  // Returns to `marks`, with the value on top of the stack as the result
+  // unless `result` is an error.
+  EvaluationResult unwind(Marks const& marks, eval_result<void> result) {
+    slots_.resize(marks.slots);
+    frames_.resize(marks.frames);
+    activations_.erase(activations_.begin() + marks.activations,
+                       activations_.end());
+    callees_.erase(callees_.begin() + marks.callees, callees_.end());
+    if (not result) {
+      stack_.erase(stack_.begin() + marks.stack, stack_.end());
+      return result.error();
+    }
+
+    EvaluationSuccess es{std::move(stack_.back())};
+    stack_.erase(stack_.begin() + marks.stack, stack_.end());
+    return es;
+  }
+
+  // Runs until the activation at index `entry` returns.
+  eval_result<void> execute(EvaluationContext& root, std::size_t entry) {
+    Chunk const* chunk;
+    Instruction const* pc;
+    Instruction const* end;
+    std::size_t frame_base;
+    auto const enter = [&] {
+      Activation const& a = activations_.back();
+      chunk = a.chunk;
+      pc = chunk->code.data() + a.pc;
+      end = chunk->code.data() + chunk->code.size();
+      frame_base = a.frame_base;
+    };
+    auto const suspend = [&] {
+      activations_.back().pc = pc - chunk->code.data();
+    };
+    enter();
+
+    while (true) {
+      if (pc == end) {
+        leave();
+        if (activations_.size() == entry) return outcome::success();
+        enter();
+        continue;
+      }
+      Instruction const i = *pc++;
+      switch (i.op) {
+        case Op::Const:
+          stack_.push_back(chunk->constants[i.a]);
+          break;
+        case Op::Fixnum:
+          stack_.push_back(Term{Number{i.fixnum()}});
+          break;
+        case Op::LoadLocal:
+          stack_.push_back(*slot({i.a, i.b}));
+          break;
+        case Op::LoadGlobal: {
+          Identifier const id = Identifier::from_id(i.a);
+          Term const* t = root.find_value(id);
+          stack_.push_back(t != nullptr ? *t : Term{id});
+          break;
+        }
+        case Op::Lookup: {
+          Chunk::Lookup const& l = chunk->lookups[i.a];
+          Term const* t = lookup(l, root);
+          stack_.push_back(t != nullptr ? *t : Term{Identifier::from_id(l.id)});
+          break;
+        }
+        case Op::CheckNumber:
+          if (not std::holds_alternative<Number>(*stack_.back()) and
+              not std::holds_alternative<Vector>(*stack_.back())) {
+            return arithmetic_error();
+          }
+          break;
+        case Op::Add:
+          if (not arithmetic(std::plus<>{})) {
+            OUTCOME_TRYV(vector_operation(simd::Arith::Add));
+          }
+          break;
+        case Op::Subtract:
+          if (not arithmetic(std::minus<>{})) {
+            OUTCOME_TRYV(vector_operation(simd::Arith::Subtract));
+          }
+          break;
+        case Op::Multiply:
+          if (not arithmetic(std::multiplies<>{})) {
+            OUTCOME_TRYV(vector_operation(simd::Arith::Multiply));
+          }
+          break;
+        case Op::Equal:
+          if (not compare(std::equal_to<>{})) return arithmetic_error();
+          break;
+        case Op::Less:
+          if (not compare(std::less<>{})) return arithmetic_error();
+          break;
+        case Op::Greater:
+          if (not compare(std::greater<>{})) return arithmetic_error();
+          break;
+        case Op::LessEqual:
+          if (not compare(std::less_equal<>{})) return arithmetic_error();
+          break;
+        case Op::GreaterEqual:
+          if (not compare(std::greater_equal<>{})) return arithmetic_error();
+          break;
+        case Op::Let: {
+          OUTCOME_TRYV(root.set_value(Identifier::from_id(i.a),
+                                      chunk->constants[i.b]));
+          stack_.push_back(chunk->constants[i.b]);
+          break;
+        }
+        case Op::LetLocal: {
+          auto& s = slot({0, i.a});
+          if (s) return EvalError("value already exists");
+          s = chunk->constants[i.b];
+          stack_.push_back(chunk->constants[i.b]);
+          break;
+        }
+        case Op::EnterScope: {
+          Chunk::Scope const& scope = chunk->scopes[i.a];
+          auto const base = static_cast<std::uint32_t>(slots_.size());
+          slots_.resize(base + scope.slots.size());
+          for (std::size_t a = 0; a < scope.arguments.size(); ++a) {
+            slots_[base + a] = scope.arguments[a];
+          }
+          frames_.push_back({base, i.a, nullptr});
+          break;
+        }
+        case Op::LeaveScope:
+          slots_.resize(frames_.back().base);
+          frames_.pop_back();
+          break;
+        case Op::Call: {
+          OUTCOME_TRYV(call(*chunk, i, root, frame_base));
+          break;
+        }
+        case Op::Jump:
+          pc = chunk->code.data() + i.a;
+          break;
+        case Op::JumpIfBusy:
+          if (WorkStealingPool::global().busy()) {
+            pc = chunk->code.data() + i.a;
+          }
+          break;
+        case Op::JumpIfFalse: {
+          bool const taken = not is_true(stack_.back());
+          stack_.pop_back();
+          if (taken) pc = chunk->code.data() + i.a;
+          break;
+        }
+        case Op::MakeClosure: {
+          Chunk::LambdaSite const& site = chunk->lambdas[i.a];
+          std::vector<std::optional<Term>> captures;
+          captures.reserve(site.captures.size());
+          for (Chunk::Lookup const& l : site.captures) {
+            Term const* t = lookup(l, root);
+            captures.push_back(t != nullptr ? std::optional{*t}
+                                            : std::nullopt);
+          }
+          stack_.push_back(
+              Term{make_closure(site.lambda, std::move(captures))});
+          break;
+        }
+        case Op::Callee: {
+          OUTCOME_TRYV(push_callee(*chunk, i, root));
+          break;
+        }
+        case Op::CalleeValue: {
+          OUTCOME_TRYV(push_callee_value(i, root));
+          break;
+        }
+        case Op::Apply:
+        case Op::TailApply: {
+          // the running function goes on from here even after a tail call,
+          // which only leaves it
+          std::unique_ptr<MemoCache::Key> memo;
+          if (callees_.back().closure->memoized) {
+            memo = recall(i.a);
+            if (memo == nullptr) break;
+          } else if (jit_ and call_native(i.a, root)) {
+            break;
+          }
+          // memoized calls, and calls from them, have to return to store the
+          // result
+          bool const tail = i.op == Op::TailApply and memo == nullptr and
+                            activations_.back().memo == nullptr;
+          suspend();
+          apply(i.a, tail);
+          enter();
+          activations_.back().memo = std::move(memo);
+          break;
+        }
+        case Op::Fail:
+          return EvalError(chunk->messages[i.a]);
+      }
+    }
+  }
+
+ public:
+  Stats const& stats() const { return stats_; }
+  void reset_stats() { stats_ = {}; }
+
+  // Whether hot functions run as native code, where the JIT is available.
+  bool jit() const { return jit_; }
+  void set_jit(bool on) { jit_ = on and kJitAvailable; }
+  // calls of a function body after which it is compiled to native code
+  void set_jit_threshold(std::uint32_t calls) { jit_threshold_ = calls; }
+
+  EvaluationResult run(Chunk const& chunk, EvaluationContext& ctx) {
+    Marks const marks = mark();
+    activations_.push_back({&chunk, 0, marks.frames, Term{NIL}, nullptr});
+    return unwind(marks, execute(ctx, marks.activations));
+  }
+
+  // Runs the body of `closure` on `args`, which it takes as many of as it
+  // has parameters, as a call from a Chunk would: through the memo cache or
+  // native code if it has them, and with its tail calls in constant space.
+  // This is how builtins call closures. The body sees the globals of `ctx`
+  // and records its effects in its journal.
+  EvaluationResult run_closure(Closure const& closure, std::vector<Term> args,
+                               EvaluationContext& ctx) {
+    Marks const marks = mark();
+    ClosureData const& data = closure.data();
+    std::size_t const argc = args.size();
+    std::move(args.begin(), args.end(), std::back_inserter(stack_));
+    callees_.push_back({&data, &compiled(ctx, *data.lambda), Term{closure}});
+
+    std::unique_ptr<MemoCache::Key> memo;
+    if (data.memoized) {
+      memo = recall(argc);
+      if (memo == nullptr) return unwind(marks, outcome::success());
+    } else if (jit_ and call_native(argc, ctx)) {
+      return unwind(marks, outcome::success());
+    }
+    apply(argc, false);
+    activations_.back().memo = std::move(memo);
+    return unwind(marks, execute(ctx, marks.activations));
+  }
+};
+
+}  // namespace guci
@@ -0,0 +1,232 @@
+#include "guci/eval/vm.hpp"
+
+#include <string>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "guci/eval/compiler.hpp"
+#include "guci/eval/evaluator.hpp"
+#include "guci/eval/test_helpers.hpp"
+#include "guci/parse/reader.hpp"
+
+namespace guci {
+
+using testing::show;
+using testing::with_generic_builtins;
+
+namespace {
+// Runs the forms of `program` through both evaluators, each with its own
+// global context, and returns the printed results of both.
+std::pair<std::vector<std::string>, std::vector<std::string>> run_both(
+    std::string_view program) {
+  bool quit_tree = false;
+  bool quit_vm = false;
+  EvaluationContext const tree_global = make_global_context(quit_tree);
+  EvaluationContext const vm_global = make_global_context(quit_vm);
+  EvaluationContext tree_ctx = with_generic_builtins(tree_global);
+  EvaluationContext vm_ctx = with_generic_builtins(vm_global);
+  VirtualMachine vm;
+
+  std::vector<std::string> tree;
+  std::vector<std::string> bytecode;
+  auto const forms = read_all(program).value();
+  for (Term const& t : forms) {
+    tree.push_back(show(std::visit(EvaluatingVisitor{tree_ctx}, *t)));
+    bytecode.push_back(show(vm.run(compile(vm_ctx, t), vm_ctx)));
+  }
+  REQUIRE(quit_tree == quit_vm);
+  return {tree, bytecode};
+}
+}  // namespace
+
+TEST_CASE("vm matches the tree-walking evaluator", "[vm]") {
+  auto const program = GENERATE(as<std::string_view>{},
+      "1 \"s\" x () (+) (*) (+ 1 2 3) (* 2 3 4) (- 10 1 2) (- 5)",
+      "(- x) (- \"s\") (+ x 1) (+ 1 x) (* 1 \"a\") (- 1 x)",
+      "(+ 9223372036854775807 1) (* 4294967296 4294967296 -1)",
+      "-9223372036854775808 (- -9223372036854775808 1) 99999999999999999999",
+      "(let x 5) x (+ x x) (let x 6) (let y (+ 1 2)) y (+ y 1)",
+      "(let) (let 1 2) (let x) (1 2) (foo 1) (quit 1)",
+      "(eval (+ a b) a 1 b 2) (eval a) (eval a b) (eval (+ a a) a 2 a 3)",
+      "(eval (* a (eval (+ a b) b 3)) a 2) (eval (let z 1)) z",
+      "(eval (+ (let q 1) q) w 4) q (eval 1 2 3)",
+      "(+ 1 (let r 2) r) r (+ \"a\" (let s 1)) s (- (let t 1) (foo)) t",
+      "(+ (eval (let u 1) v 2) (let u 3)) u (quit) (+ 1 2)",
+      "(eval (+ a (eval (+ a (let a 2) a) b 1) (let c 7) c) a 1)",
+      "(eval (+ (eval (+ a b) b 5) (let b 2) b) a 1 x 0)",
+      "(eval (eval (+ a (let b 3) b (let a 4) a) c 0) a 1)",
+      "(eval (let a 2) a 1)",
+      "(sum 1 2) (bind g 3) g (sum g g) (bind g 4) (sum (let h 1) h)",
+      "(eval (sum a (bind b 2) b) a 1) (eval (+ (sum (bind b 2)) b) a 1)",
+      "(eval (+ (bind b 2) (let b 3)) a 1) (eval (sum (let c 1) c) a 1)",
+      "(eval (+ (bind z 1) (eval (+ z (sum z)) y 2) z) a 1) z",
+      "(eval (+ (sum (eval (bind w 1) q 1)) (let w 2) w) a 1) (eval w q 1)");
+
+  auto const [tree, bytecode] = run_both(program);
+  REQUIRE(tree == bytecode);
+}
+
+TEST_CASE("vm matches the evaluator on user functions", "[vm]") {
+  auto const program = GENERATE(as<std::string_view>{},
+      "(if (< 1 2) 3 4) (if () 1 2) (if 0 1 2) (if (= 1 x) 1 2) (if 1 2)",
+      "(= 1 1) (< 2 1) (> 2 1) (<= 2 2) (>= 1 2) (< x 1) (< 1 \"a\") (=)",
+      "(define sq (x) (* x x)) (sq 4) (sq) (sq 1 2) (sq y) sq "
+      "(define sq (y) y)",
+      "(define fib (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2))))) "
+      "(fib 15) (fib x)",
+      "(define loop (n acc) (if (= n 0) acc (loop (- n 1) (+ acc n)))) "
+      "(loop 1000 0)",
+      "(define ev (n) (if (= n 0) (= 0 0) (od (- n 1)))) "
+      "(define od (n) (if (= n 0) (= 0 1) (ev (- n 1)))) (ev 10) (od 7)",
+      "(define adder (n) (lambda (x) (+ x n))) (funcall (adder 5) 10) "
+      "(let f (adder 2)) (funcall f 1) (funcall f) (funcall 1 2) (funcall g)",
+      "(let k 7) (define getk () k) (getk) (eval (getk) k 1) (let k 8) (getk)",
+      "(funcall (lambda (a b) (- a b)) 5 2) (lambda (a a) a) (lambda 1 2)",
+      "(eval (funcall (lambda (y) (+ y a)) 2) a 1) (lambda (x) x)",
+      "(eval (define h () 1) a 1) (h) (define 1 () 2) (define j x 1)",
+      "(define lets (a) (+ (let b (* a 2)) b a)) (lets 3) b",
+      "(define f (x) (sum x (bind y 2) y)) (f 1) y (define m (x) (bind x 3)) "
+      "(m 1)",
+      "(define g (x) (eval (+ x a (let a 3) a) a 1)) (g 2) (nope 1 (quit))",
+      "(define t (x) (if (< x 0) (foo) x)) (t 1) (t -1) (+ 1 (t -1))",
+      "(define c (n) (lambda () n)) (let cs (c 4)) (funcall cs) "
+      "(define compose (f g) (lambda (x) (funcall f (funcall g x)))) "
+      "(funcall (compose (c 1) (adder 1)) 2) (funcall (compose cs cs))",
+      "(defmemo mf (n) (if (< n 2) n (+ (mf (- n 1)) (mf (- n 2))))) "
+      "(mf 60) (mf 60) (mf x) (defmemo bad (x) (let y x)) (bad 1) "
+      "(define twice (f x) (+ (funcall f x) (funcall f x))) "
+      "(twice (memoize (lambda (x) (* x x))) 5) "
+      "(memoize (lambda (x) (let y x)))",
+      "(defmemo count (n acc) (if (= n 0) acc (count (- n 1) (+ acc 1)))) "
+      "(count 500 0) (count 1000 0) (count 5 (count 5 0))");
+
+  auto const [tree, bytecode] = run_both(program);
+  REQUIRE(tree == bytecode);
+}
+
+TEST_CASE("tail calls run in constant space", "[vm]") {
+  bool quit = false;
+  VirtualMachine vm;
+  vm.set_jit(false);
+  EvaluationContext ctx = make_global_context(quit);
+  auto const run = [&](std::string_view source) {
+    return show(vm.run(compile(ctx, read(source).value()), ctx));
+  };
+
+  run("(define loop (n acc) (if (= n 0) acc (loop (- n 1) (+ acc n))))");
+  run("(define ev (n) (if (= n 0) (= 0 0) (od (- n 1))))");
+  run("(define od (n) (if (= n 0) (= 0 1) (ev (- n 1))))");
+  vm.reset_stats();
+  REQUIRE(run("(loop 1000000 0)") == "500000500000");
+  // the call from the top level is in tail position too
+  REQUIRE(vm.stats().tail_calls == 1000001);
+  REQUIRE(run("(ev 1000001)") == "#f");
+  REQUIRE(run("(funcall (lambda (n) (loop n 0)) 10)") == "55");
+}
+
+TEST_CASE("closures called by builtins make tail calls in constant space",
+          "[vm]") {
+  bool quit = false;
+  EvaluationContext global = make_global_context(quit);
+  // calls the closure it is given on 1000000 and 0
+  auto call_loop = [](EvaluationContext& c,
+                      std::span<Term const> args) -> EvaluationResult {
+    EvaluationSuccess f =
+        OUTCOME_TRYX(std::visit(EvaluatingVisitor{c}, *args[0]));
+    return apply_closure(std::get<Closure>(*f.t), c,
+                         {Term{Number(1000000)}, Term{Number(0)}});
+  };
+  EvaluationContext ctx{
+      &global, {{"call-loop", BuiltInFunction(1, call_loop)}}, {}};
+  auto const run = [&](std::string_view source) {
+    return show(evaluate(ctx, read(source).value()));
+  };
+  bool const jit = thread_vm().jit();
+  thread_vm().set_jit(false);
+
+  run("(define loop (n acc) (if (= n 0) acc (loop (- n 1) (+ acc n))))");
+  thread_vm().reset_stats();
+  REQUIRE(run("(call-loop (lambda (n acc) (loop n acc)))") == "500000500000");
+  REQUIRE(thread_vm().stats().tail_calls >= 1000000);
+  REQUIRE(run("(pcall loop 1000000 0)") == "500000500000");
+  REQUIRE(run("(eval (pcall loop n 0) n 1000000)") == "500000500000");
+  // the tree-walking evaluator calls functions the same way
+  REQUIRE(show(std::visit(EvaluatingVisitor{ctx},
+                          *read("(loop 1000000 0)").value())) ==
+          "500000500000");
+  thread_vm().set_jit(jit);
+}
+
+TEST_CASE("compiler lowers intrinsics to opcodes", "[vm]") {
+  bool quit = false;
+  EvaluationContext ctx = make_global_context(quit);
+
+  Chunk const arithmetic = compile(ctx, read("(+ 1 (* 2 x))").value());
+  std::vector<Op> ops;
+  for (auto const& i : arithmetic.code) ops.push_back(i.op);
+  REQUIRE(ops == std::vector{Op::Fixnum, Op::CheckNumber, Op::Fixnum,
+                             Op::CheckNumber, Op::LoadGlobal, Op::Multiply,
+                             Op::Add});
+  REQUIRE(arithmetic.constants.empty());
+
+  Chunk const call = compile(ctx, read("(quit)").value());
+  REQUIRE(call.code.size() == 1);
+  REQUIRE(call.code[0].op == Op::Call);
+
+  Chunk const error = compile(ctx, read("(let 1 2)").value());
+  REQUIRE(error.code.size() == 1);
+  REQUIRE(error.code[0].op == Op::Fail);
+}
+
+TEST_CASE("vm can be re-entered", "[vm]") {
+  bool quit = false;
+  VirtualMachine vm;
+  EvaluationContext ctx = make_global_context(quit);
+  auto inner = [&vm](EvaluationContext& c, std::span<Term const>) {
+    return vm.run(compile(c, read("(+ 1 2)").value()), c);
+  };
+  EvaluationContext nested{&ctx, {{"inner", BuiltInFunction(0, inner)}}, {}};
+
+  auto const r = vm.run(compile(nested, read("(* 2 (inner))").value()), nested);
+  REQUIRE(show(r) == "6");
+}
+
+
+TEST_CASE("call sites cache the function they resolve", "[vm]") {
+  bool quit = false;
+  VirtualMachine vm;
+  EvaluationContext ctx = make_global_context(quit);
+  auto constant = [](int n) {
+    return BuiltInFunction(
+        0, [n](EvaluationContext&, std::span<Term const>) -> EvaluationResult {
+          return Term{Number(n)};
+        });
+  };
+  EvaluationContext outer{&ctx, {{"f", constant(1)}}, {}};
+  Chunk const chunk = compile(outer, read("(eval (+ (f) (f)) x 1)").value());
+
+  REQUIRE(show(vm.run(chunk, outer)) == "2");
+  REQUIRE(vm.stats().call_cache_hits == 2);
+  REQUIRE(vm.stats().call_cache_misses == 0);
+
+  // a context that shadows `f` resolves it anew
+  vm.reset_stats();
+  EvaluationContext inner{&outer, {{"f", constant(2)}}, {}};
+  REQUIRE(show(vm.run(chunk, inner)) == "4");
+  REQUIRE(show(vm.run(chunk, inner)) == "4");
+  REQUIRE(vm.stats().call_cache_hits == 2);
+  REQUIRE(vm.stats().call_cache_misses == 2);
+
+  // and any new definition invalidates every cache
+  REQUIRE(show(vm.run(chunk, outer)) == "2");
+  EvaluationContext const unrelated{{{"g", constant(3)}}, {}};
+  vm.reset_stats();
+  REQUIRE(show(vm.run(chunk, outer)) == "2");
+  REQUIRE(vm.stats().call_cache_hits == 0);
+  REQUIRE(vm.stats().call_cache_misses == 2);
+
+  EvaluationContext empty{{}, {}};
+  REQUIRE(show(vm.run(chunk, empty)) == "error: function not found");
+}
+
+}  // namespace guci
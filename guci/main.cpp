@@ -1,6 +1,7 @@
 #include <fmt/core.h>
 #include <readline/history.h>
 #include <readline/readline.h>
+#include <signal.h>
 #include <unistd.h>
 
 #include <algorithm>
@@ -8,19 +9,26 @@
 #include <cstdlib>
 #include <functional>
 #include <memory>
+#include <optional>
 #include <span>
 #include <sstream>
 #include <string>
 #include <string_view>
+#include <system_error>
+#include <thread>
 #include <unordered_set>
 #include <variant>
 #include <vector>
 
-#include "guci/eval/ast_eval_utils.hpp"
-#include "guci/eval/eval.hpp"
-#include "guci/eval/eval_error.hpp"
+#include "guci/eval/evaluator.hpp"
+#include "guci/eval/session.hpp"
 #include "guci/parse/ast.hpp"
 #include "guci/parse/parse.hpp"
+#include "guci/parse/reader.hpp"
+#include "guci/parse/stream_reader.hpp"
+#include "guci/server/server.hpp"
+#include "guci/utils/buffered_writer.hpp"
+#include "guci/utils/mapped_file.hpp"
 #include "guci/utils/outcome.hpp"
 #include "guci/utils/overload.hpp"
 #include "guci/utils/string_manipulation.hpp"
@@ -33,277 +41,183 @@ struct CStringDeleter {
 
 using SafeCStr = std::unique_ptr<char, CStringDeleter>;
 
-EvaluationResult apply(Function const& fun, EvaluationContext& ctx,
-                       std::span<Term const> args) {
-  auto const v = overload(
-      [&](BuiltInFunction const& f) -> EvaluationResult {
-        if (not f.acceptsArgumentNumber(args.size())) {
-          return EvalError{"arity mismatch"};
-        }
-        return f.apply(ctx, args);
-      },
-      [](UserDefinedFunction const&) -> EvaluationResult {
-        return EvalError{"not defined"};
-      });
-  return std::visit(v, fun());
-}
+outcome::result<void> RunRepl() {
+  rl_bind_key('\t', rl_complete);
 
-class ActionVisitor {
-  EvaluationContext** pctx_;
+  bool program_termination_requested = false;
 
- public:
-  ActionVisitor(EvaluationContext** pctx) : pctx_{pctx} {}
-  eval_result<void> operator()(SetValue id_to_value) {
-    return (*pctx_)->set_value(id_to_value.id, id_to_value.value);
-  }
-};
+  EvaluationContext global_context =
+      make_global_context(program_termination_requested);
 
-EvaluationResult execute_actions(EvaluationContext** ctx,
-                                 EvaluationSuccess result) {
-  for (Action const& a : result.as) {
-    OUTCOME_TRYV(std::visit(ActionVisitor{ctx}, *a));
-  }
+  while (not program_termination_requested) {
+    SafeCStr input{readline("prompt> ")};
 
-  return EvaluationSuccess{result.t};
-}
+    if (input == nullptr) {
+      break;
+    }
 
-class EvaluatingVisitor {
-  EvaluationContext* context_;
+    add_history(input.get());
 
- public:
-  EvaluatingVisitor(EvaluationContext& context)
-      : context_{std::addressof(context)} {}
+    auto result = show_result(global_context, input.get());
+    puts(result.c_str());
+  }
 
-  EvaluationResult operator()(List<Term> const& l) {
-    if (l.empty()) return Term{Nil{}};
+  return outcome::success();
+}
 
-    auto v = overload(
-        [this, &l](Identifier const& id) -> EvaluationResult {
-          Function const* f = context_->find_function(id.value());
-          if (f == nullptr) return EvalError{"function not found"};
+// Evaluates every top-level form read from `fd` as soon as it is complete,
+// up to the first that does not parse, which is reported on stderr as in a
+// script.
+outcome::result<void> RunStream(int fd) {
+  bool program_termination_requested = false;
 
-          return apply(*f, *context_, l.tail());
-        },
-        [](auto const&) -> EvaluationResult {
-          return EvalError{"not a function"};
-        });
-    return execute_actions(&context_,
-                           OUTCOME_TRYX(std::visit(v, l.at(0).term())));
-  }
+  EvaluationContext global_context =
+      make_global_context(program_termination_requested);
 
-  EvaluationResult operator()(Number const& n) { return Term{n}; }
+  StreamReader reader{fd};
+  BufferedWriter out{fileno(stdout)};
 
-  EvaluationResult operator()(Identifier const& id) {
-    Term const* t = context_->find_value(id.value());
-    if (t == nullptr) {
-      return Term{id};
+  while (not program_termination_requested) {
+    auto form = OUTCOME_TRYX(reader.next_form());
+    if (not form) break;
+
+    auto parsed = read(*form);
+    if (not parsed) {
+      // after the results of the forms before it
+      OUTCOME_TRYV(out.flush());
+      fmt::print(stderr, "<stdin>: {}\n", parsed.error().msg);
+      return std::make_error_code(std::errc::invalid_argument);
     }
 
-    return *t;
+    OUTCOME_TRYV(out.write(show_result(global_context, parsed.value())));
+    OUTCOME_TRYV(out.write("\n"));
   }
 
-  EvaluationResult operator()(Nil const&) { return Term{NIL}; }
-
-  EvaluationResult operator()(String const& s) { return Term{s}; }
+  return out.flush();
+}
 
-  EvaluationResult operator()(Boolean const& b) { return Term{b}; }
-};
+// Runs the top-level forms of `source` in order, up to the first that does
+// not parse, whose message is left in `parse_error`.
+outcome::result<void> RunForms(std::string_view source,
+                               std::string& parse_error) {
+  bool program_termination_requested = false;
 
-class PrintingVisitor {
-  std::stringstream s;
+  EvaluationContext global_context =
+      make_global_context(program_termination_requested);
 
- public:
-  std::string get() { return s.str(); }
+  Reader reader{skip_shebang(source)};
+  BufferedWriter out{fileno(stdout)};
 
-  void operator()(List<Term> const& l) {
-    s << '[';
-    const auto num_elements = l.size();
-    for (int i = 0; i < num_elements; ++i) {
-      if (i > 0) s << ' ';
-      std::visit(*this, l.at(i).term());
+  while (not program_termination_requested and not reader.at_end()) {
+    auto parsed = reader.read_term();
+    if (not parsed) {
+      // reported after the results of the forms before it
+      OUTCOME_TRYV(out.flush());
+      parse_error = parsed.error().msg;
+      return std::make_error_code(std::errc::invalid_argument);
     }
-    s << ']';
-  }
 
-  template <typename T>
-  void operator()(T const& t) {
-    s << t;
+    OUTCOME_TRYV(out.write(show_result(global_context, parsed.value())));
+    OUTCOME_TRYV(out.write("\n"));
   }
-};
-
-std::string show_result(EvaluationContext& context, std::string_view input) {
-  Term t = parse(input).value();
 
-  EvaluatingVisitor ev(context);
-  EvaluationResult res = std::visit(ev, t.term());
-
-  if (!res) {
-    return res.error().msg();
-  }
-  EvaluationSuccess es = res.value();
-  PrintingVisitor v;
-  std::visit(v, *es.t);
+  return out.flush();
+}
 
-  return v.get();
+// Runs a script file and reports why it failed, if it did, on one line of
+// stderr. The parser works on the mapped file directly, so the source is
+// never copied.
+outcome::result<void> RunScript(std::string const& path) {
+  std::string parse_error;
+  auto result = [&]() -> outcome::result<void> {
+    MappedFile const script = OUTCOME_TRYX(MappedFile::open(path));
+    return RunForms(script.view(), parse_error);
+  }();
+  if (not result) {
+    fmt::print(stderr, "{}: {}\n", path,
+               parse_error.empty() ? result.error().message() : parse_error);
+  }
+  return result;
 }
 
-class Add {
- public:
-  EvaluationResult operator()(EvaluationContext& ctx,
-                              std::span<Term const> ts) {
-    EvaluationSuccess es{Number(0)};
-    for (auto const& t : ts) {
-      EvaluationSuccess t_eval =
-          OUTCOME_TRYX(std::visit(EvaluatingVisitor{ctx}, *t));
-      es.merge_action_from(std::move(t_eval.as));
-      EvaluationSuccess r = OUTCOME_TRYX(std::visit(*this, *es.t, *t_eval.t));
-      es.t = r.t;
-      es.merge_action_from(std::move(r.as));
+// Serves sessions on the Unix socket at `path` until SIGINT or SIGTERM, with
+// the definitions of `preload` shared by all of them. A preload that cannot
+// be read or loaded is reported here, under its own name, and `reported` is
+// set.
+outcome::result<void> RunServer(std::string const& path, std::size_t threads,
+                                std::optional<std::string> const& preload,
+                                bool& reported) {
+  // blocked before any thread starts, so that only sigwait() sees them
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+  SharedEnvironment environment;
+  if (preload) {
+    auto const file = MappedFile::open(*preload);
+    if (not file) {
+      fmt::print(stderr, "{}: {}\n", *preload, file.error().message());
+      reported = true;
+      return file.error();
     }
-    return es;
-  }
-
-  EvaluationResult operator()(Number const& lhs, Number const& rhs) {
-    return Term{Number{lhs.value() + rhs.value()}};
-  }
-
-  template <typename LHS, typename RHS>
-  EvaluationResult operator()(LHS const&, RHS const&) {
-    return EvalError("unbound variables in arithmetic expression");
-  }
-};
-
-class Subtract {
- public:
-  EvaluationResult operator()(EvaluationContext& ctx,
-                              std::span<Term const> args) {
-    auto arg_0_eval =
-        OUTCOME_TRYX(std::visit(EvaluatingVisitor{ctx}, *args[0]));
-
-    EvaluationSuccess es{arg_0_eval.t};
-    es.merge_action_from(std::move(arg_0_eval.as));
-
-    for (std::size_t i = 1; i < args.size(); ++i) {
-      EvaluationSuccess arg_eval =
-          OUTCOME_TRYX(std::visit(EvaluatingVisitor{ctx}, *args[i]));
-      es.merge_action_from(std::move(arg_eval.as));
-      EvaluationSuccess r = OUTCOME_TRYX(std::visit(*this, *es.t, *arg_eval.t));
-      es.t = r.t;
-      es.merge_action_from(std::move(r.as));
+    auto const loaded = environment.load(file.value().view());
+    if (not loaded) {
+      fmt::print(stderr, "{}: {}\n", *preload, loaded.error().msg());
+      reported = true;
+      return std::make_error_code(std::errc::invalid_argument);
     }
-
-    return es;
   }
 
-  EvaluationResult operator()(Number const& lhs, Number const& rhs) {
-    return Term{Number{lhs.value() - rhs.value()}};
-  }
-
-  template <typename LHS, typename RHS>
-  EvaluationResult operator()(LHS const&, RHS const&) {
-    return EvalError("unbound variables in arithmetic expression");
-  }
-};
+  auto server = OUTCOME_TRYX(SessionServer::start(environment, path, threads));
+  fmt::print(stderr, "serving {} with {} threads\n", path, threads);
+  int signal = 0;
+  sigwait(&signals, &signal);
+  server.reset();
+  ::unlink(path.c_str());
+  return outcome::success();
+}
 
-class Multiply {
-public:
-  EvaluationResult operator()(EvaluationContext& ctx,
-                              std::span<Term const> ts) {
-    EvaluationSuccess es{Number(1)};
-    for (auto const& t : ts) {
-      EvaluationSuccess t_eval =
-          OUTCOME_TRYX(std::visit(EvaluatingVisitor{ctx}, *t));
-      es.merge_action_from(std::move(t_eval.as));
-      EvaluationSuccess r = OUTCOME_TRYX(std::visit(*this, *es.t, *t_eval.t));
-      es.t = r.t;
-      es.merge_action_from(std::move(r.as));
+//   gucilisp --serve PATH [--threads N] [--preload FILE]
+outcome::result<void> Serve(std::vector<std::string_view> const& args) {
+  std::size_t threads = std::max(std::thread::hardware_concurrency(), 1u);
+  std::optional<std::string> preload;
+  bool valid = args.size() % 2 == 1;
+  for (std::size_t i = 3; valid and i < args.size(); i += 2) {
+    if (args[i] == "--threads") {
+      threads = std::max(1, std::atoi(std::string{args[i + 1]}.c_str()));
+    } else if (args[i] == "--preload") {
+      preload = std::string{args[i + 1]};
+    } else {
+      valid = false;
     }
-    return es;
   }
-
-  EvaluationResult operator()(Number const& lhs, Number const& rhs) {
-    return Term{Number{lhs.value() * rhs.value()}};
+  if (args.size() < 3 or not valid) {
+    fmt::print(stderr,
+               "usage: {} --serve PATH [--threads N] [--preload FILE]\n",
+               args[0]);
+    return std::make_error_code(std::errc::invalid_argument);
   }
 
-  template <typename LHS, typename RHS>
-  EvaluationResult operator()(LHS const&, RHS const&) {
-    return EvalError("unbound variables in arithmetic expression");
+  std::string const path{args[2]};
+  bool reported = false;
+  auto result = RunServer(path, threads, preload, reported);
+  if (not result and not reported) {
+    fmt::print(stderr, "{}: {}\n", path, result.error().message());
   }
-};
-
-EvaluationResult builtin_let(EvaluationContext&, std::span<Term const> args) {
-  Identifier id = OUTCOME_TRYX(as_identifier(args[0]));
-  auto set_value_action = SetValue(id.value(), args[1]);
-  return EvaluationSuccess(args[1], {set_value_action});
-}
-
-EvaluationResult builtin_eval(EvaluationContext& ctx,
-                              std::span<Term const> args) {
-  if (args.size() % 2 != 1) {
-    return EvalError("mismatched number of local variables and values");
-  }
-  auto local_ctx = EvaluationContext(&ctx, {}, {});
-  for (auto i = 1u; i < args.size(); i += 2) {
-    OUTCOME_TRYV(
-        local_ctx.set_value(OUTCOME_TRYX(as_identifier(args[i])), args[i + 1]));
-  }
-  return std::visit(EvaluatingVisitor{local_ctx}, *args[0]);
+  return result;
 }
 
-outcome::result<void> RunRepl() {
-  rl_bind_key('\t', rl_complete);
-
-  bool program_termination_requested = false;
+outcome::result<void> Main(std::vector<std::string_view> const& args) {
+  if (args.size() > 1 and args[1] == "--serve") return Serve(args);
 
-  EvaluationContext global_context{
-      {
-          {"+", BuiltInFunction(BuiltInFunction::kAnyArity, Add{})},
-          {"-",
-           BuiltInFunction(BuiltInFunction::kAnyPositiveArity, Subtract{})},
-          {"*", BuiltInFunction(BuiltInFunction::kAnyArity, Multiply{})},
-          {"quit",
-           BuiltInFunction(0,
-                           [&program_termination_requested](
-                               EvaluationContext&,
-                               std::span<Term const>) -> EvaluationResult {
-                             program_termination_requested = true;
-                             return EvaluationSuccess(NIL);
-                           })},
-          {"let", BuiltInFunction(2, builtin_let)},
-          {"eval",
-           BuiltInFunction(BuiltInFunction::kAnyPositiveArity, builtin_eval)},
-      },
-
-      {}};
+  if (args.size() > 1) return RunScript(std::string{args[1]});
 
-  while (not program_termination_requested) {
-    SafeCStr input{readline("prompt> ")};
-
-    if (input == nullptr) {
-      break;
-    }
-
-    add_history(input.get());
-
-    auto result = show_result(global_context, input.get());
-    puts(result.c_str());
-  }
-
-  return outcome::success();
-}
-
-outcome::result<void> Main(std::vector<std::string_view> const& args
-                           [[maybe_unused]]) {
   if (isatty(fileno(stdin))) {
     return RunRepl();
   } else {
-    std::array<char, 128> chunk;
-
-    while (fgets(chunk.data(), chunk.size(), stdin) != NULL) {
-      fputs(chunk.data(), stdout);
-      fputs("|*\n", stdout);
-    }
-    return outcome::success();
+    return RunStream(fileno(stdin));
   }
 }
 
@@ -1,20 +1,39 @@
 #pragma once
 
 #include <algorithm>
+#include <compare>
+#include <cstdint>
 #include <functional>
+#include <initializer_list>
+#include <memory>
 #include <ostream>
 #include <span>
+#include <stdexcept>
 #include <string>
 #include <string_view>
 #include <variant>
 #include <vector>
 
+#include "guci/parse/symbol_table.hpp"
+#include "guci/utils/bigint.hpp"
+#include "guci/utils/shared_array.hpp"
+
 namespace guci {
 
+// Structural hashes: equal terms hash alike whichever copies they are.
+inline std::uint64_t hash_combine(std::uint64_t seed, std::uint64_t v) {
+  // the finalizer of splitmix64
+  std::uint64_t h = seed ^ (v + 0x9e3779b97f4a7c15 + (seed << 6));
+  h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9;
+  h = (h ^ (h >> 27)) * 0x94d049bb133111eb;
+  return h ^ (h >> 31);
+}
+
 class Nil {
  public:
   bool operator==(Nil) const { return true; }
   bool operator!=(Nil) const { return false; }
+  std::uint64_t hash() const { return 0; }
   friend std::ostream& operator<<(std::ostream& out, Nil const&) {
     return out << "NIL";
   }
@@ -22,42 +41,143 @@ class Nil {
 
 inline Nil const NIL{};
 
+// Integers of any size. Values that fit in 64 bits are kept as a fixnum and
+// only promoted to a BigInt when an operation overflows, so the common case
+// never allocates; results are demoted again whenever they fit.
 class Number {
-  int value_;
+  std::variant<std::int64_t, BigInt> value_;
+
+  static BigInt to_bignum(Number const& n) {
+    return n.is_fixnum() ? BigInt{n.fixnum()} : n.bignum();
+  }
 
  public:
-  Number(int value) : value_{value} {}
+  Number(std::int64_t value) : value_{value} {}
+  Number(BigInt value) {
+    if (value.fits_int64()) {
+      value_ = value.to_int64();
+    } else {
+      value_ = std::move(value);
+    }
+  }
   bool operator==(Number const&) const = default;
 
-  int value() const { return value_; }
+  bool is_fixnum() const { return value_.index() == 0; }
+  std::int64_t fixnum() const { return *std::get_if<std::int64_t>(&value_); }
+  BigInt const& bignum() const { return *std::get_if<BigInt>(&value_); }
+
+  std::uint64_t hash() const {
+    if (is_fixnum()) return static_cast<std::uint64_t>(fixnum());
+    std::uint64_t h = bignum().negative();
+    for (auto const limb : bignum().magnitude()) h = hash_combine(h, limb);
+    return h;
+  }
+
+  friend Number operator+(Number const& lhs, Number const& rhs) {
+    std::int64_t r;
+    if (lhs.is_fixnum() and rhs.is_fixnum() and
+        not __builtin_add_overflow(lhs.fixnum(), rhs.fixnum(), &r)) {
+      return r;
+    }
+    return to_bignum(lhs) + to_bignum(rhs);
+  }
+
+  friend Number operator-(Number const& lhs, Number const& rhs) {
+    std::int64_t r;
+    if (lhs.is_fixnum() and rhs.is_fixnum() and
+        not __builtin_sub_overflow(lhs.fixnum(), rhs.fixnum(), &r)) {
+      return r;
+    }
+    return to_bignum(lhs) - to_bignum(rhs);
+  }
+
+  friend Number operator*(Number const& lhs, Number const& rhs) {
+    std::int64_t r;
+    if (lhs.is_fixnum() and rhs.is_fixnum() and
+        not __builtin_mul_overflow(lhs.fixnum(), rhs.fixnum(), &r)) {
+      return r;
+    }
+    return to_bignum(lhs) * to_bignum(rhs);
+  }
+
+  friend std::strong_ordering operator<=>(Number const& lhs,
+                                          Number const& rhs) {
+    if (lhs.is_fixnum() and rhs.is_fixnum()) {
+      return lhs.fixnum() <=> rhs.fixnum();
+    }
+    return to_bignum(lhs) <=> to_bignum(rhs);
+  }
 
   friend std::ostream& operator<<(std::ostream& out, Number const& n) {
-    return out << n.value();
+    if (n.is_fixnum()) return out << n.fixnum();
+    return out << n.bignum();
   }
 };
 
 class Identifier {
-  std::string id;
+  SymbolId id_;
+
+  struct FromId {};
+  Identifier(FromId, SymbolId id) : id_{id} {}
 
  public:
-  Identifier(std::string_view sv) : id{sv} {}
+  Identifier(std::string_view sv) : id_{SymbolTable::global().intern(sv)} {}
+  static Identifier from_id(SymbolId id) { return {FromId{}, id}; }
   bool operator==(Identifier const&) const = default;
 
-  std::string const& value() const { return id; }
+  SymbolId id() const { return id_; }
+  std::string const& value() const { return SymbolTable::global().name(id_); }
+  std::uint64_t hash() const { return id_; }
 
   friend std::ostream& operator<<(std::ostream& out, Identifier const& id) {
     return out << id.value();
   }
 };
 
+// Strings and lists cannot change once built and share their contents, so
+// copying a Term never copies more than a pointer. Their hashes are cached
+// with the contents. Contents interned in the same HashConsTable (see
+// hash_cons.hpp) carry its id as their tag and are stored there once, so
+// they are equal only if they are the same contents.
+namespace detail {
+template <typename T>
+bool same_contents(SharedArray<T> const& a, SharedArray<T> const& b) {
+  if (a.view().data() == b.view().data()) return true;
+  if (a.tag() != 0 and a.tag() == b.tag()) return false;
+  auto const ha = a.cached_hash();
+  auto const hb = b.cached_hash();
+  if (ha != 0 and hb != 0 and ha != hb) return false;
+  return std::ranges::equal(a.view(), b.view());
+}
+
+// 0 stands for a hash not computed yet
+inline std::uint64_t cacheable(std::uint64_t h) { return h != 0 ? h : 1; }
+}  // namespace detail
+
 class String {
-  std::string value_;
+  SharedArray<char> chars_;
 
  public:
-  String(std::string_view sv) : value_{sv} {}
-  bool operator==(String const&) const = default;
+  String(std::string_view sv)
+      : chars_{SharedArray<char>::copy_of({sv.data(), sv.size()})} {}
+  bool operator==(String const& other) const {
+    return detail::same_contents(chars_, other.chars_);
+  }
 
-  std::string const& value() const { return value_; }
+  std::string_view value() const {
+    auto const chars = chars_.view();
+    return {chars.data(), chars.size()};
+  }
+
+  std::uint64_t hash() const {
+    if (auto const h = chars_.cached_hash()) return h;
+    auto const h = detail::cacheable(std::hash<std::string_view>{}(value()));
+    chars_.cache_hash(h);
+    return h;
+  }
+  std::uint32_t tag() const { return chars_.tag(); }
+  void set_tag(std::uint32_t tag) const { chars_.set_tag(tag); }
+  std::size_t allocated_bytes() const { return chars_.allocated_bytes(); }
 
   friend std::ostream& operator<<(std::ostream& out, String const& s) {
     return out << '"' << s.value() << '"';
@@ -66,33 +186,103 @@ class String {
 
 template <typename T>
 class List {
-  std::vector<T> terms_;
+  SharedArray<T> terms_;
 
  public:
-  List() : terms_{} {}
-  List(std::initializer_list<T> ts) : terms_{ts} {}
+  List() = default;
+  List(std::initializer_list<T> ts)
+      : terms_{SharedArray<T>::copy_of({ts.begin(), ts.size()})} {}
 
+  // copies the elements first if the list is shared
   List& append(T&& t) {
-    terms_.push_back(std::forward<T>(t));
+    terms_.emplace_back(std::forward<T>(t));
 
     return *this;
   }
 
-  bool operator==(List const&) const = default;
+  bool operator==(List const& other) const {
+    return detail::same_contents(terms_, other.terms_);
+  }
+
+  std::uint64_t hash() const {
+    if (auto const h = terms_.cached_hash()) return h;
+    std::uint64_t h = size();
+    for (T const& t : terms_.view()) h = hash_combine(h, t.hash());
+    terms_.cache_hash(detail::cacheable(h));
+    return detail::cacheable(h);
+  }
+  std::uint32_t tag() const { return terms_.tag(); }
+  void set_tag(std::uint32_t tag) const { terms_.set_tag(tag); }
+  std::size_t allocated_bytes() const { return terms_.allocated_bytes(); }
 
-  T const& at(int i) const { return terms_.at(i); }
+  T const& at(int i) const { return terms_.view()[i]; }
 
   int size() const { return terms_.size(); }
 
-  bool empty() const { return terms_.empty(); }
+  bool empty() const { return terms_.size() == 0; }
 
   std::span<T const> tail() const {
-    if (terms_.begin() == terms_.end()) return {};
-    return {terms_.begin() + 1, terms_.end()};
+    if (empty()) return {};
+    return terms_.view().subspan(1);
+  }
+
+  auto begin() const { return terms_.view().begin(); }
+  auto end() const { return terms_.view().end(); }
+};
+
+// A vector of fixnums, packed in one array for the kernels of
+// guci/utils/simd_numeric.hpp. Like a list, it cannot change once built.
+class Vector {
+  SharedArray<std::int64_t> elements_;
+
+  explicit Vector(SharedArray<std::int64_t> elements)
+      : elements_{std::move(elements)} {}
+
+ public:
+  Vector() = default;
+  Vector(std::initializer_list<std::int64_t> xs)
+      : elements_{SharedArray<std::int64_t>::copy_of({xs.begin(), xs.size()})} {
+  }
+
+  // the most elements a vector may have, 2 GiB of them
+  static constexpr std::uint64_t kMaxSize = std::uint64_t{1} << 28;
+
+  // a vector of `n` elements, which `fill` writes given where they go;
+  // throws std::length_error, as std::vector does, if there would be more
+  // than kMaxSize, and std::bad_alloc if they cannot be allocated
+  template <typename Fill>
+  static Vector build(std::uint64_t n, Fill fill) {
+    if (n > kMaxSize) throw std::length_error("vector too large");
+    return Vector{SharedArray<std::int64_t>::build(
+        static_cast<std::uint32_t>(n), std::move(fill))};
+  }
+
+  bool operator==(Vector const& other) const {
+    return detail::same_contents(elements_, other.elements_);
   }
 
-  auto begin() const { return terms_.begin(); }
-  auto end() const { return terms_.end(); }
+  std::uint64_t hash() const {
+    if (auto const h = elements_.cached_hash()) return h;
+    std::uint64_t h = size();
+    for (auto const x : view()) {
+      h = hash_combine(h, static_cast<std::uint64_t>(x));
+    }
+    elements_.cache_hash(detail::cacheable(h));
+    return detail::cacheable(h);
+  }
+  std::size_t allocated_bytes() const { return elements_.allocated_bytes(); }
+
+  std::span<std::int64_t const> view() const { return elements_.view(); }
+  std::uint32_t size() const { return elements_.size(); }
+
+  friend std::ostream& operator<<(std::ostream& out, Vector const& v) {
+    out << "#[";
+    for (std::size_t i = 0; i < v.size(); ++i) {
+      if (i > 0) out << ' ';
+      out << v.view()[i];
+    }
+    return out << ']';
+  }
 };
 
 class Boolean {
@@ -105,15 +295,61 @@ class Boolean {
   bool operator==(Boolean const&) const = default;
 
   bool value() const { return value_; }
+  std::uint64_t hash() const { return value_; }
 
   friend std::ostream& operator<<(std::ostream& out, Boolean const& b) {
     return out << (b.value() ? "#t" : "#f");
   }
 };
 
+// Defined by the evaluator, in guci/eval/eval.hpp.
+struct ClosureData;
+
+// A function value made by `lambda`. A closure is only equal to its copies.
+class Closure {
+  std::shared_ptr<ClosureData const> data_;
+
+ public:
+  explicit Closure(std::shared_ptr<ClosureData const> data)
+      : data_{std::move(data)} {}
+  bool operator==(Closure const&) const = default;
+
+  ClosureData const& data() const { return *data_; }
+  std::uint64_t hash() const {
+    return reinterpret_cast<std::uintptr_t>(data_.get());
+  }
+
+  friend std::ostream& operator<<(std::ostream& out, Closure const&) {
+    return out << "#<lambda>";
+  }
+};
+
+// Defined by the evaluator, in guci/eval/parallel.hpp.
+struct FutureData;
+
+// The value of a term being evaluated by another thread, made by `future`.
+// Like a closure, it is only equal to its copies.
+class Future {
+  std::shared_ptr<FutureData const> data_;
+
+ public:
+  explicit Future(std::shared_ptr<FutureData const> data)
+      : data_{std::move(data)} {}
+  bool operator==(Future const&) const = default;
+
+  FutureData const& data() const { return *data_; }
+  std::uint64_t hash() const {
+    return reinterpret_cast<std::uintptr_t>(data_.get());
+  }
+
+  friend std::ostream& operator<<(std::ostream& out, Future const&) {
+    return out << "#<future>";
+  }
+};
+
 class Term {
-  using ValueType =
-      std::variant<Nil, Boolean, Identifier, Number, String, List<Term>>;
+  using ValueType = std::variant<Nil, Boolean, Identifier, Number, String,
+                                 List<Term>, Closure, Future, Vector>;
   ValueType term_;
 
  public:
@@ -128,6 +364,9 @@ class Term {
   Term(Number v) : term_{std::move(v)} {}
   Term(String v) : term_{std::move(v)} {}
   Term(List<Term> v) : term_{std::move(v)} {}
+  Term(Closure v) : term_{std::move(v)} {}
+  Term(Future v) : term_{std::move(v)} {}
+  Term(Vector v) : term_{std::move(v)} {}
 
   bool operator==(Term const&) const = default;
 
@@ -136,6 +375,12 @@ class Term {
     return lhs.term_ == rhs;
   }
 
+  std::uint64_t hash() const {
+    return hash_combine(
+        term_.index(),
+        std::visit([](auto const& v) { return v.hash(); }, term_));
+  }
+
   auto const& term() const { return term_; }
   auto const& operator*() const { return term_; }
 };
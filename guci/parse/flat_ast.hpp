@@ -0,0 +1,258 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "guci/parse/ast.hpp"
+#include "guci/parse/parse_error.hpp"
+#include "guci/parse/reader.hpp"
+#include "guci/parse/symbol_table.hpp"
+
+namespace guci {
+
+enum class NodeKind : std::uint8_t {
+  Number,
+  Identifier,
+  String,
+  List,
+};
+
+class FlatAst;
+
+// Cheap handle to one node of a FlatAst. Valid as long as the FlatAst is.
+class FlatNode {
+  FlatAst const* ast_;
+  std::uint32_t id_;
+
+ public:
+  FlatNode(FlatAst const* ast, std::uint32_t id) : ast_{ast}, id_{id} {}
+
+  NodeKind kind() const;
+  bool is(NodeKind k) const { return kind() == k; }
+
+  Number const& number() const;
+  Identifier identifier() const;
+  std::string_view string() const;
+
+  // children of a list node
+  std::size_t size() const;
+  bool empty() const { return size() == 0; }
+  FlatNode operator[](std::size_t i) const;
+
+  class iterator {
+    FlatAst const* ast_;
+    std::uint32_t const* child_;
+
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = FlatNode;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = FlatNode;
+
+    iterator() = default;
+    iterator(FlatAst const* ast, std::uint32_t const* child)
+        : ast_{ast}, child_{child} {}
+
+    FlatNode operator*() const { return {ast_, *child_}; }
+    iterator& operator++() {
+      ++child_;
+      return *this;
+    }
+    iterator operator++(int) {
+      auto const old = *this;
+      ++child_;
+      return old;
+    }
+    bool operator==(iterator const& other) const {
+      return child_ == other.child_;
+    }
+  };
+
+  iterator begin() const;
+  iterator end() const;
+
+  Term to_term() const;
+};
+
+// A parsed program stored as a handful of flat arrays instead of a tree of
+// individually allocated Terms. Every node has a kind, a payload and an extent
+// (struct of arrays):
+//   Number      payload indexes numbers_
+//   Identifier  payload is the SymbolId
+//   String      payload/extent are offset/length in the bytes_ arena
+//   List        payload/extent are offset/count in children_
+// Nodes are appended as they are completed, so the children of a list are
+// always complete before the list itself and its entry in children_ is one
+// contiguous range.
+class FlatAst {
+  friend class FlatNode;
+  friend parse_result<FlatAst> read_flat(std::string_view, ReaderOptions);
+
+  std::vector<NodeKind> kinds_;
+  std::vector<std::uint32_t> payloads_;
+  std::vector<std::uint32_t> extents_;
+  std::vector<std::uint32_t> children_;
+  std::vector<Number> numbers_;
+  std::string bytes_;
+  std::vector<std::uint32_t> roots_;
+
+  std::uint32_t add(NodeKind kind, std::uint32_t payload,
+                    std::uint32_t extent) {
+    kinds_.push_back(kind);
+    payloads_.push_back(payload);
+    extents_.push_back(extent);
+    return static_cast<std::uint32_t>(kinds_.size() - 1);
+  }
+
+ public:
+  std::size_t num_nodes() const { return kinds_.size(); }
+
+  // top-level forms, in source order
+  std::size_t size() const { return roots_.size(); }
+  FlatNode operator[](std::size_t i) const { return {this, roots_[i]}; }
+  FlatNode::iterator begin() const { return {this, roots_.data()}; }
+  FlatNode::iterator end() const {
+    return {this, roots_.data() + roots_.size()};
+  }
+};
+
+inline NodeKind FlatNode::kind() const { return ast_->kinds_[id_]; }
+
+inline Number const& FlatNode::number() const {
+  return ast_->numbers_[ast_->payloads_[id_]];
+}
+
+inline Identifier FlatNode::identifier() const {
+  return Identifier::from_id(ast_->payloads_[id_]);
+}
+
+inline std::string_view FlatNode::string() const {
+  return std::string_view{ast_->bytes_}.substr(ast_->payloads_[id_],
+                                               ast_->extents_[id_]);
+}
+
+inline std::size_t FlatNode::size() const {
+  return kind() == NodeKind::List ? ast_->extents_[id_] : 0;
+}
+
+inline FlatNode FlatNode::operator[](std::size_t i) const {
+  return {ast_, ast_->children_[ast_->payloads_[id_] + i]};
+}
+
+inline FlatNode::iterator FlatNode::begin() const {
+  return {ast_, ast_->children_.data() + ast_->payloads_[id_]};
+}
+
+inline FlatNode::iterator FlatNode::end() const {
+  return {ast_, ast_->children_.data() + ast_->payloads_[id_] + size()};
+}
+
+inline Term FlatNode::to_term() const {
+  switch (kind()) {
+    case NodeKind::Number:
+      return number();
+    case NodeKind::Identifier:
+      return identifier();
+    case NodeKind::String:
+      return String{string()};
+    case NodeKind::List: {
+      List<Term> l;
+      for (FlatNode child : *this) l.append(child.to_term());
+      return l;
+    }
+  }
+  return NIL;
+}
+
+// Reads all top-level forms of `in` into a FlatAst. Accepts the same input as
+// read_all() and describes the same terms.
+inline parse_result<FlatAst> read_flat(std::string_view in,
+                                       ReaderOptions options = {}) {
+  FlatAst ast;
+  // a node takes at least one byte of input; most take a few
+  ast.kinds_.reserve(in.size() / 4);
+  ast.payloads_.reserve(in.size() / 4);
+  ast.extents_.reserve(in.size() / 4);
+  ast.children_.reserve(in.size() / 4);
+
+  Lexer lexer{in};
+  // ids of completed nodes whose list is still open, and where each open
+  // list's children start among them
+  std::vector<std::uint32_t> pending;
+  std::vector<std::size_t> open_lists;
+
+  auto complete = [&](std::uint32_t id) {
+    if (open_lists.empty()) {
+      ast.roots_.push_back(id);
+    } else {
+      pending.push_back(id);
+    }
+  };
+
+  while (true) {
+    Token t = OUTCOME_TRYX(lexer.next());
+    switch (t.kind) {
+      case TokenKind::End:
+        if (not open_lists.empty()) {
+          return ParseError{ParseErrc::GenericError,
+                            "list should end with ')'"};
+        }
+        return ast;
+      case TokenKind::OpenParen:
+        if (open_lists.size() >= options.max_depth) {
+          return ParseError{ParseErrc::NestingTooDeep,
+                            "list nesting exceeds the maximum depth"};
+        }
+        open_lists.push_back(pending.size());
+        break;
+      case TokenKind::CloseParen: {
+        if (open_lists.empty()) {
+          return ParseError{ParseErrc::GenericError, "unexpected ')'"};
+        }
+        auto const first = open_lists.back();
+        open_lists.pop_back();
+        auto const offset = static_cast<std::uint32_t>(ast.children_.size());
+        ast.children_.insert(ast.children_.end(), pending.begin() + first,
+                             pending.end());
+        auto const count = static_cast<std::uint32_t>(pending.size() - first);
+        pending.resize(first);
+        complete(ast.add(NodeKind::List, offset, count));
+        break;
+      }
+      case TokenKind::Number:
+        ast.numbers_.push_back(token_number(t));
+        complete(ast.add(NodeKind::Number,
+                         static_cast<std::uint32_t>(ast.numbers_.size() - 1),
+                         0));
+        break;
+      case TokenKind::Identifier:
+        complete(
+            ast.add(NodeKind::Identifier, Identifier{t.text}.id(), 0));
+        break;
+      case TokenKind::String: {
+        auto const offset = static_cast<std::uint32_t>(ast.bytes_.size());
+        if (t.has_escapes) {
+          for (std::size_t pos = 0; pos < t.text.size(); ++pos) {
+            char c = t.text[pos];
+            if (c == '\\') c = Lexer::escaped(t.text[++pos]).value();
+            ast.bytes_.push_back(c);
+          }
+        } else {
+          ast.bytes_.append(t.text);
+        }
+        complete(ast.add(
+            NodeKind::String, offset,
+            static_cast<std::uint32_t>(ast.bytes_.size() - offset)));
+        break;
+      }
+    }
+  }
+}
+
+}  // namespace guci
@@ -0,0 +1,53 @@
+#include "guci/parse/flat_ast.hpp"
+
+#include "catch2/catch.hpp"
+#include "guci/parse/reader.hpp"
+
+namespace guci {
+
+TEST_CASE("flat ast describes the same terms as the reader", "[flat_ast]") {
+  std::string_view const input =
+      "42 foo \"s\\n\" () (+ 1 (* 2 -3) \"x\") ((a (b)) c) (let x \"(\")";
+
+  FlatAst const ast = read_flat(input).value();
+  auto const terms = read_all(input).value();
+
+  REQUIRE(ast.size() == terms.size());
+  for (std::size_t i = 0; i < ast.size(); ++i) {
+    REQUIRE(ast[i].to_term() == terms[i]);
+  }
+}
+
+TEST_CASE("flat node views", "[flat_ast]") {
+  FlatAst const ast = read_flat("(+ 1 (* 2 x) \"str\")").value();
+  REQUIRE(ast.size() == 1);
+  REQUIRE(ast.num_nodes() == 8);
+
+  FlatNode const root = ast[0];
+  REQUIRE(root.is(NodeKind::List));
+  REQUIRE(root.size() == 4);
+  REQUIRE(root[0].identifier() == Identifier("+"));
+  REQUIRE(root[1].number() == 1);
+  REQUIRE(root[3].string() == "str");
+
+  FlatNode const inner = root[2];
+  REQUIRE(inner.size() == 3);
+  REQUIRE(inner[2].identifier() == Identifier("x"));
+
+  std::int64_t sum = 0;
+  for (FlatNode child : inner) {
+    if (child.is(NodeKind::Number)) sum += child.number().fixnum();
+  }
+  REQUIRE(sum == 2);
+}
+
+TEST_CASE("flat ast errors", "[flat_ast]") {
+  REQUIRE(not read_flat("(1 2"));
+  REQUIRE(not read_flat("1)"));
+  REQUIRE(not read_flat("\"abc"));
+  REQUIRE(read_flat("((()))", ReaderOptions{2}).error().ec ==
+          ParseErrc::NestingTooDeep);
+  REQUIRE(read_flat("  ").value().size() == 0);
+}
+
+}  // namespace guci
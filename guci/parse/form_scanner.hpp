@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+namespace guci {
+
+// Finds where top-level forms end without parsing them. The scanner keeps its
+// state between calls, so a form split across several chunks of input is
+// scanned exactly once, chunk by chunk.
+class FormScanner {
+  int depth_ = 0;
+  bool in_string_ = false;
+  bool escape_ = false;
+  bool in_atom_ = false;
+
+  static bool ends_atom(char c) {
+    switch (c) {
+      case ' ':
+      case '\t':
+      case '\n':
+      case '(':
+      case ')':
+      case '"':
+        return true;
+      default:
+        return false;
+    }
+  }
+
+ public:
+  static constexpr auto npos = std::string_view::npos;
+
+  // Returns the number of bytes of `in` up to the end of the first complete
+  // form, or npos if `in` ends inside a form. In the latter case the next
+  // call should be given only the bytes that follow `in`.
+  std::size_t scan(std::string_view in) {
+    for (std::size_t i = 0; i < in.size(); ++i) {
+      char const c = in[i];
+
+      if (in_string_) {
+        if (escape_) {
+          escape_ = false;
+        } else if (c == '\\') {
+          escape_ = true;
+        } else if (c == '"') {
+          in_string_ = false;
+          if (depth_ == 0) return i + 1;
+        }
+        continue;
+      }
+
+      if (in_atom_) {
+        if (not ends_atom(c)) continue;
+        in_atom_ = false;
+        return i;
+      }
+
+      switch (c) {
+        case ' ':
+        case '\t':
+        case '\n':
+          break;
+        case '"':
+          in_string_ = true;
+          break;
+        case '(':
+          ++depth_;
+          break;
+        case ')':
+          // a stray ')' is handed on as a form of its own so that the reader
+          // can report it
+          if (depth_ == 0 or --depth_ == 0) return i + 1;
+          break;
+        default:
+          if (depth_ == 0) in_atom_ = true;
+          break;
+      }
+    }
+
+    return npos;
+  }
+
+  void reset() { *this = FormScanner{}; }
+};
+
+}  // namespace guci
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <unordered_set>
+#include <utility>
+#include <variant>
+
+#include "guci/parse/ast.hpp"
+
+namespace guci {
+
+// Keeps one copy of each string and list interned in it, so that terms built
+// from the same text share their structure and interned terms compare by
+// address. A table tags what it interns with an id no other table ever had;
+// clear() forgets every entry and takes a new id. Entries stay alive until
+// then. Safe to use from several threads.
+class HashConsTable {
+ public:
+  struct Stats {
+    // strings and non-empty lists looked up, and how many of them an entry
+    // was found for
+    std::uint64_t lookups = 0;
+    std::uint64_t hits = 0;
+    std::uint64_t entries = 0;
+    // of the contents of the entries, and of the duplicates found instead
+    std::uint64_t stored_bytes = 0;
+    std::uint64_t saved_bytes = 0;
+
+    double dedup_ratio() const {
+      return lookups == 0 ? 0.0 : static_cast<double>(hits) / lookups;
+    }
+  };
+
+ private:
+  struct Hash {
+    std::size_t operator()(Term const& t) const { return t.hash(); }
+  };
+
+  inline static std::atomic<std::uint32_t> next_id_{1};
+
+  mutable std::mutex mutex_;
+  std::unordered_set<Term, Hash> entries_;
+  std::atomic<std::uint32_t> id_{
+      next_id_.fetch_add(1, std::memory_order_relaxed)};
+  Stats stats_;
+
+  // `t` is a string or list whose elements are interned
+  template <typename T>
+  Term lookup(T const& t) {
+    // hashed before taking the lock
+    Term term{t};
+    term.hash();
+    std::lock_guard const lock{mutex_};
+    ++stats_.lookups;
+    auto const [it, inserted] = entries_.insert(std::move(term));
+    auto const& entry = std::get<T>(**it);
+    if (inserted) {
+      entry.set_tag(id_.load(std::memory_order_relaxed));
+      ++stats_.entries;
+      stats_.stored_bytes += entry.allocated_bytes();
+    } else {
+      ++stats_.hits;
+      stats_.saved_bytes += t.allocated_bytes();
+    }
+    return *it;
+  }
+
+ public:
+  HashConsTable() = default;
+  HashConsTable(HashConsTable const&) = delete;
+  HashConsTable& operator=(HashConsTable const&) = delete;
+
+  bool contains(Term const& t) const {
+    auto const id = id_.load(std::memory_order_relaxed);
+    if (auto const* s = std::get_if<String>(&*t)) return s->tag() == id;
+    if (auto const* l = std::get_if<List<Term>>(&*t)) {
+      return l->empty() or l->tag() == id;
+    }
+    return true;
+  }
+
+  // The interned copy of `t`, with the elements of lists interned first.
+  // Atoms other than strings and empty lists are returned as they are.
+  Term intern(Term const& t) {
+    if (contains(t)) return t;
+    if (auto const* s = std::get_if<String>(&*t)) return lookup(*s);
+
+    auto const& l = std::get<List<Term>>(*t);
+    bool const elements_interned =
+        std::ranges::all_of(l, [&](Term const& e) { return contains(e); });
+    if (elements_interned) return lookup(l);
+    return list({l.begin(), l.end()});
+  }
+
+  // an interned list of the interned `elements`
+  Term list(std::span<Term const> elements) {
+    if (elements.empty()) return List<Term>{};
+    List<Term> l;
+    for (Term const& e : elements) l.append(intern(e));
+    return lookup(l);
+  }
+
+  void clear() {
+    std::lock_guard const lock{mutex_};
+    entries_.clear();
+    id_.store(next_id_.fetch_add(1, std::memory_order_relaxed),
+              std::memory_order_relaxed);
+    stats_ = {};
+  }
+
+  Stats stats() const {
+    std::lock_guard const lock{mutex_};
+    return stats_;
+  }
+};
+
+}  // namespace guci
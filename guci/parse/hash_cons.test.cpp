@@ -0,0 +1,122 @@
+#include "guci/parse/hash_cons.hpp"
+
+#include <string>
+#include <thread>
+#include <variant>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "guci/parse/reader.hpp"
+
+namespace guci {
+
+namespace {
+List<Term> const& as_list(Term const& t) { return std::get<List<Term>>(*t); }
+
+// whether `a` and `b` share their contents
+bool same(Term const& a, Term const& b) {
+  return &as_list(a).at(0) == &as_list(b).at(0);
+}
+}  // namespace
+
+TEST_CASE("equal terms hash alike", "[hash_cons]") {
+  Term const a = read("(f (g 1 \"x\") 99999999999999999999 ())").value();
+  Term const b = read("(f (g 1 \"x\") 99999999999999999999 ())").value();
+  REQUIRE(a.hash() == b.hash());
+  REQUIRE(a == b);
+  REQUIRE(a.hash() == a.hash());
+
+  Term const c = read("(f (g 1 \"y\") 99999999999999999999 ())").value();
+  REQUIRE(a != c);
+  REQUIRE(a.hash() != c.hash());
+  REQUIRE(Term{Number{1}}.hash() != Term{Identifier::from_id(1)}.hash());
+  REQUIRE(Term{List<Term>{}}.hash() != Term{NIL}.hash());
+
+  // appending in place forgets the cached hash
+  List<Term> l = as_list(read("(1)").value());
+  auto const before = Term{l}.hash();
+  Term const* storage = &l.at(0);
+  l.append(read("2").value());
+  REQUIRE(&l.at(0) == storage);
+  REQUIRE(Term{l}.hash() != before);
+  REQUIRE(Term{l}.hash() == read("(1 2)").value().hash());
+}
+
+TEST_CASE("the reader stores identical subtrees once", "[hash_cons]") {
+  HashConsTable table;
+  ReaderOptions options;
+  options.hash_cons = &table;
+
+  Term const t = read("((+ 1 (* 2 3)) (+ 1 (* 2 3)) \"s\" \"s\")", options)
+                     .value();
+  auto const& l = as_list(t);
+  REQUIRE(same(l.at(0), l.at(1)));
+  REQUIRE(std::get<String>(*l.at(2)).value() == "s");
+
+  Term const again = read(" ((+ 1 (* 2 3)) (+ 1 (* 2 3)) \"s\" \"s\")",
+                          options)
+                         .value();
+  REQUIRE(same(t, again));
+  REQUIRE(table.contains(t));
+
+  auto const stats = table.stats();
+  // (* 2 3), (+ 1 ...), "s" and the whole list
+  REQUIRE(stats.entries == 4);
+  REQUIRE(stats.lookups == 14);
+  REQUIRE(stats.hits == 10);
+  REQUIRE(stats.dedup_ratio() == Catch::Approx(10.0 / 14));
+  REQUIRE(stats.saved_bytes > 0);
+  REQUIRE(stats.stored_bytes > 0);
+
+  // interned terms that differ are told apart without looking inside
+  Term const other = read("((+ 1 (* 2 3)) (+ 1 (* 2 3)) \"s\" \"t\")",
+                          options)
+                         .value();
+  REQUIRE(other != t);
+  REQUIRE(same(as_list(other).at(0), l.at(0)));
+}
+
+TEST_CASE("interning keeps terms equal to what they were", "[hash_cons]") {
+  HashConsTable table;
+  Term const t = read("(a (b (c \"d\")) (b (c \"d\")) () 12)").value();
+  Term const interned = table.intern(t);
+  REQUIRE(interned == t);
+  REQUIRE(table.contains(interned));
+  REQUIRE_FALSE(table.contains(t));
+  REQUIRE(same(as_list(interned).at(1), as_list(interned).at(2)));
+  REQUIRE(same(table.intern(t), interned));
+
+  std::vector<Term> const elements{Identifier{"b"},
+                                   read("(c \"d\")").value()};
+  REQUIRE(same(table.list(elements), as_list(interned).at(1)));
+
+  table.clear();
+  REQUIRE_FALSE(table.contains(interned));
+  REQUIRE(table.stats().entries == 0);
+  Term const fresh = table.intern(t);
+  REQUIRE(fresh == interned);
+  REQUIRE(interned == fresh);
+}
+
+TEST_CASE("threads intern into one table", "[hash_cons]") {
+  HashConsTable table;
+  ReaderOptions options;
+  options.hash_cons = &table;
+
+  std::vector<Term> results(4, NIL);
+  std::vector<std::thread> threads;
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    threads.emplace_back([&, i] {
+      for (int n = 0; n < 100; ++n) {
+        results[i] = read("(x (y 1 2) (y 1 2) \"z\")", options).value();
+      }
+    });
+  }
+  for (auto& t : threads) t.join();
+
+  for (Term const& r : results) REQUIRE(same(r, results[0]));
+  // (y 1 2), "z" and the whole list
+  REQUIRE(table.stats().entries == 3);
+}
+
+}  // namespace guci
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <iterator>
+#include <optional>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "guci/parse/ast.hpp"
+#include "guci/parse/parse_error.hpp"
+#include "guci/parse/reader.hpp"
+#include "guci/utils/char_class.hpp"
+#include "guci/utils/simd_scan.hpp"
+
+namespace guci {
+
+// Cuts `in` into at most `pieces` consecutive slices that each hold whole
+// top-level forms. Returns the slice boundaries, starting with 0 and ending
+// with in.size(). The scan only tracks list depth and string literals
+// (including escaped quotes), so it runs well ahead of a full parse; input
+// that is malformed past some point simply ends up in one slice, where the
+// reader reports the same error it would report reading sequentially.
+inline std::vector<std::size_t> find_split_points(std::string_view in,
+                                                  std::size_t pieces) {
+  std::vector<std::size_t> points{0};
+  auto const target_of = [&](std::size_t i) {
+    return std::max(in.size() / pieces * i, points.back() + 1);
+  };
+
+  std::size_t target = target_of(1);
+  std::size_t pos = 0;
+  int depth = 0;
+  while (points.size() < pieces) {
+    auto const next = simd::find_structural(in, pos);
+    auto const region_end = std::min(next, in.size());
+
+    // [pos, region_end) holds only atoms and whitespace at the top level, so
+    // any whitespace in it, or the structural character ending it, is a
+    // boundary between forms
+    if (depth == 0 and region_end >= target) {
+      auto boundary = std::max(pos, target);
+      while (boundary < region_end and not has_class(in[boundary], kWhitespace))
+        ++boundary;
+      if (boundary == in.size()) break;
+
+      points.push_back(boundary);
+      target = target_of(points.size());
+      if (boundary < region_end) continue;
+    }
+
+    if (next == std::string_view::npos) break;
+    switch (in[next]) {
+      case '(':
+        ++depth;
+        pos = next + 1;
+        break;
+      case ')':
+        if (depth > 0) --depth;
+        pos = next + 1;
+        break;
+      default:
+        pos = simd::find_string_end(in, next + 1);
+        if (pos == std::string_view::npos) pos = in.size();
+        if (pos < in.size()) ++pos;
+        break;
+    }
+    if (pos >= in.size()) break;
+  }
+
+  points.push_back(in.size());
+  return points;
+}
+
+// Reads all top-level terms of `in` on up to `threads` threads. The result,
+// including which error is reported for malformed input, is the same as that
+// of read_all().
+inline parse_result<std::vector<Term>> parallel_read(
+    std::string_view in, std::size_t threads, ReaderOptions options = {}) {
+  if (threads <= 1) return read_all(in, options);
+
+  // several slices per thread even out forms of uneven size
+  auto const points = find_split_points(in, threads * 8);
+  auto const num_slices = points.size() - 1;
+
+  std::vector<std::vector<Term>> slices(num_slices);
+  std::vector<std::optional<ParseError>> errors(num_slices);
+  std::atomic<std::size_t> next_slice{0};
+
+  auto worker = [&] {
+    for (auto i = next_slice++; i < num_slices; i = next_slice++) {
+      Reader reader{in.substr(points[i], points[i + 1] - points[i]), options};
+      while (not reader.at_end()) {
+        auto t = reader.read_term();
+        if (not t) {
+          errors[i] = std::move(t).error();
+          break;
+        }
+        slices[i].push_back(std::move(t).value());
+      }
+    }
+  };
+
+  {
+    std::vector<std::jthread> pool;
+    for (std::size_t i = 1; i < std::min(threads, num_slices); ++i) {
+      pool.emplace_back(worker);
+    }
+    worker();
+  }
+
+  std::size_t total = 0;
+  for (std::size_t i = 0; i < num_slices; ++i) {
+    if (errors[i]) return std::move(*errors[i]);
+    total += slices[i].size();
+  }
+
+  std::vector<Term> forms;
+  forms.reserve(total);
+  for (auto& slice : slices) {
+    std::move(slice.begin(), slice.end(), std::back_inserter(forms));
+  }
+  return forms;
+}
+
+}  // namespace guci
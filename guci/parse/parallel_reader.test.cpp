@@ -0,0 +1,79 @@
+#include "guci/parse/parallel_reader.hpp"
+
+#include <random>
+#include <string>
+
+#include "catch2/catch.hpp"
+
+namespace guci {
+
+namespace {
+std::string generate_forms(std::size_t count) {
+  std::mt19937 gen{7};
+  std::string out;
+  for (std::size_t i = 0; i < count; ++i) {
+    switch (gen() % 5) {
+      case 0:
+        out += "(+ " + std::to_string(i) + " (* x 2) (- 7 y))\n";
+        break;
+      case 1:
+        out += "(let s" + std::to_string(i) + " \"a ( \\\" ) b\")";
+        break;
+      case 2:
+        out += " atom" + std::to_string(i) + " -" + std::to_string(i);
+        break;
+      case 3:
+        out += "\"top ) level\"(f(g(h 1)))";
+        break;
+      default:
+        out += "\n\t(((nested) (lists)) \"\\\\\")  ";
+        break;
+    }
+  }
+  return out;
+}
+}  // namespace
+
+TEST_CASE("split points fall between forms", "[parallel_reader]") {
+  std::string const input = generate_forms(500);
+  auto const expected = read_all(input).value();
+
+  auto pieces = GENERATE(1u, 2u, 7u, 64u, 5000u);
+  auto const points = find_split_points(input, pieces);
+  REQUIRE(points.front() == 0);
+  REQUIRE(points.back() == input.size());
+  REQUIRE(points.size() <= pieces + 1);
+
+  std::vector<Term> pieced;
+  for (std::size_t i = 0; i + 1 < points.size(); ++i) {
+    REQUIRE(points[i] < points[i + 1]);
+    auto part = read_all(std::string_view{input}.substr(
+                             points[i], points[i + 1] - points[i]))
+                    .value();
+    pieced.insert(pieced.end(), part.begin(), part.end());
+  }
+  REQUIRE(pieced == expected);
+}
+
+TEST_CASE("parallel read matches sequential read", "[parallel_reader]") {
+  std::string const input = generate_forms(2000);
+  auto const expected = read_all(input).value();
+
+  auto threads = GENERATE(1u, 2u, 3u, 8u);
+  REQUIRE(parallel_read(input, threads).value() == expected);
+}
+
+TEST_CASE("parallel read reports the first error", "[parallel_reader]") {
+  std::string input = generate_forms(300);
+  input += " ) ";
+  input += generate_forms(300);
+  input += " (unterminated \"string)";
+
+  auto const expected = read_all(input);
+  auto const actual = parallel_read(input, 4);
+  REQUIRE(not expected);
+  REQUIRE(not actual);
+  REQUIRE(actual.error().msg == expected.error().msg);
+}
+
+}  // namespace guci
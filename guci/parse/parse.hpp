@@ -1,11 +1,14 @@
 #pragma once
 
 #include <algorithm>
+#include <cstdint>
 #include <functional>
 #include <string_view>
 
 #include "guci/parse/ast.hpp"
 #include "guci/parse/parse_error.hpp"
+#include "guci/utils/char_class.hpp"
+#include "guci/utils/simd_scan.hpp"
 #include "guci/utils/string_manipulation.hpp"
 
 namespace guci {
@@ -21,15 +24,15 @@ using MaybeParse = ::guci::parse_result<PartialParse>;
 using Parser = std::function<MaybeParse(std::string_view)>;
 using JoinOp = std::function<Term(Term, Term)>;
 
-inline bool is_whitespace(char c) { return is_one_of(c, " \n\t"); }
+inline bool is_whitespace(char c) { return has_class(c, kWhitespace); }
 
 inline bool is_alpha(char c) {
   return (c >= 'a' and c <= 'z') or (c >= 'A' and c <= 'Z');
 }
 
-inline bool is_special_char(char c) { return is_one_of(c, ":()\"'$[]"); }
+inline bool is_special_char(char c) { return has_class(c, kSpecial); }
 
-inline bool is_decimal(char c) { return c >= '0' and c <= '9'; }
+inline bool is_decimal(char c) { return has_class(c, kDigit); }
 
 class skip_one_of {
   std::string_view chars_;
@@ -98,19 +101,25 @@ inline MaybeParse parse_number(std::string_view untrimed) {
 
   auto [res, in] = skip_whitespace(untrimed).value();
 
-  int sign = in[0] == '-' ? -1 : 1;
-  std::string_view::size_type idx = in[0] == '-' ? 1 : 0;
+  bool const negative = in[0] == '-';
+  std::string_view::size_type idx = negative ? 1 : 0;
 
   if (not is_one_of(in[idx], decimal_digits))
     return ParseError{ParseErrc::GenericError, "not a number"};
 
-  int acc = 0;
+  // accumulate towards the sign so that INT64_MIN does not overflow
+  std::int64_t acc = 0;
+  bool overflows = false;
   while (is_one_of(in[idx], decimal_digits)) {
-    acc = 10 * acc + (in[idx] - '0');
+    int const digit = negative ? '0' - in[idx] : in[idx] - '0';
+    overflows = overflows or __builtin_mul_overflow(acc, 10, &acc) or
+                __builtin_add_overflow(acc, digit, &acc);
     idx++;
   }
 
-  return outcome::success(PartialParse{Number{sign * acc}, in.substr(idx)});
+  Number n = overflows ? Number{BigInt::from_decimal(in.substr(0, idx))}
+                       : Number{acc};
+  return outcome::success(PartialParse{std::move(n), in.substr(idx)});
 }
 
 inline parse_result<char> escaped(char c) {
@@ -145,30 +154,21 @@ inline MaybeParse parse_string(std::string_view untrimmed) {
     return ParseError{"invalid string"};
   }
 
-  std::size_t length = 0;
-
-  std::size_t pos = 1;
-  while (true) {
-    if (pos >= in.size()) return ParseError{"unterminated string literal"};
-    if (in[pos] == '"') break;
-    if (in[pos] == '\\') ++pos;
-    ++length;
-    ++pos;
-  }
-
   std::string result;
-  result.reserve(length);
 
-  pos = 1;
+  std::size_t pos = 1;
   while (true) {
-    if (in[pos] == '"') break;
-    if (in[pos] == '\\') {
-      result.push_back(OUTCOME_TRYX(escaped(in[++pos])));
-    } else {
-      result.push_back(in[pos]);
+    auto const stop = simd::find_either(in, pos, '"', '\\');
+    if (stop == std::string_view::npos) {
+      return ParseError{"unterminated string literal"};
     }
+    result.append(in.substr(pos, stop - pos));
+    pos = stop;
+    if (in[pos] == '"') break;
 
-    pos++;
+    if (pos + 1 >= in.size()) return ParseError{"unterminated string literal"};
+    result.push_back(OUTCOME_TRYX(escaped(in[pos + 1])));
+    pos += 2;
   }
 
   return outcome::success(PartialParse{String{result}, in.substr(pos + 1)});
@@ -176,10 +176,8 @@ inline MaybeParse parse_string(std::string_view untrimmed) {
 
 inline MaybeParse parse_identifier(std::string_view untrimmed) {
   auto [res, in] = skip_whitespace(untrimmed).value();
-  auto valid_begin = [](char c) {
-    return is_alpha(c) or is_one_of(c, "_+-*/%^@?!");
-  };
-  auto valid_rest = [&](char c) { return valid_begin(c) or is_decimal(c); };
+  auto valid_begin = [](char c) { return has_class(c, kIdentifierBegin); };
+  auto valid_rest = [](char c) { return has_class(c, kIdentifierRest); };
 
   if (not valid_begin(in[0])) {
     return ParseError{ParseErrc::GenericError, "invalid identifier"};
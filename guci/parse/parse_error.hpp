@@ -7,6 +7,7 @@ namespace guci {
 enum class ParseErrc {
   Success = 0,
   GenericError = 1,
+  NestingTooDeep = 2,
 };
 }  // namespace guci
 
@@ -33,6 +34,8 @@ class ParseErrc_category : public std::error_category {
         return "parse successful";
       case ParseErrc::GenericError:
         return "converting empty string";
+      case ParseErrc::NestingTooDeep:
+        return "nesting too deep";
       default:
         return "unknown";
     }
@@ -43,6 +46,8 @@ class ParseErrc_category : public std::error_category {
     switch (static_cast<ParseErrc>(c)) {
       case ParseErrc::GenericError:
         return make_error_condition(std::errc::invalid_argument);
+      case ParseErrc::NestingTooDeep:
+        return make_error_condition(std::errc::result_out_of_range);
       default:
         // I have no mapping for this code
         return std::error_condition(c, *this);
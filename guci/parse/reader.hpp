@@ -0,0 +1,298 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "guci/parse/ast.hpp"
+#include "guci/parse/hash_cons.hpp"
+#include "guci/parse/parse_error.hpp"
+#include "guci/utils/char_class.hpp"
+#include "guci/utils/simd_scan.hpp"
+
+namespace guci {
+
+enum class TokenKind {
+  OpenParen,
+  CloseParen,
+  Number,
+  Identifier,
+  String,
+  End,
+};
+
+class Token {
+ public:
+  TokenKind kind;
+  // source text of the token; for strings the surrounding quotes are dropped
+  std::string_view text;
+  std::int64_t number = 0;
+  bool has_escapes = false;
+  // the literal does not fit in 64 bits; its value is only in `text`
+  bool number_overflows = false;
+};
+
+inline Number token_number(Token const& t) {
+  if (t.number_overflows) return BigInt::from_decimal(t.text);
+  return t.number;
+}
+
+// Splits the input into tokens, dispatching on the first character of each.
+// Every input byte is looked at once and tokens only refer to the input.
+class Lexer {
+  std::string_view in_;
+  std::size_t pos_;
+
+ public:
+  Lexer(std::string_view in) : in_{in}, pos_{0} {}
+
+  static parse_result<char> escaped(char c) {
+    switch (c) {
+      case '\\':
+      case '\'':
+      case '\"':
+        return c;
+      case 'n':
+        return '\n';
+      case 'a':
+        return '\a';
+      case 't':
+        return '\t';
+      case 'r':
+        return '\r';
+      case 'b':
+        return '\b';
+      case 'v':
+        return '\v';
+      case '0':
+        return '\0';
+      default:
+        return ParseError{"invalid escape sequence"};
+    }
+  }
+
+  std::string_view rest() const { return in_.substr(pos_); }
+
+  void skip_whitespace() { pos_ = simd::skip_whitespace(in_, pos_); }
+
+  bool at_end() {
+    skip_whitespace();
+    return pos_ == in_.size();
+  }
+
+  parse_result<Token> next() {
+    skip_whitespace();
+    if (pos_ == in_.size()) return Token{TokenKind::End, {}};
+
+    char const c = in_[pos_];
+    switch (c) {
+      case '(':
+        return Token{TokenKind::OpenParen, in_.substr(pos_++, 1)};
+      case ')':
+        return Token{TokenKind::CloseParen, in_.substr(pos_++, 1)};
+      case '"':
+        return lex_string();
+      case '-':
+        if (pos_ + 1 < in_.size() and has_class(in_[pos_ + 1], kDigit))
+          return lex_number();
+        return lex_identifier();
+      default:
+        if (has_class(c, kDigit)) return lex_number();
+        if (has_class(c, kIdentifierBegin)) return lex_identifier();
+        return ParseError{ParseErrc::GenericError, "unexpected character"};
+    }
+  }
+
+ private:
+  Token lex_number() {
+    std::size_t const begin = pos_;
+    bool const negative = in_[pos_] == '-';
+    if (negative) ++pos_;
+
+    // accumulate the magnitude unsigned so that INT64_MIN is representable
+    std::uint64_t const limit =
+        std::uint64_t{std::numeric_limits<std::int64_t>::max()} + negative;
+    std::uint64_t acc = 0;
+    bool overflows = false;
+    while (pos_ < in_.size() and has_class(in_[pos_], kDigit)) {
+      overflows = overflows or __builtin_mul_overflow(acc, 10, &acc) or
+                  __builtin_add_overflow(acc, in_[pos_] - '0', &acc) or
+                  acc > limit;
+      ++pos_;
+    }
+
+    Token t{TokenKind::Number, in_.substr(begin, pos_ - begin)};
+    t.number = static_cast<std::int64_t>(negative ? 0 - acc : acc);
+    t.number_overflows = overflows;
+    return t;
+  }
+
+  Token lex_identifier() {
+    std::size_t const begin = pos_;
+    pos_ = simd::skip_identifier_rest(in_, pos_ + 1);
+
+    return Token{TokenKind::Identifier, in_.substr(begin, pos_ - begin)};
+  }
+
+  parse_result<Token> lex_string() {
+    std::size_t const begin = pos_ + 1;
+    std::size_t end = begin;
+    bool has_escapes = false;
+    while (true) {
+      end = simd::find_either(in_, end, '"', '\\');
+      if (end == std::string_view::npos) {
+        return ParseError{"unterminated string literal"};
+      }
+      if (in_[end] == '"') break;
+
+      has_escapes = true;
+      end += 2;
+      if (end <= in_.size() and not escaped(in_[end - 1]))
+        return ParseError{"invalid escape sequence"};
+    }
+
+    Token t{TokenKind::String, in_.substr(begin, end - begin)};
+    t.has_escapes = has_escapes;
+    pos_ = end + 1;
+    return t;
+  }
+};
+
+class ReaderOptions {
+ public:
+  static constexpr std::size_t kDefaultMaxDepth = 10000;
+
+  // deepest list nesting accepted before reading fails with NestingTooDeep
+  std::size_t max_depth = kDefaultMaxDepth;
+  // if set, strings and lists are interned there as soon as they are read
+  HashConsTable* hash_cons = nullptr;
+};
+
+// Reader over the Lexer's token stream. Produces the same Term trees as
+// parse() while allocating only for the resulting AST. Open lists are kept on
+// an explicit stack instead of the call stack, so arbitrarily deep input costs
+// heap memory linear in its depth and is cut off at options.max_depth.
+class Reader {
+  Lexer lexer_;
+  ReaderOptions options_;
+  std::vector<List<Term>> open_lists_;
+
+ public:
+  Reader(std::string_view in, ReaderOptions options = {})
+      : lexer_{in}, options_{options} {}
+
+  bool at_end() { return lexer_.at_end(); }
+  std::string_view rest() const { return lexer_.rest(); }
+
+  parse_result<Term> read_term() {
+    Token t = OUTCOME_TRYX(lexer_.next());
+    if (t.kind != TokenKind::OpenParen) {
+      return shared(OUTCOME_TRYX(read_atom(t)));
+    }
+
+    open_lists_.clear();
+    open_lists_.emplace_back();
+    while (true) {
+      t = OUTCOME_TRYX(lexer_.next());
+      switch (t.kind) {
+        case TokenKind::OpenParen:
+          if (open_lists_.size() >= options_.max_depth) {
+            return ParseError{ParseErrc::NestingTooDeep,
+                              "list nesting exceeds the maximum depth"};
+          }
+          open_lists_.emplace_back();
+          break;
+        case TokenKind::CloseParen: {
+          Term list = shared(std::move(open_lists_.back()));
+          open_lists_.pop_back();
+          if (open_lists_.empty()) return list;
+          open_lists_.back().append(std::move(list));
+          break;
+        }
+        case TokenKind::End:
+          return ParseError{ParseErrc::GenericError,
+                            "list should end with ')'"};
+        default:
+          open_lists_.back().append(shared(OUTCOME_TRYX(read_atom(t))));
+          break;
+      }
+    }
+  }
+
+ private:
+  // the elements of lists are interned before the lists
+  Term shared(Term t) const {
+    if (options_.hash_cons == nullptr) return t;
+    return options_.hash_cons->intern(t);
+  }
+
+  static parse_result<Term> read_atom(Token const& t) {
+    switch (t.kind) {
+      case TokenKind::Number:
+        return Term{token_number(t)};
+      case TokenKind::Identifier:
+        return Term{Identifier{t.text}};
+      case TokenKind::String:
+        return make_string(t);
+      case TokenKind::CloseParen:
+        return ParseError{ParseErrc::GenericError, "unexpected ')'"};
+      case TokenKind::OpenParen:
+      case TokenKind::End:
+        break;
+    }
+    return ParseError{ParseErrc::GenericError, "unexpected end of input"};
+  }
+
+  static Term make_string(Token const& t) {
+    if (not t.has_escapes) return String{t.text};
+
+    std::string result;
+    result.reserve(t.text.size());
+    for (std::size_t pos = 0; pos < t.text.size(); ++pos) {
+      if (t.text[pos] == '\\') {
+        result.push_back(Lexer::escaped(t.text[++pos]).value());
+      } else {
+        result.push_back(t.text[pos]);
+      }
+    }
+    return String{result};
+  }
+};
+
+// Reads exactly one term; only whitespace may follow it.
+inline parse_result<Term> read(std::string_view in,
+                               ReaderOptions options = {}) {
+  Reader reader{in, options};
+  Term t = OUTCOME_TRYX(reader.read_term());
+  if (not reader.at_end()) {
+    return ParseError(ParseErrc::GenericError, "incomplete parse");
+  }
+
+  return t;
+}
+
+// Reads all top-level terms, in source order.
+inline parse_result<std::vector<Term>> read_all(std::string_view in,
+                                                ReaderOptions options = {}) {
+  Reader reader{in, options};
+  std::vector<Term> forms;
+  while (not reader.at_end()) {
+    forms.push_back(OUTCOME_TRYX(reader.read_term()));
+  }
+
+  return forms;
+}
+
+// Drops the "#!" interpreter line that executable scripts begin with.
+inline std::string_view skip_shebang(std::string_view in) {
+  if (not in.starts_with("#!")) return in;
+
+  auto const eol = in.find('\n');
+  if (eol == std::string_view::npos) return {};
+  return in.substr(eol + 1);
+}
+
+}  // namespace guci
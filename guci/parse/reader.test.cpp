@@ -0,0 +1,157 @@
+#include "guci/parse/reader.hpp"
+
+#include <cstdint>
+#include <limits>
+
+#include "catch2/catch.hpp"
+#include "guci/parse/parse.hpp"
+
+namespace guci {
+
+TEST_CASE("lexer", "[reader]") {
+  Lexer lexer{" (+ -12 \"a\\tb\" x-1)"};
+
+  auto next_kind = [&] { return lexer.next().value().kind; };
+  REQUIRE(next_kind() == TokenKind::OpenParen);
+  REQUIRE(lexer.next().value().text == "+");
+
+  Token number = lexer.next().value();
+  REQUIRE(number.kind == TokenKind::Number);
+  REQUIRE(number.number == -12);
+
+  Token string = lexer.next().value();
+  REQUIRE(string.kind == TokenKind::String);
+  REQUIRE(string.text == "a\\tb");
+  REQUIRE(string.has_escapes);
+
+  REQUIRE(lexer.next().value().text == "x-1");
+  REQUIRE(next_kind() == TokenKind::CloseParen);
+  REQUIRE(next_kind() == TokenKind::End);
+}
+
+TEST_CASE("read atoms", "[reader]") {
+  REQUIRE(read(" 123").value() == Number(123));
+  REQUIRE(read(" -4321   ").value() == Number(-4321));
+  REQUIRE(read(" aa?").value() == Identifier("aa?"));
+  REQUIRE(read("+").value() == Identifier("+"));
+  REQUIRE(read(" \"abc\"  ").value() == String("abc"));
+  REQUIRE(read(" \"abc\\ndef\"").value() == String("abc\ndef"));
+}
+
+TEST_CASE("number literals beyond 64 bits", "[reader]") {
+  auto const int64_min = std::numeric_limits<std::int64_t>::min();
+  REQUIRE(read("9223372036854775807").value() ==
+          Number(std::numeric_limits<std::int64_t>::max()));
+  REQUIRE(read("-9223372036854775808").value() == Number(int64_min));
+
+  Term const big = read("123456789012345678901234567890").value();
+  REQUIRE(big ==
+          Number(BigInt::from_decimal("123456789012345678901234567890")));
+  REQUIRE(read("-9223372036854775809").value() ==
+          Number(BigInt::from_decimal("-9223372036854775809")));
+  REQUIRE(parse_number("123456789012345678901234567890").value().t == big);
+  REQUIRE(parse_number("-9223372036854775808").value().t ==
+          Number(int64_min));
+}
+
+TEST_CASE("fixnums promote to bignums on overflow", "[reader]") {
+  auto const max = std::numeric_limits<std::int64_t>::max();
+  auto const min = std::numeric_limits<std::int64_t>::min();
+
+  Number const sum = Number(max) + Number(1);
+  REQUIRE_FALSE(sum.is_fixnum());
+  REQUIRE(sum.bignum().to_string() == "9223372036854775808");
+  REQUIRE((sum - Number(1)).is_fixnum());
+  REQUIRE(sum - Number(1) == Number(max));
+
+  REQUIRE_FALSE((Number(min) - Number(1)).is_fixnum());
+  REQUIRE((Number(min) * Number(-1)) == sum);
+  REQUIRE((Number(2) * Number(3)) == Number(6));
+
+  Number const square = sum * sum;
+  REQUIRE(square.bignum().to_string() ==
+          "85070591730234615865843651857942052864");
+  REQUIRE(Number(max) < sum);
+  REQUIRE(Number(0) - square < Number(min));
+}
+
+TEST_CASE("read lists", "[reader]") {
+  SECTION("list of numbers") {
+    auto expected_term = List<Term>{Number(1), Number(2), Number(3)};
+    REQUIRE(read("(1 2 3)").value() == expected_term);
+  }
+  SECTION("list with identifier at first pos and a nested list") {
+    auto expected_term = List<Term>{
+        Identifier("+"),
+        List<Term>{Identifier("+"), Number(3), Number(4)},
+        Number(2),
+    };
+    REQUIRE(read("(+ (+ 3 4) 2)").value() == expected_term);
+  }
+  SECTION("empty list") { REQUIRE(read("()").value() == List<Term>{}); }
+  SECTION("whitespace before closing paren") {
+    // parse() rejects this; the reader does not
+    REQUIRE(read("( 1 2\n)").value() == List<Term>{Number(1), Number(2)});
+  }
+}
+
+TEST_CASE("read errors", "[reader]") {
+  REQUIRE(not read("(1 2"));
+  REQUIRE(not read("1 2"));
+  REQUIRE(not read(")"));
+  REQUIRE(not read("\"abc"));
+  REQUIRE(not read("\"a\\qc\""));
+  REQUIRE(not read("(a [b])"));
+}
+
+TEST_CASE("deep nesting", "[reader]") {
+  auto nested = [](std::size_t depth) {
+    return std::string(depth, '(') + "x" + std::string(depth, ')');
+  };
+
+  SECTION("within the limit") {
+    Term t = read(nested(ReaderOptions::kDefaultMaxDepth)).value();
+    std::size_t depth = 0;
+    while (std::holds_alternative<List<Term>>(*t)) {
+      Term inner = std::get<List<Term>>(*t).at(0);
+      t = std::move(inner);
+      ++depth;
+    }
+    REQUIRE(depth == ReaderOptions::kDefaultMaxDepth);
+    REQUIRE(t == Identifier("x"));
+  }
+  SECTION("beyond the limit is an error, not a crash") {
+    auto result = read(nested(1'000'000));
+    REQUIRE(not result);
+    REQUIRE(result.error().ec == ParseErrc::NestingTooDeep);
+  }
+  SECTION("configurable limit") {
+    REQUIRE(read(nested(3), ReaderOptions{3}));
+    REQUIRE(read(nested(4), ReaderOptions{3}).error().ec ==
+            ParseErrc::NestingTooDeep);
+  }
+}
+
+TEST_CASE("read consecutive forms", "[reader]") {
+  Reader reader{skip_shebang("#!/usr/bin/gucilisp\n(let x 1)\n x \"s\"\n")};
+
+  REQUIRE(reader.read_term().value() ==
+          List<Term>{Identifier("let"), Identifier("x"), Number(1)});
+  REQUIRE(reader.read_term().value() == Identifier("x"));
+  REQUIRE(reader.read_term().value() == String("s"));
+  REQUIRE(reader.at_end());
+}
+
+TEST_CASE("reader matches parse", "[reader]") {
+  auto input = GENERATE(as<std::string_view>{}, "42", "-7", "foo", "- 1",
+                        "-x", "+5", "12abc", "(a(b)c)", "(+ 1 (* 2 3) x)",
+                        "(\"s\\\"q\" \"\" (()))", " ( let  x\t\n(1 2)) ",
+                        "(1 2", "(a))", "\"bad\\q\"");
+
+  auto parsed = parse(input);
+  auto read_back = read(input);
+  REQUIRE(parsed.has_value() == read_back.has_value());
+  if (parsed) REQUIRE(parsed.value() == read_back.value());
+}
+
+}  // namespace guci
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+#include "guci/parse/form_scanner.hpp"
+#include "guci/utils/outcome.hpp"
+
+namespace guci {
+
+// Pulls input from a file descriptor in large reads and hands out one complete
+// top-level form at a time. Consumed input is dropped before every read, so
+// the buffer never holds more than the largest form plus one chunk.
+class StreamReader {
+  int fd_;
+  std::size_t chunk_size_;
+  std::string buffer_;
+  std::size_t begin_ = 0;
+  std::size_t scanned_ = 0;
+  bool eof_ = false;
+  FormScanner scanner_;
+
+  outcome::result<void> fill() {
+    buffer_.erase(0, begin_);
+    scanned_ -= begin_;
+    begin_ = 0;
+
+    auto const old_size = buffer_.size();
+    buffer_.resize(old_size + chunk_size_);
+    ssize_t n;
+    do {
+      n = ::read(fd_, buffer_.data() + old_size, chunk_size_);
+    } while (n < 0 and errno == EINTR);
+
+    if (n < 0) {
+      buffer_.resize(old_size);
+      return std::error_code{errno, std::generic_category()};
+    }
+
+    buffer_.resize(old_size + n);
+    eof_ = n == 0;
+    return outcome::success();
+  }
+
+ public:
+  static constexpr std::size_t kDefaultChunkSize = 1 << 16;
+
+  StreamReader(int fd, std::size_t chunk_size = kDefaultChunkSize)
+      : fd_{fd}, chunk_size_{chunk_size} {}
+
+  // The returned view, which may include leading whitespace, stays valid
+  // until the next call. An empty optional signals the end of input.
+  outcome::result<std::optional<std::string_view>> next_form() {
+    while (true) {
+      std::string_view const buffered{buffer_};
+
+      if (scanned_ < buffered.size()) {
+        auto const n = scanner_.scan(buffered.substr(scanned_));
+        if (n != FormScanner::npos) {
+          auto const form = buffered.substr(begin_, scanned_ + n - begin_);
+          begin_ = scanned_ = scanned_ + n;
+          return form;
+        }
+        scanned_ = buffered.size();
+      }
+
+      if (eof_) {
+        auto const form = buffered.substr(begin_);
+        begin_ = scanned_ = buffered.size();
+        scanner_.reset();
+        if (form.find_first_not_of(" \t\n") == std::string_view::npos) {
+          return std::nullopt;
+        }
+        // either a trailing atom or an unterminated form; the reader tells
+        return form;
+      }
+
+      OUTCOME_TRYV(fill());
+    }
+  }
+};
+
+}  // namespace guci
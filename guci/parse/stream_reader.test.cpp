@@ -0,0 +1,76 @@
+#include "guci/parse/stream_reader.hpp"
+
+#include <unistd.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "guci/parse/form_scanner.hpp"
+
+namespace guci {
+
+namespace {
+std::vector<std::string> forms_of(std::string_view input,
+                                  std::size_t chunk_size) {
+  int fds[2];
+  REQUIRE(pipe(fds) == 0);
+  std::thread producer{[&] {
+    for (std::size_t pos = 0; pos < input.size(); pos += chunk_size) {
+      auto const chunk = input.substr(pos, chunk_size);
+      if (write(fds[1], chunk.data(), chunk.size()) < 0) break;
+    }
+    close(fds[1]);
+  }};
+
+  std::vector<std::string> forms;
+  StreamReader reader{fds[0], chunk_size};
+  while (auto form = reader.next_form().value()) {
+    forms.emplace_back(*form);
+  }
+  producer.join();
+  close(fds[0]);
+  return forms;
+}
+}  // namespace
+
+TEST_CASE("form scanner", "[stream_reader]") {
+  SECTION("list") {
+    FormScanner s;
+    REQUIRE(s.scan("  (+ 1 (* 2 3)) (x)") == 15);
+  }
+  SECTION("parens inside strings do not count") {
+    FormScanner s;
+    REQUIRE(s.scan("(f \"(\\\")\") 1") == 10);
+  }
+  SECTION("atom ends at delimiter") {
+    FormScanner s;
+    REQUIRE(s.scan("abc(") == 3);
+    REQUIRE(s.scan("abc") == FormScanner::npos);
+  }
+  SECTION("form split between chunks") {
+    FormScanner s;
+    REQUIRE(s.scan("(+ 1 \"a\\") == FormScanner::npos);
+    REQUIRE(s.scan("\"b\"") == FormScanner::npos);
+    REQUIRE(s.scan(" 2) 3") == 3);
+  }
+}
+
+TEST_CASE("stream reader", "[stream_reader]") {
+  std::string_view const input =
+      "(+ 1 2)\n(let x \"a (b\")\n  foo 42\n(* 3 4)\n";
+  std::vector<std::string> expected = {"(+ 1 2)", "\n(let x \"a (b\")",
+                                       "\n  foo", " 42", "\n(* 3 4)"};
+
+  auto chunk_size = GENERATE(1u, 2u, 5u, 64u);
+  REQUIRE(forms_of(input, chunk_size) == expected);
+}
+
+TEST_CASE("stream reader hands over incomplete trailing form",
+          "[stream_reader]") {
+  REQUIRE(forms_of("(a) (b", 4) == std::vector<std::string>{"(a)", " (b"});
+  REQUIRE(forms_of("  \n", 4).empty());
+}
+
+}  // namespace guci
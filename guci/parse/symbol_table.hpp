@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace guci {
+
+using SymbolId = std::uint32_t;
+
+// Interns identifier names so that the rest of the interpreter can refer to
+// them by a small integer. Names are stored once and never move, so the
+// references handed out by name() stay valid for the lifetime of the table.
+class SymbolTable {
+  mutable std::shared_mutex mutex_;
+  std::deque<std::string> names_;
+  std::unordered_map<std::string_view, SymbolId> ids_;
+
+ public:
+  static SymbolTable& global() {
+    static SymbolTable table;
+    return table;
+  }
+
+  SymbolId intern(std::string_view name) {
+    {
+      std::shared_lock lock{mutex_};
+      auto const it = ids_.find(name);
+      if (it != ids_.end()) return it->second;
+    }
+
+    std::unique_lock lock{mutex_};
+    auto const it = ids_.find(name);
+    if (it != ids_.end()) return it->second;
+
+    auto const id = static_cast<SymbolId>(names_.size());
+    names_.emplace_back(name);
+    ids_.emplace(names_.back(), id);
+    return id;
+  }
+
+  std::string const& name(SymbolId id) const {
+    std::shared_lock lock{mutex_};
+    return names_[id];
+  }
+
+  std::size_t size() const {
+    std::shared_lock lock{mutex_};
+    return names_.size();
+  }
+};
+
+}  // namespace guci
@@ -0,0 +1,54 @@
+#include "guci/parse/symbol_table.hpp"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "catch2/catch.hpp"
+#include "guci/parse/ast.hpp"
+
+namespace guci {
+
+TEST_CASE("intern", "[symbol_table]") {
+  SymbolTable table;
+
+  SymbolId const a = table.intern("a");
+  SymbolId const b = table.intern("b");
+  REQUIRE(a != b);
+  REQUIRE(table.intern(std::string{"a"}) == a);
+  REQUIRE(table.name(a) == "a");
+  REQUIRE(table.name(b) == "b");
+  REQUIRE(table.size() == 2);
+}
+
+TEST_CASE("identifiers compare by symbol", "[symbol_table]") {
+  REQUIRE(Identifier("abc") == Identifier(std::string{"abc"}));
+  REQUIRE(Identifier("abc").id() == Identifier("abc").id());
+  REQUIRE(Identifier("abc") != Identifier("abd"));
+  REQUIRE(Identifier("abc").value() == "abc");
+}
+
+TEST_CASE("concurrent interning", "[symbol_table]") {
+  SymbolTable table;
+  constexpr int kThreads = 4;
+  constexpr int kNames = 1000;
+
+  std::vector<std::vector<SymbolId>> ids(kThreads);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&, t] {
+      for (int i = 0; i < kNames; ++i) {
+        ids[t].push_back(table.intern("sym" + std::to_string(i)));
+      }
+    });
+  }
+  for (auto& thread : threads) thread.join();
+
+  REQUIRE(table.size() == kNames);
+  for (int t = 1; t < kThreads; ++t) REQUIRE(ids[t] == ids[0]);
+  for (int i = 0; i < kNames; ++i) {
+    REQUIRE(table.name(ids[0][i]) == "sym" + std::to_string(i));
+  }
+}
+
+}  // namespace guci
@@ -0,0 +1,381 @@
+#pragma once
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+#include "guci/eval/session.hpp"
+#include "guci/parse/form_scanner.hpp"
+#include "guci/utils/outcome.hpp"
+#include "guci/utils/unix_socket.hpp"
+#include "guci/utils/work_stealing_pool.hpp"
+
+namespace guci {
+
+namespace detail {
+// `result` and a newline, with the newlines in `result` written as \n and
+// its backslashes as \\, so that every answer is a single line
+inline void append_answer(std::string& out, std::string_view result) {
+  for (char const ch : result) {
+    if (ch == '\n') {
+      out += "\\n";
+    } else if (ch == '\\') {
+      out += "\\\\";
+    } else {
+      out += ch;
+    }
+  }
+  out += '\n';
+}
+
+// the result of an answer line, without its newline
+inline std::string read_answer(std::string_view line) {
+  std::string result;
+  result.reserve(line.size());
+  for (std::size_t i = 0; i < line.size(); ++i) {
+    if (line[i] == '\\' and i + 1 < line.size()) {
+      result += line[++i] == 'n' ? '\n' : line[i];
+    } else {
+      result += line[i];
+    }
+  }
+  return result;
+}
+
+// the printed result of the form `input` in `session`, or, if evaluating
+// it throws, its error, so that no form takes the server down
+inline std::string answer(Session& session, std::string_view input) {
+  try {
+    return session.evaluate(input);
+  } catch (std::bad_alloc const&) {
+    return "out of memory";
+  } catch (std::exception const& e) {
+    return e.what();
+  } catch (...) {
+    return "evaluation failed";
+  }
+}
+}  // namespace detail
+
+// How much a connection of a SessionServer may buffer before its session is
+// closed: of a form that is not complete yet, and of answers its client has
+// not read yet.
+struct ConnectionLimits {
+  std::size_t input = std::size_t{16} << 20;
+  std::size_t output = std::size_t{16} << 20;
+};
+
+// Serves a Session of a SharedEnvironment to each client of a UnixSocket.
+// Clients send top-level forms and get a line with the printed result of
+// each back, in order, with detail::append_answer() keeping it on one line;
+// `quit` or the end of their input ends their session. A form that throws,
+// as when memory runs out, gets its error as its answer, and the session
+// goes on.
+//
+// One thread waits for connections, and for input on them, with epoll. A
+// connection with input goes to a WorkStealingPool, which reads what there
+// is, evaluates the forms it completes and answers them before the
+// connection is watched again, so a session is served by one thread at a
+// time. Connections never wait for their clients: answers a client does not
+// read stay with its connection, which is watched for room to write them
+// instead of for input, and evaluates nothing more until they are gone. A
+// session that buffers more than its ConnectionLimits is closed.
+class SessionServer {
+ public:
+  struct Stats {
+    std::uint64_t sessions = 0;
+    std::uint64_t forms = 0;
+  };
+
+ private:
+  class FileDescriptor {
+    int fd_;
+
+   public:
+    explicit FileDescriptor(int fd) : fd_{fd} {}
+    FileDescriptor(FileDescriptor const&) = delete;
+    FileDescriptor& operator=(FileDescriptor const&) = delete;
+    ~FileDescriptor() {
+      if (fd_ >= 0) ::close(fd_);
+    }
+    int get() const { return fd_; }
+  };
+
+  struct Connection {
+    UnixSocket socket;
+    Session session;
+    // input from `begin` on is not evaluated yet, and from `scanned` on not
+    // scanned yet
+    std::string input;
+    std::size_t begin = 0;
+    std::size_t scanned = 0;
+    FormScanner scanner;
+    // the end of input has been read
+    bool ended = false;
+    // the session is over once its answers are written
+    bool over = false;
+    // answers from `sent` on are not written yet
+    std::string output;
+    std::size_t sent = 0;
+
+    Connection(UnixSocket s, SharedEnvironment const& env)
+        : socket{std::move(s)}, session{env} {}
+  };
+
+  static constexpr std::size_t kReadSize = 1 << 16;
+  // evaluation stops for answers to be written once this many are pending
+  static constexpr std::size_t kWriteSize = 1 << 16;
+
+  SharedEnvironment const& env_;
+  ConnectionLimits const limits_;
+  UnixSocket listener_;
+  FileDescriptor epoll_;
+  // written to stop the poller
+  FileDescriptor wake_;
+  std::atomic<bool> stopping_{false};
+  std::mutex mutex_;
+  std::unordered_map<Connection*, std::unique_ptr<Connection>> connections_;
+  std::atomic<std::uint64_t> sessions_{0};
+  std::atomic<std::uint64_t> forms_{0};
+  // last but the poller, so that the turns of the sessions are done before
+  // the rest goes
+  WorkStealingPool pool_;
+  std::jthread poller_;
+
+  SessionServer(SharedEnvironment const& env, UnixSocket listener,
+                std::size_t threads, ConnectionLimits limits)
+      : env_{env},
+        limits_{limits},
+        listener_{std::move(listener)},
+        epoll_{::epoll_create1(EPOLL_CLOEXEC)},
+        wake_{::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)},
+        pool_{threads} {}
+
+  static std::error_code last_error() {
+    return {errno, std::generic_category()};
+  }
+
+  // for `events` once, until watched again, unless `once` is false
+  outcome::result<void> watch(int fd, void* data, int op,
+                              std::uint32_t events = EPOLLIN,
+                              bool once = true) {
+    epoll_event event{};
+    event.events = events;
+    if (once) event.events |= EPOLLONESHOT;
+    event.data.ptr = data;
+    if (::epoll_ctl(epoll_.get(), op, fd, &event) != 0) return last_error();
+    return outcome::success();
+  }
+
+  // the listener is tagged with `this`, wake_ with null
+  void poll() {
+    epoll_event events[64];
+    while (not stopping_) {
+      int const n = ::epoll_wait(epoll_.get(), events, 64, -1);
+      if (n < 0 and errno != EINTR) return;
+      for (int i = 0; i < n; ++i) {
+        void* const data = events[i].data.ptr;
+        if (data == this) {
+          accept_all();
+        } else if (data != nullptr) {
+          auto* c = static_cast<Connection*>(data);
+          pool_.submit([this, c] { serve(*c); });
+        }
+      }
+    }
+  }
+
+  void accept_all() {
+    while (true) {
+      auto socket = listener_.accept();
+      if (not socket) return;
+      auto c = std::make_unique<Connection>(std::move(socket).value(), env_);
+      Connection* const key = c.get();
+      std::lock_guard const lock{mutex_};
+      if (not watch(key->socket.fd(), key, EPOLL_CTL_ADD)) continue;
+      connections_.emplace(key, std::move(c));
+      sessions_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  // evaluates the complete forms of `c.input`, and what is left of it at
+  // the end of input, into `c.output`; stops early, with input left to
+  // scan, once kWriteSize of answers are pending. False once the session is
+  // over.
+  bool evaluate(Connection& c) {
+    std::string_view const input{c.input};
+    while (c.scanned < input.size()) {
+      if (c.output.size() >= kWriteSize) return true;
+      auto const n = c.scanner.scan(input.substr(c.scanned));
+      if (n == FormScanner::npos) {
+        c.scanned = input.size();
+        break;
+      }
+      auto const form = input.substr(c.begin, c.scanned + n - c.begin);
+      c.begin = c.scanned = c.scanned + n;
+      detail::append_answer(c.output, detail::answer(c.session, form));
+      forms_.fetch_add(1, std::memory_order_relaxed);
+      if (c.session.quit_requested()) return false;
+    }
+    if (c.ended) {
+      auto const rest = input.substr(c.begin);
+      if (rest.find_first_not_of(" \t\n") != std::string_view::npos) {
+        detail::append_answer(c.output, detail::answer(c.session, rest));
+        forms_.fetch_add(1, std::memory_order_relaxed);
+      }
+      return false;
+    }
+    c.input.erase(0, c.begin);
+    c.scanned -= c.begin;
+    c.begin = 0;
+    return true;
+  }
+
+  // one read of what there is
+  static void receive(Connection& c) {
+    char chunk[kReadSize];
+    auto const n = c.socket.read(chunk, sizeof chunk, false);
+    if (n) {
+      c.input.append(chunk, n.value());
+      c.ended = n.value() == 0;
+    } else if (n.error() != std::errc::resource_unavailable_try_again) {
+      c.ended = true;
+    }
+  }
+
+  // writes what the client takes of the pending answers; false if it is
+  // gone
+  static bool flush(Connection& c) {
+    while (c.sent < c.output.size()) {
+      auto const n =
+          c.socket.write_some(std::string_view{c.output}.substr(c.sent));
+      if (not n) return n.error() == std::errc::resource_unavailable_try_again;
+      c.sent += n.value();
+    }
+    c.output.clear();
+    c.sent = 0;
+    return true;
+  }
+
+  // Answers what it can of `c` with one read at most, and returns the
+  // events to watch it for next: input, or room for the answers that are
+  // pending. 0 once the session is over.
+  std::uint32_t turn(Connection& c) {
+    bool received = false;
+    while (true) {
+      if (not flush(c)) return 0;
+      if (c.output.size() - c.sent > limits_.output) return 0;
+      if (not c.output.empty()) return EPOLLOUT;
+      if (c.over) return 0;
+      // input left to scan is that of forms evaluation stopped at for their
+      // answers to be written
+      if (c.scanned == c.input.size()) {
+        if (received) return EPOLLIN;
+        receive(c);
+        received = true;
+      }
+      c.over = not evaluate(c);
+      // after the answers of the forms before it
+      if (c.scanned == c.input.size() and
+          c.input.size() - c.begin > limits_.input) {
+        c.over = true;
+      }
+    }
+  }
+
+  // One read per turn; the connection is watched again if there is more.
+  void serve(Connection& c) {
+    std::uint32_t const events = turn(c);
+    // the next turn, which may close `c`, waits for the lock
+    std::lock_guard const lock{mutex_};
+    if (events != 0 and not stopping_ and
+        watch(c.socket.fd(), &c, EPOLL_CTL_MOD, events)) {
+      return;
+    }
+    ::epoll_ctl(epoll_.get(), EPOLL_CTL_DEL, c.socket.fd(), nullptr);
+    connections_.erase(&c);
+  }
+
+ public:
+  // Serves `env` on the socket at `path` with `threads` threads, until the
+  // server is destroyed.
+  static outcome::result<std::unique_ptr<SessionServer>> start(
+      SharedEnvironment const& env, std::string const& path,
+      std::size_t threads, ConnectionLimits limits = {}) {
+    UnixSocket listener = OUTCOME_TRYX(UnixSocket::listen(path));
+    std::unique_ptr<SessionServer> server{
+        new SessionServer(env, std::move(listener), threads, limits)};
+    if (server->epoll_.get() < 0 or server->wake_.get() < 0) {
+      return last_error();
+    }
+    OUTCOME_TRYV(server->watch(server->listener_.fd(), server.get(),
+                               EPOLL_CTL_ADD, EPOLLIN, false));
+    OUTCOME_TRYV(server->watch(server->wake_.get(), nullptr, EPOLL_CTL_ADD));
+    server->poller_ = std::jthread{[s = server.get()] { s->poll(); }};
+    return server;
+  }
+
+  SessionServer(SessionServer const&) = delete;
+  SessionServer& operator=(SessionServer const&) = delete;
+
+  // Finishes the turns of the sessions that are being served, then closes
+  // all of them.
+  ~SessionServer() {
+    stopping_ = true;
+    std::uint64_t const one = 1;
+    (void)!::write(wake_.get(), &one, sizeof one);
+    if (poller_.joinable()) poller_.join();
+  }
+
+  Stats stats() const {
+    return {sessions_.load(std::memory_order_relaxed),
+            forms_.load(std::memory_order_relaxed)};
+  }
+};
+
+// A client of a SessionServer, sending one form at a time.
+class SessionClient {
+  UnixSocket socket_;
+  std::string buffer_;
+
+  explicit SessionClient(UnixSocket socket) : socket_{std::move(socket)} {}
+
+ public:
+  static outcome::result<SessionClient> connect(std::string const& path) {
+    return SessionClient{OUTCOME_TRYX(UnixSocket::connect(path))};
+  }
+
+  // the printed result of `form`, which has to be a single top-level form
+  outcome::result<std::string> call(std::string_view form) {
+    // in one piece, as the session may end with the form
+    OUTCOME_TRYV(socket_.write(std::string{form} + '\n'));
+    std::size_t end;
+    while ((end = buffer_.find('\n')) == std::string::npos) {
+      char chunk[4096];
+      auto const n = OUTCOME_TRYX(socket_.read(chunk, sizeof chunk));
+      if (n == 0) return std::make_error_code(std::errc::connection_reset);
+      buffer_.append(chunk, n);
+    }
+    std::string result =
+        detail::read_answer(std::string_view{buffer_}.substr(0, end));
+    buffer_.erase(0, end + 1);
+    return result;
+  }
+};
+
+}  // namespace guci
@@ -0,0 +1,204 @@
+#include "guci/server/server.hpp"
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "catch2/catch.hpp"
+
+namespace guci {
+
+namespace {
+std::string socket_path() {
+  return std::filesystem::temp_directory_path() /
+         ("guci-server-test-" + std::to_string(::getpid()) + ".sock");
+}
+
+SharedEnvironment const& environment() {
+  static SharedEnvironment* const env = [] {
+    auto* e = new SharedEnvironment;
+    REQUIRE(e->load("(define fib (n) (if (< n 2) n (+ (fib (- n 1)) "
+                    "(fib (- n 2))))) (let base 100)"));
+    return e;
+  }();
+  return *env;
+}
+
+// the address space of the process, in bytes
+std::size_t address_space() {
+  std::size_t pages = 0;
+  std::ifstream{"/proc/self/statm"} >> pages;
+  return pages * static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+}
+}  // namespace
+
+TEST_CASE("clients get a session each", "[server]") {
+  auto const path = socket_path();
+  auto server = SessionServer::start(environment(), path, 2).value();
+  auto a = SessionClient::connect(path).value();
+  auto b = SessionClient::connect(path).value();
+
+  REQUIRE(a.call("(fib 15)").value() == "610");
+  REQUIRE(a.call("(let x 5)").value() == "5");
+  REQUIRE(a.call("(+ x base)").value() == "105");
+  REQUIRE(b.call("x").value() == "x");
+  REQUIRE(b.call("(define g (n) n)").value() ==
+          "functions are read-only here");
+  REQUIRE(b.call("(nothing 1)").value() == "function not found");
+  REQUIRE(b.call("(quit)").value() == "NIL");
+  REQUIRE_FALSE(b.call("1"));
+  REQUIRE(a.call("\"still here\"").value() == "\"still here\"");
+
+  auto const stats = server->stats();
+  REQUIRE(stats.sessions == 2);
+  REQUIRE(stats.forms == 8);
+}
+
+TEST_CASE("forms are answered in order as they complete", "[server]") {
+  auto const path = socket_path();
+  auto server = SessionServer::start(environment(), path, 1).value();
+  auto socket = UnixSocket::connect(path).value();
+
+  // split across writes, several in one, and a trailing atom at the end
+  REQUIRE(socket.write("(+ 1"));
+  REQUIRE(socket.write(" 2) (* 2 3) (fib"));
+  REQUIRE(socket.write(" 10)\n(let y 4) y"));
+  ::shutdown(socket.fd(), SHUT_WR);
+
+  std::string out;
+  char chunk[256];
+  while (auto const n = socket.read(chunk, sizeof chunk).value()) {
+    out.append(chunk, n);
+  }
+  REQUIRE(out == "3\n6\n55\n4\n4\n");
+}
+
+TEST_CASE("answers stay on one line", "[server]") {
+  auto const path = socket_path();
+  auto server = SessionServer::start(environment(), path, 1).value();
+  auto client = SessionClient::connect(path).value();
+  REQUIRE(client.call("\"multi\nline\"").value() == "\"multi\nline\"");
+  REQUIRE(client.call("(+ 1 2)").value() == "3");
+  // read as a backslash and an n, which are not a newline
+  REQUIRE(client.call(R"("not\\n")").value() == R"("not\n")");
+
+  auto socket = UnixSocket::connect(path).value();
+  REQUIRE(socket.write("\"a\nb\" (+ 2 2)"));
+  ::shutdown(socket.fd(), SHUT_WR);
+  std::string out;
+  char chunk[256];
+  while (auto const n = socket.read(chunk, sizeof chunk).value()) {
+    out.append(chunk, n);
+  }
+  REQUIRE(out == "\"a\\nb\"\n4\n");
+}
+
+TEST_CASE("a form that runs out of memory fails alone", "[server]") {
+  auto const path = socket_path();
+  auto server = SessionServer::start(environment(), path, 2).value();
+  auto a = SessionClient::connect(path).value();
+  auto b = SessionClient::connect(path).value();
+  REQUIRE(a.call("(let x 1)").value() == "1");
+
+  rlimit original{};
+  REQUIRE(::getrlimit(RLIMIT_AS, &original) == 0);
+  std::optional<outcome::result<std::string>> failed;
+  {
+    // no room for a 64 MiB vector, for the time of one form
+    rlimit limited = original;
+    limited.rlim_cur = address_space() + (std::size_t{32} << 20);
+    REQUIRE(::setrlimit(RLIMIT_AS, &limited) == 0);
+    struct Restore {
+      rlimit const& limit;
+      ~Restore() { ::setrlimit(RLIMIT_AS, &limit); }
+    } const restore{original};
+    failed = a.call("(range 8000000)");
+  }
+
+  REQUIRE(failed->value() == "out of memory");
+  REQUIRE(a.call("(+ x 1)").value() == "2");
+  REQUIRE(b.call("(fib 10)").value() == "55");
+  REQUIRE(SessionClient::connect(path).value().call("base").value() == "100");
+}
+
+TEST_CASE("many clients are served at once", "[server]") {
+  auto const path = socket_path();
+  auto server = SessionServer::start(environment(), path, 4).value();
+  std::vector<std::vector<std::string>> results(16);
+  {
+    std::vector<std::jthread> clients;
+    for (std::size_t c = 0; c < results.size(); ++c) {
+      clients.emplace_back([&, c] {
+        auto client = SessionClient::connect(path).value();
+        auto const n = std::to_string(c);
+        results[c].push_back(client.call("(let n " + n + ")").value());
+        for (int i = 0; i < 25; ++i) {
+          results[c].push_back(client.call("(+ (fib 10) n)").value());
+        }
+      });
+    }
+  }
+  for (std::size_t c = 0; c < results.size(); ++c) {
+    REQUIRE(results[c].front() == std::to_string(c));
+    for (std::size_t i = 1; i < results[c].size(); ++i) {
+      REQUIRE(results[c][i] == std::to_string(55 + c));
+    }
+  }
+  REQUIRE(server->stats().sessions == results.size());
+}
+
+TEST_CASE("clients that do not read hold up no one else", "[server]") {
+  auto const path = socket_path();
+  auto server = SessionServer::start(environment(), path, 1).value();
+  std::string forms;
+  for (int i = 0; i < 200; ++i) forms += "(range 5000) ";
+
+  // megabytes of answers each, which no one reads
+  std::vector<UnixSocket> stalled;
+  for (int i = 0; i < 2; ++i) {
+    stalled.push_back(UnixSocket::connect(path).value());
+    REQUIRE(stalled.back().write(forms));
+  }
+  auto client = SessionClient::connect(path).value();
+  REQUIRE(client.call("(+ 1 2)").value() == "3");
+  REQUIRE(server->stats().sessions == 3);
+}
+
+TEST_CASE("sessions that buffer too much are closed", "[server]") {
+  auto const path = socket_path();
+  auto server = SessionServer::start(environment(), path, 1,
+                                     {.input = 1 << 10, .output = 1 << 16})
+                    .value();
+  auto const drain = [](UnixSocket const& socket) {
+    std::string out;
+    char chunk[4096];
+    while (auto const n = socket.read(chunk, sizeof chunk)) {
+      if (n.value() == 0) break;
+      out.append(chunk, n.value());
+    }
+    return out;
+  };
+
+  // a form that does not end, after one that does
+  auto unterminated = UnixSocket::connect(path).value();
+  REQUIRE(unterminated.write("(+ 1 2) (list " + std::string(2000, '1')));
+  REQUIRE(drain(unterminated) == "3\n");
+
+  // an answer of more than a megabyte, more than the socket takes at once
+  auto unread = UnixSocket::connect(path).value();
+  REQUIRE(unread.write("(range 200000)"));
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  REQUIRE(drain(unread).size() < std::size_t{1} << 20);
+
+  auto client = SessionClient::connect(path).value();
+  REQUIRE(client.call("(+ 1 2)").value() == "3");
+}
+
+}  // namespace guci
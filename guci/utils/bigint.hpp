@@ -0,0 +1,350 @@
+#pragma once
+
+#include <algorithm>
+#include <compare>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <ostream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace guci {
+
+namespace detail::magnitude {
+// Unsigned arbitrary-precision arithmetic on little-endian 64-bit limbs.
+using Limb = std::uint64_t;
+using Wide = unsigned __int128;
+using Limbs = std::vector<Limb>;
+using View = std::span<Limb const>;
+
+// below this many limbs in the shorter operand, schoolbook multiplication
+// beats Karatsuba
+inline constexpr std::size_t kKaratsubaThreshold = 32;
+
+inline View trimmed(View a) {
+  while (not a.empty() and a.back() == 0) a = a.first(a.size() - 1);
+  return a;
+}
+
+inline void trim(Limbs& a) {
+  while (not a.empty() and a.back() == 0) a.pop_back();
+}
+
+inline int compare(View a, View b) {
+  a = trimmed(a);
+  b = trimmed(b);
+  if (a.size() != b.size()) return a.size() < b.size() ? -1 : 1;
+  for (std::size_t i = a.size(); i-- > 0;) {
+    if (a[i] != b[i]) return a[i] < b[i] ? -1 : 1;
+  }
+  return 0;
+}
+
+// out += a << (64 * shift); out must be large enough to hold the result
+inline void add_into(Limbs& out, View a, std::size_t shift = 0) {
+  Limb carry = 0;
+  std::size_t i = 0;
+  for (; i < a.size(); ++i) {
+    Wide const s = Wide{out[i + shift]} + a[i] + carry;
+    out[i + shift] = static_cast<Limb>(s);
+    carry = static_cast<Limb>(s >> 64);
+  }
+  for (i += shift; carry != 0; ++i) {
+    Wide const s = Wide{out[i]} + carry;
+    out[i] = static_cast<Limb>(s);
+    carry = static_cast<Limb>(s >> 64);
+  }
+}
+
+// out -= a; requires out >= a
+inline void sub_into(Limbs& out, View a) {
+  Limb borrow = 0;
+  std::size_t i = 0;
+  for (; i < a.size(); ++i) {
+    Wide const d = Wide{out[i]} - a[i] - borrow;
+    out[i] = static_cast<Limb>(d);
+    borrow = static_cast<Limb>(d >> 64) & 1;
+  }
+  for (; borrow != 0; ++i) {
+    borrow = out[i] == 0;
+    --out[i];
+  }
+}
+
+inline Limbs add(View a, View b) {
+  if (a.size() < b.size()) std::swap(a, b);
+  Limbs out(a.begin(), a.end());
+  out.push_back(0);
+  add_into(out, b);
+  trim(out);
+  return out;
+}
+
+// requires a >= b
+inline Limbs sub(View a, View b) {
+  Limbs out(a.begin(), a.end());
+  sub_into(out, b);
+  trim(out);
+  return out;
+}
+
+inline void mul_schoolbook(View a, View b, Limbs& out) {
+  out.assign(a.size() + b.size(), 0);
+  for (std::size_t i = 0; i < a.size(); ++i) {
+    Limb carry = 0;
+    for (std::size_t j = 0; j < b.size(); ++j) {
+      Wide const p = Wide{a[i]} * b[j] + out[i + j] + carry;
+      out[i + j] = static_cast<Limb>(p);
+      carry = static_cast<Limb>(p >> 64);
+    }
+    out[i + b.size()] = carry;
+  }
+}
+
+inline Limbs mul(View a, View b) {
+  a = trimmed(a);
+  b = trimmed(b);
+  if (a.empty() or b.empty()) return {};
+
+  Limbs out;
+  if (std::min(a.size(), b.size()) < kKaratsubaThreshold) {
+    mul_schoolbook(a, b, out);
+    trim(out);
+    return out;
+  }
+
+  // a = a1 * B^m + a0, b = b1 * B^m + b0
+  // a * b = z2 * B^2m + (z1 - z2 - z0) * B^m + z0
+  std::size_t const m = std::max(a.size(), b.size()) / 2;
+  auto const low = [m](View x) { return x.first(std::min(m, x.size())); };
+  auto const high = [m](View x) {
+    return x.size() > m ? x.subspan(m) : View{};
+  };
+
+  Limbs const z0 = mul(low(a), low(b));
+  Limbs const z2 = mul(high(a), high(b));
+  Limbs z1 = mul(add(low(a), high(a)), add(low(b), high(b)));
+  sub_into(z1, z0);
+  sub_into(z1, z2);
+  trim(z1);
+
+  out.assign(a.size() + b.size() + 1, 0);
+  add_into(out, z0);
+  add_into(out, z1, m);
+  add_into(out, z2, 2 * m);
+  trim(out);
+  return out;
+}
+
+// a = a * m + add, in place
+inline void mul_add_small(Limbs& a, Limb m, Limb add) {
+  Limb carry = add;
+  for (auto& limb : a) {
+    Wide const p = Wide{limb} * m + carry;
+    limb = static_cast<Limb>(p);
+    carry = static_cast<Limb>(p >> 64);
+  }
+  if (carry != 0) a.push_back(carry);
+}
+
+// a = a / d in place, returns the remainder
+inline Limb divmod_small(Limbs& a, Limb d) {
+  Wide rem = 0;
+  for (std::size_t i = a.size(); i-- > 0;) {
+    Wide const cur = (rem << 64) | a[i];
+    a[i] = static_cast<Limb>(cur / d);
+    rem = cur % d;
+  }
+  trim(a);
+  return static_cast<Limb>(rem);
+}
+}  // namespace detail::magnitude
+
+// Arbitrary-precision signed integer. Magnitudes of up to kInlineLimbs limbs
+// are stored inline, so bignums just past the 64-bit range do not allocate.
+class BigInt {
+  using Limb = detail::magnitude::Limb;
+  using View = detail::magnitude::View;
+
+  static constexpr std::uint32_t kInlineLimbs = 2;
+
+  // number of limbs; negative for negative numbers (as in GMP)
+  std::int32_t signed_size_ = 0;
+  std::uint32_t capacity_ = kInlineLimbs;
+  union {
+    Limb inline_[kInlineLimbs];
+    Limb* heap_;
+  };
+
+  bool is_inline() const { return capacity_ == kInlineLimbs; }
+  Limb* data() { return is_inline() ? inline_ : heap_; }
+  Limb const* data() const { return is_inline() ? inline_ : heap_; }
+
+  void assign(View mag, bool negative) {
+    mag = detail::magnitude::trimmed(mag);
+    if (mag.size() > capacity_) {
+      release();
+      capacity_ = static_cast<std::uint32_t>(mag.size());
+      heap_ = new Limb[capacity_];
+    }
+    std::copy(mag.begin(), mag.end(), data());
+    auto const size = static_cast<std::int32_t>(mag.size());
+    signed_size_ = negative ? -size : size;
+  }
+
+  void release() {
+    if (not is_inline()) delete[] heap_;
+    capacity_ = kInlineLimbs;
+  }
+
+  BigInt(View mag, bool negative) : inline_{} { assign(mag, negative); }
+
+  static BigInt add_signed(BigInt const& a, BigInt const& b, bool negate_b) {
+    namespace mag = detail::magnitude;
+    bool const b_negative = b.negative() != negate_b;
+    if (a.negative() == b_negative) {
+      return {mag::add(a.magnitude(), b.magnitude()), a.negative()};
+    }
+    if (mag::compare(a.magnitude(), b.magnitude()) >= 0) {
+      return {mag::sub(a.magnitude(), b.magnitude()), a.negative()};
+    }
+    return {mag::sub(b.magnitude(), a.magnitude()), b_negative};
+  }
+
+ public:
+  BigInt() : inline_{} {}
+
+  BigInt(std::int64_t v) : inline_{} {
+    // two's complement negation of the unsigned value handles INT64_MIN
+    Limb const mag = v < 0 ? Limb{0} - static_cast<Limb>(v) : v;
+    assign(View{&mag, 1}, v < 0);
+  }
+
+  BigInt(BigInt const& other) : inline_{} {
+    assign(other.magnitude(), other.negative());
+  }
+  BigInt(BigInt&& other) noexcept
+      : signed_size_{other.signed_size_}, capacity_{other.capacity_} {
+    if (other.is_inline()) {
+      std::memcpy(inline_, other.inline_, sizeof(inline_));
+    } else {
+      heap_ = other.heap_;
+      other.capacity_ = kInlineLimbs;
+    }
+    other.signed_size_ = 0;
+  }
+  BigInt& operator=(BigInt const& other) {
+    if (this != &other) assign(other.magnitude(), other.negative());
+    return *this;
+  }
+  BigInt& operator=(BigInt&& other) noexcept {
+    if (this != &other) {
+      this->~BigInt();
+      new (this) BigInt(std::move(other));
+    }
+    return *this;
+  }
+  ~BigInt() { release(); }
+
+  // digits, optionally preceded by '-'
+  static BigInt from_decimal(std::string_view s) {
+    bool const negative = not s.empty() and s[0] == '-';
+    if (negative) s.remove_prefix(1);
+
+    // 19 decimal digits at a time still fit in a limb
+    detail::magnitude::Limbs mag;
+    std::size_t const head = s.size() % 19;
+    for (std::size_t pos = 0; pos < s.size();) {
+      std::size_t const len = pos == 0 and head != 0 ? head : 19;
+      Limb chunk = 0;
+      Limb scale = 1;
+      for (char c : s.substr(pos, len)) {
+        chunk = chunk * 10 + (c - '0');
+        scale *= 10;
+      }
+      detail::magnitude::mul_add_small(mag, scale, chunk);
+      pos += len;
+    }
+    return {mag, negative};
+  }
+
+  bool negative() const { return signed_size_ < 0; }
+  bool is_zero() const { return signed_size_ == 0; }
+  View magnitude() const {
+    return {data(), static_cast<std::size_t>(std::abs(signed_size_))};
+  }
+
+  bool fits_int64() const {
+    auto const mag = magnitude();
+    if (mag.size() > 1) return false;
+    if (mag.empty()) return true;
+    Limb const limit =
+        Limb{std::numeric_limits<std::int64_t>::max()} + (negative() ? 1 : 0);
+    return mag[0] <= limit;
+  }
+
+  // requires fits_int64()
+  std::int64_t to_int64() const {
+    auto const mag = magnitude();
+    Limb const m = mag.empty() ? 0 : mag[0];
+    return static_cast<std::int64_t>(negative() ? Limb{0} - m : m);
+  }
+
+  std::string to_string() const {
+    if (is_zero()) return "0";
+
+    constexpr Limb kChunk = 10'000'000'000'000'000'000ull;
+    detail::magnitude::Limbs mag(magnitude().begin(), magnitude().end());
+    std::string digits;
+    while (not mag.empty()) {
+      Limb chunk = detail::magnitude::divmod_small(mag, kChunk);
+      for (int i = 0; i < 19 and (chunk != 0 or not mag.empty()); ++i) {
+        digits.push_back(static_cast<char>('0' + chunk % 10));
+        chunk /= 10;
+      }
+    }
+    if (negative()) digits.push_back('-');
+    std::reverse(digits.begin(), digits.end());
+    return digits;
+  }
+
+  BigInt operator-() const { return {magnitude(), not negative()}; }
+
+  friend BigInt operator+(BigInt const& a, BigInt const& b) {
+    return add_signed(a, b, false);
+  }
+  friend BigInt operator-(BigInt const& a, BigInt const& b) {
+    return add_signed(a, b, true);
+  }
+  friend BigInt operator*(BigInt const& a, BigInt const& b) {
+    return {detail::magnitude::mul(a.magnitude(), b.magnitude()),
+            a.negative() != b.negative()};
+  }
+
+  friend bool operator==(BigInt const& a, BigInt const& b) {
+    return a.signed_size_ == b.signed_size_ and
+           std::equal(a.data(), a.data() + std::abs(a.signed_size_),
+                      b.data());
+  }
+
+  friend std::strong_ordering operator<=>(BigInt const& a, BigInt const& b) {
+    if (a.negative() != b.negative()) {
+      return a.negative() ? std::strong_ordering::less
+                          : std::strong_ordering::greater;
+    }
+    int const c = detail::magnitude::compare(a.magnitude(), b.magnitude());
+    int const signed_c = a.negative() ? -c : c;
+    return signed_c <=> 0;
+  }
+
+  friend std::ostream& operator<<(std::ostream& out, BigInt const& b) {
+    return out << b.to_string();
+  }
+};
+
+}  // namespace guci
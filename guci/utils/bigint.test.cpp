@@ -0,0 +1,89 @@
+#include "guci/utils/bigint.hpp"
+
+#include <random>
+#include <sstream>
+#include <string>
+
+#include "catch2/catch.hpp"
+
+namespace guci {
+
+TEST_CASE("decimal round trip", "[bigint]") {
+  auto const s = GENERATE(as<std::string>{}, "0", "1", "-1",
+                          "9223372036854775807", "-9223372036854775808",
+                          "9223372036854775808", "18446744073709551616",
+                          "10000000000000000000",
+                          "-123456789012345678901234567890123456789");
+  REQUIRE(BigInt::from_decimal(s).to_string() == s);
+}
+
+TEST_CASE("int64 conversion", "[bigint]") {
+  auto const v = GENERATE(std::int64_t{0}, std::int64_t{-7},
+                          std::numeric_limits<std::int64_t>::max(),
+                          std::numeric_limits<std::int64_t>::min());
+  BigInt const b{v};
+  REQUIRE(b.fits_int64());
+  REQUIRE(b.to_int64() == v);
+  REQUIRE(b.to_string() == std::to_string(v));
+
+  REQUIRE_FALSE(BigInt::from_decimal("9223372036854775808").fits_int64());
+  REQUIRE_FALSE(BigInt::from_decimal("-9223372036854775809").fits_int64());
+}
+
+TEST_CASE("signed arithmetic", "[bigint]") {
+  auto const big = BigInt::from_decimal("100000000000000000000");
+
+  REQUIRE((big + big).to_string() == "200000000000000000000");
+  REQUIRE((big - big).is_zero());
+  REQUIRE((BigInt{5} - big).to_string() == "-99999999999999999995");
+  REQUIRE((-big + BigInt{5}).to_string() == "-99999999999999999995");
+  REQUIRE((-big - big).to_string() == "-200000000000000000000");
+  REQUIRE((big * -big).to_string() ==
+          "-10000000000000000000000000000000000000000");
+  REQUIRE((-big * -big) == big * big);
+  REQUIRE((big * BigInt{0}).is_zero());
+
+  REQUIRE(-big < BigInt{0});
+  REQUIRE(BigInt{0} < big);
+  REQUIRE(big < big + BigInt{1});
+  REQUIRE(-big - BigInt{1} < -big);
+}
+
+TEST_CASE("values spill from inline storage", "[bigint]") {
+  BigInt x{1};
+  BigInt const two_64 = BigInt::from_decimal("18446744073709551616");
+  for (int i = 0; i < 5; ++i) x = x * two_64;
+  REQUIRE(x.magnitude().size() == 6);
+
+  BigInt copy = x;
+  BigInt moved = std::move(copy);
+  REQUIRE(moved == x);
+  for (int i = 0; i < 5; ++i) moved = moved - x * BigInt{0} + BigInt{0};
+  REQUIRE(moved == x);
+
+  std::ostringstream out;
+  out << BigInt{-42};
+  REQUIRE(out.str() == "-42");
+}
+
+TEST_CASE("karatsuba agrees with schoolbook", "[bigint]") {
+  namespace mag = detail::magnitude;
+  std::mt19937_64 gen{GENERATE(1u, 2u, 3u)};
+  auto random_limbs = [&](std::size_t n) {
+    mag::Limbs l(n);
+    for (auto& limb : l) limb = gen();
+    return l;
+  };
+
+  auto const sizes = GENERATE(std::pair{32, 32}, std::pair{100, 100},
+                              std::pair{40, 257}, std::pair{300, 33});
+  auto const a = random_limbs(sizes.first);
+  auto const b = random_limbs(sizes.second);
+
+  mag::Limbs expected;
+  mag::mul_schoolbook(a, b, expected);
+  mag::trim(expected);
+  REQUIRE(mag::mul(a, b) == expected);
+}
+
+}  // namespace guci
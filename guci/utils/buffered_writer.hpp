@@ -0,0 +1,60 @@
+#pragma once
+
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include "guci/utils/outcome.hpp"
+
+namespace guci {
+
+// Collects output and hands it to the file descriptor in large writes.
+class BufferedWriter {
+  int fd_;
+  std::vector<char> buffer_;
+  std::size_t size_ = 0;
+
+  outcome::result<void> write_all(char const* data, std::size_t size) {
+    while (size > 0) {
+      ssize_t const n = ::write(fd_, data, size);
+      if (n < 0) {
+        if (errno == EINTR) continue;
+        return std::error_code{errno, std::generic_category()};
+      }
+      data += n;
+      size -= n;
+    }
+    return outcome::success();
+  }
+
+ public:
+  static constexpr std::size_t kDefaultCapacity = 1 << 16;
+
+  BufferedWriter(int fd, std::size_t capacity = kDefaultCapacity)
+      : fd_{fd}, buffer_(capacity) {}
+  BufferedWriter(BufferedWriter const&) = delete;
+  BufferedWriter& operator=(BufferedWriter const&) = delete;
+  ~BufferedWriter() { (void)flush(); }
+
+  outcome::result<void> write(std::string_view sv) {
+    if (size_ + sv.size() > buffer_.size()) {
+      OUTCOME_TRYV(flush());
+      if (sv.size() > buffer_.size()) return write_all(sv.data(), sv.size());
+    }
+    std::memcpy(buffer_.data() + size_, sv.data(), sv.size());
+    size_ += sv.size();
+    return outcome::success();
+  }
+
+  outcome::result<void> flush() {
+    auto const size = size_;
+    size_ = 0;
+    return write_all(buffer_.data(), size);
+  }
+};
+
+}  // namespace guci
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+namespace guci {
+
+// Character classes of the surface syntax, looked up in a single table.
+enum CharClass : std::uint8_t {
+  kWhitespace = 1 << 0,
+  kDigit = 1 << 1,
+  kIdentifierBegin = 1 << 2,
+  kIdentifierRest = 1 << 3,
+  kSpecial = 1 << 4,
+};
+
+inline constexpr std::string_view kWhitespaceChars = " \t\n";
+inline constexpr std::string_view kIdentifierPunctuation = "_+-*/%^@?!<=>";
+inline constexpr std::string_view kSpecialChars = ":()\"'$[]";
+
+namespace detail {
+constexpr std::array<std::uint8_t, 256> make_char_classes() {
+  std::array<std::uint8_t, 256> table{};
+  for (unsigned char c : kWhitespaceChars) table[c] |= kWhitespace;
+  for (int c = '0'; c <= '9'; ++c) table[c] |= kDigit | kIdentifierRest;
+  for (int c = 'a'; c <= 'z'; ++c) table[c] |= kIdentifierBegin;
+  for (int c = 'A'; c <= 'Z'; ++c) table[c] |= kIdentifierBegin;
+  for (unsigned char c : kIdentifierPunctuation) table[c] |= kIdentifierBegin;
+  for (unsigned char c : kSpecialChars) table[c] |= kSpecial;
+  for (auto& cls : table) {
+    if (cls & kIdentifierBegin) cls |= kIdentifierRest;
+  }
+  return table;
+}
+
+inline constexpr auto kCharClasses = make_char_classes();
+}  // namespace detail
+
+inline bool has_class(char c, CharClass cls) {
+  return detail::kCharClasses[static_cast<unsigned char>(c)] & cls;
+}
+
+}  // namespace guci
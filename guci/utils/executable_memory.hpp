@@ -0,0 +1,64 @@
+#pragma once
+
+#include <sys/mman.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <system_error>
+#include <utility>
+
+#include "guci/utils/outcome.hpp"
+
+namespace guci {
+
+// Pages holding machine code, mapped read and execute only once the code has
+// been copied in.
+class ExecutableMemory {
+  void* data_ = nullptr;
+  std::size_t size_ = 0;
+
+  ExecutableMemory(void* data, std::size_t size) : data_{data}, size_{size} {}
+
+  static std::error_code last_error() {
+    return {errno, std::generic_category()};
+  }
+
+ public:
+  static outcome::result<ExecutableMemory> copy_of(
+      std::span<std::uint8_t const> code) {
+    if (code.empty()) return std::make_error_code(std::errc::invalid_argument);
+
+    void* data = ::mmap(nullptr, code.size(), PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED) return last_error();
+    ExecutableMemory memory{data, code.size()};
+
+    std::memcpy(data, code.data(), code.size());
+    if (::mprotect(data, code.size(), PROT_READ | PROT_EXEC) != 0) {
+      return last_error();
+    }
+    return memory;
+  }
+
+  ExecutableMemory(ExecutableMemory&& other)
+      : data_{std::exchange(other.data_, nullptr)},
+        size_{std::exchange(other.size_, 0)} {}
+  ExecutableMemory& operator=(ExecutableMemory&& other) {
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+    return *this;
+  }
+  ExecutableMemory(ExecutableMemory const&) = delete;
+  ExecutableMemory& operator=(ExecutableMemory const&) = delete;
+
+  ~ExecutableMemory() {
+    if (data_ != nullptr) ::munmap(data_, size_);
+  }
+
+  void const* data() const { return data_; }
+  std::size_t size() const { return size_; }
+};
+
+}  // namespace guci
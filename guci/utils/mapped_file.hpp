@@ -0,0 +1,76 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+
+#include "guci/utils/outcome.hpp"
+
+namespace guci {
+
+// Read-only memory mapping of a whole file.
+class MappedFile {
+  void* data_ = nullptr;
+  std::size_t size_ = 0;
+
+  MappedFile(void* data, std::size_t size) : data_{data}, size_{size} {}
+
+  static std::error_code last_error() {
+    return {errno, std::generic_category()};
+  }
+
+ public:
+  static outcome::result<MappedFile> open(std::string const& path) {
+    int const fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return last_error();
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+      auto const ec = last_error();
+      ::close(fd);
+      return ec;
+    }
+
+    std::size_t const size = st.st_size;
+    if (size == 0) {
+      ::close(fd);
+      return MappedFile{nullptr, 0};
+    }
+
+    void* data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    auto const ec = last_error();
+    ::close(fd);
+    if (data == MAP_FAILED) return ec;
+
+    ::madvise(data, size, MADV_SEQUENTIAL);
+    return MappedFile{data, size};
+  }
+
+  MappedFile(MappedFile&& other)
+      : data_{std::exchange(other.data_, nullptr)},
+        size_{std::exchange(other.size_, 0)} {}
+  MappedFile& operator=(MappedFile&& other) {
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+    return *this;
+  }
+  MappedFile(MappedFile const&) = delete;
+  MappedFile& operator=(MappedFile const&) = delete;
+
+  ~MappedFile() {
+    if (data_ != nullptr) ::munmap(data_, size_);
+  }
+
+  std::string_view view() const {
+    return {static_cast<char const*>(data_), size_};
+  }
+};
+
+}  // namespace guci
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <span>
+#include <type_traits>
+#include <utility>
+
+#include "guci/utils/value_heap.hpp"
+
+namespace guci {
+
+// Array shared between owners, with its reference count, size and elements
+// in one allocation. Copying is a pointer copy and an atomic increment, so
+// owners may live in different threads. Elements can only be appended, and
+// an append copies the elements first unless this is the only owner, so
+// whatever other owners see never changes. An empty array owns nothing.
+// Arrays live on the ValueHeap.
+//
+// Next to its elements an array keeps a hash of them and a tag, which
+// whoever computes them may cache there for all owners; an append in place
+// clears both.
+template <typename T>
+class SharedArray {
+  struct alignas(std::max(alignof(T), alignof(std::uint64_t))) Header {
+    std::atomic<std::uint32_t> refs;
+    std::uint32_t size;
+    std::uint32_t capacity;
+    std::atomic<std::uint32_t> tag;
+    std::atomic<std::uint64_t> hash;
+
+    // sizeof(Header) is a multiple of alignof(T), so the elements start
+    // right after it
+    T* elements() { return reinterpret_cast<T*>(this + 1); }
+  };
+
+  Header* header_ = nullptr;
+
+  static std::size_t bytes(std::uint32_t capacity) {
+    return sizeof(Header) + capacity * sizeof(T);
+  }
+
+  static Header* allocate(std::uint32_t capacity) {
+    static_assert(alignof(Header) <= 16);
+    void* p = ValueHeap::global().allocate(bytes(capacity));
+    return ::new (p) Header{{1}, 0, capacity, {0}, {0}};
+  }
+
+  static void destroy(Header* h) {
+    std::size_t const size = bytes(h->capacity);
+    std::destroy_n(h->elements(), h->size);
+    h->~Header();
+    ValueHeap::global().deallocate(h, size);
+  }
+
+  void retain() const {
+    if (header_ != nullptr) {
+      header_->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  void release() {
+    if (header_ != nullptr and
+        header_->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      destroy(header_);
+    }
+    header_ = nullptr;
+  }
+
+  // Moves to a new allocation of `capacity` elements and constructs the
+  // element at index size() there from `args`.
+  template <typename... Args>
+  void grow(std::uint32_t capacity, Args&&... args) {
+    Header* const h = allocate(capacity);
+    std::uint32_t const n = size();
+    ::new (h->elements() + n) T(std::forward<Args>(args)...);
+    if (unique()) {
+      std::uninitialized_move_n(header_->elements(), n, h->elements());
+    } else if (n != 0) {
+      std::uninitialized_copy_n(header_->elements(), n, h->elements());
+    }
+    h->size = n + 1;
+    release();
+    header_ = h;
+  }
+
+ public:
+  SharedArray() = default;
+
+  static SharedArray copy_of(std::span<T const> ts) {
+    SharedArray a;
+    if (ts.empty()) return a;
+    a.header_ = allocate(static_cast<std::uint32_t>(ts.size()));
+    std::uninitialized_copy(ts.begin(), ts.end(), a.header_->elements());
+    a.header_->size = static_cast<std::uint32_t>(ts.size());
+    return a;
+  }
+
+  // An array of `n` elements that `fill` writes, given where they go; for
+  // trivial types only, whose elements need no constructor.
+  template <typename Fill>
+  static SharedArray build(std::uint32_t n, Fill fill) {
+    static_assert(std::is_trivial_v<T>);
+    SharedArray a;
+    if (n == 0) return a;
+    a.header_ = allocate(n);
+    fill(a.header_->elements());
+    a.header_->size = n;
+    return a;
+  }
+
+  SharedArray(SharedArray const& other) : header_{other.header_} {
+    retain();
+  }
+  SharedArray(SharedArray&& other) noexcept
+      : header_{std::exchange(other.header_, nullptr)} {}
+  SharedArray& operator=(SharedArray const& other) {
+    other.retain();
+    release();
+    header_ = other.header_;
+    return *this;
+  }
+  SharedArray& operator=(SharedArray&& other) noexcept {
+    if (this != &other) {
+      release();
+      header_ = std::exchange(other.header_, nullptr);
+    }
+    return *this;
+  }
+  ~SharedArray() { release(); }
+
+  std::uint32_t size() const {
+    return header_ != nullptr ? header_->size : 0;
+  }
+  bool unique() const {
+    return header_ != nullptr and
+           header_->refs.load(std::memory_order_acquire) == 1;
+  }
+  std::span<T const> view() const {
+    if (header_ == nullptr) return {};
+    return {header_->elements(), header_->size};
+  }
+  // of the allocation, header included; 0 for an empty array
+  std::size_t allocated_bytes() const {
+    return header_ != nullptr ? bytes(header_->capacity) : 0;
+  }
+
+  // 0 if nothing was cached
+  std::uint64_t cached_hash() const {
+    if (header_ == nullptr) return 0;
+    return header_->hash.load(std::memory_order_relaxed);
+  }
+  void cache_hash(std::uint64_t hash) const {
+    if (header_ != nullptr) {
+      header_->hash.store(hash, std::memory_order_relaxed);
+    }
+  }
+  std::uint32_t tag() const {
+    if (header_ == nullptr) return 0;
+    return header_->tag.load(std::memory_order_relaxed);
+  }
+  void set_tag(std::uint32_t tag) const {
+    if (header_ != nullptr) header_->tag.store(tag, std::memory_order_relaxed);
+  }
+
+  template <typename... Args>
+  void emplace_back(Args&&... args) {
+    std::uint32_t const n = size();
+    if (not unique() or n == header_->capacity) {
+      return grow(std::max<std::uint32_t>(4, 2 * n),
+                  std::forward<Args>(args)...);
+    }
+    ::new (header_->elements() + n) T(std::forward<Args>(args)...);
+    ++header_->size;
+    header_->tag.store(0, std::memory_order_relaxed);
+    header_->hash.store(0, std::memory_order_relaxed);
+  }
+};
+
+}  // namespace guci
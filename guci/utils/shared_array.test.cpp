@@ -0,0 +1,64 @@
+#include "guci/utils/shared_array.hpp"
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "catch2/catch.hpp"
+
+namespace guci {
+
+namespace {
+std::vector<std::string> contents(SharedArray<std::string> const& a) {
+  auto const v = a.view();
+  return {v.begin(), v.end()};
+}
+}  // namespace
+
+TEST_CASE("copies share the elements", "[shared_array]") {
+  std::vector<std::string> const strings{"a", "b"};
+  auto const a = SharedArray<std::string>::copy_of(strings);
+  REQUIRE(a.unique());
+
+  SharedArray<std::string> b = a;
+  REQUIRE(b.view().data() == a.view().data());
+  REQUIRE_FALSE(a.unique());
+
+  b = SharedArray<std::string>{};
+  REQUIRE(b.size() == 0);
+  REQUIRE(a.unique());
+  REQUIRE(contents(a) == strings);
+}
+
+TEST_CASE("appending copies only shared arrays", "[shared_array]") {
+  SharedArray<std::string> a;
+  a.emplace_back("one");
+  auto const* storage = a.view().data();
+  a.emplace_back("two");
+  REQUIRE(a.view().data() == storage);
+
+  SharedArray<std::string> const b = a;
+  a.emplace_back("three");
+  REQUIRE(a.view().data() != storage);
+  REQUIRE(contents(a) == std::vector<std::string>{"one", "two", "three"});
+  REQUIRE(contents(b) == std::vector<std::string>{"one", "two"});
+
+  for (int i = 0; i < 100; ++i) a.emplace_back(std::to_string(i));
+  REQUIRE(a.size() == 103);
+  REQUIRE(a.view().back() == "99");
+}
+
+TEST_CASE("built arrays hold what was written", "[shared_array]") {
+  auto const a = SharedArray<std::int64_t>::build(
+      5, [](std::int64_t* out) {
+        for (int i = 0; i < 5; ++i) out[i] = i * i;
+      });
+  REQUIRE(a.unique());
+  REQUIRE(std::vector<std::int64_t>(a.view().begin(), a.view().end()) ==
+          std::vector<std::int64_t>{0, 1, 4, 9, 16});
+  REQUIRE(SharedArray<std::int64_t>::build(0, [](std::int64_t*) {}).size() ==
+          0);
+}
+
+}  // namespace guci
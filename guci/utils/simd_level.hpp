@@ -0,0 +1,30 @@
+#pragma once
+
+#if defined(__x86_64__) or (defined(__i386__) and defined(__SSE2__))
+#define GUCI_SIMD_X86 1
+#include <immintrin.h>
+#else
+#define GUCI_SIMD_X86 0
+#endif
+
+// The instruction sets the SIMD kernels are written for, and the widest one
+// the CPU supports, which they use unless told otherwise.
+namespace guci::simd {
+
+enum class Level { Scalar, SSE2, AVX2 };
+
+inline Level detect_level() {
+#if GUCI_SIMD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) return Level::AVX2;
+  return Level::SSE2;
+#else
+  return Level::Scalar;
+#endif
+}
+
+inline Level const kActiveLevel = detect_level();
+
+inline bool supported(Level level) { return level <= kActiveLevel; }
+
+}  // namespace guci::simd
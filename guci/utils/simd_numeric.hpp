@@ -0,0 +1,367 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include "guci/utils/simd_level.hpp"
+
+// Kernels on packed 64-bit integers, used by the vectors of the evaluator.
+// Each one exists as a scalar reference and an AVX2 version; SSE2 has no
+// 64-bit comparisons, so at that level the scalar ones run, which are kept
+// free of branches where that lets the compiler vectorize them itself.
+// Nothing wraps around: a kernel whose result would not fit in 64 bits
+// returns nullopt or false instead, and the sums may do so whenever a
+// partial sum does not fit.
+namespace guci::simd {
+
+enum class Arith { Add, Subtract, Multiply };
+
+// An operand of the elementwise kernels: the elements of a vector, or one
+// value standing for all of them.
+struct Elements {
+  std::int64_t const* data;
+  std::int64_t operator[](std::size_t i) const { return data[i]; }
+};
+
+struct Broadcast {
+  std::int64_t value;
+  std::int64_t operator[](std::size_t) const { return value; }
+};
+
+// the operand from element i on
+inline Elements advance(Elements e, std::size_t i) { return {e.data + i}; }
+inline Broadcast advance(Broadcast b, std::size_t) { return b; }
+
+namespace scalar {
+inline std::optional<std::int64_t> sum(std::int64_t const* data,
+                                       std::size_t n) {
+  std::uint64_t acc = 0;
+  std::uint64_t overflow = 0;
+  for (std::size_t i = 0; i < n; ++i) {
+    auto const x = static_cast<std::uint64_t>(data[i]);
+    std::uint64_t const r = acc + x;
+    // the sign of the result differs from those of both operands
+    overflow |= (acc ^ r) & (x ^ r);
+    acc = r;
+  }
+  if (overflow >> 63) return std::nullopt;
+  return static_cast<std::int64_t>(acc);
+}
+
+inline std::optional<std::int64_t> product(std::int64_t const* data,
+                                           std::size_t n) {
+  std::int64_t acc = 1;
+  for (std::size_t i = 0; i < n; ++i) {
+    if (__builtin_mul_overflow(acc, data[i], &acc)) return std::nullopt;
+  }
+  return acc;
+}
+
+inline std::optional<std::int64_t> dot(std::int64_t const* a,
+                                       std::int64_t const* b,
+                                       std::size_t n) {
+  std::int64_t acc = 0;
+  for (std::size_t i = 0; i < n; ++i) {
+    std::int64_t p;
+    if (__builtin_mul_overflow(a[i], b[i], &p) or
+        __builtin_add_overflow(acc, p, &acc)) {
+      return std::nullopt;
+    }
+  }
+  return acc;
+}
+
+// the least element for kMax false, else the greatest; n is at least 1
+template <bool kMax>
+std::int64_t extremum(std::int64_t const* data, std::size_t n) {
+  std::int64_t m = data[0];
+  for (std::size_t i = 1; i < n; ++i) {
+    m = kMax ? std::max(m, data[i]) : std::min(m, data[i]);
+  }
+  return m;
+}
+
+template <typename L, typename R>
+bool elementwise(Arith op, L lhs, R rhs, std::int64_t* out, std::size_t n) {
+  std::uint64_t overflow = 0;
+  switch (op) {
+    case Arith::Add:
+      for (std::size_t i = 0; i < n; ++i) {
+        auto const a = static_cast<std::uint64_t>(lhs[i]);
+        auto const b = static_cast<std::uint64_t>(rhs[i]);
+        std::uint64_t const r = a + b;
+        overflow |= (a ^ r) & (b ^ r);
+        out[i] = static_cast<std::int64_t>(r);
+      }
+      break;
+    case Arith::Subtract:
+      for (std::size_t i = 0; i < n; ++i) {
+        auto const a = static_cast<std::uint64_t>(lhs[i]);
+        auto const b = static_cast<std::uint64_t>(rhs[i]);
+        std::uint64_t const r = a - b;
+        overflow |= (a ^ b) & (a ^ r);
+        out[i] = static_cast<std::int64_t>(r);
+      }
+      break;
+    case Arith::Multiply:
+      for (std::size_t i = 0; i < n; ++i) {
+        overflow |= __builtin_mul_overflow(lhs[i], rhs[i], &out[i]);
+      }
+      return overflow == 0;
+  }
+  return (overflow >> 63) == 0;
+}
+}  // namespace scalar
+
+#if GUCI_SIMD_X86
+namespace avx2 {
+#define GUCI_AVX2 __attribute__((target("avx2")))
+
+GUCI_AVX2 inline __m256i load(Elements e, std::size_t i) {
+  return _mm256_loadu_si256(reinterpret_cast<__m256i const*>(e.data + i));
+}
+
+GUCI_AVX2 inline __m256i load(Broadcast b, std::size_t) {
+  return _mm256_set1_epi64x(b.value);
+}
+
+GUCI_AVX2 inline void store(std::int64_t* out, __m256i v) {
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), v);
+}
+
+GUCI_AVX2 inline bool any_sign(__m256i v) {
+  return _mm256_movemask_pd(_mm256_castsi256_pd(v)) != 0;
+}
+
+// AVX2 only multiplies the low 32 bits of each lane, which is exact for
+// lanes that fit in 32 bits. Those that do have no high bits set in the
+// result of `biased`, so the kernels multiply regardless and check the ORed
+// results at the end, to start over in scalar in the rare case of a wider
+// element.
+GUCI_AVX2 inline __m256i biased(__m256i a, __m256i b) {
+  __m256i const bias = _mm256_set1_epi64x(std::int64_t{1} << 31);
+  return _mm256_or_si256(_mm256_add_epi64(a, bias),
+                         _mm256_add_epi64(b, bias));
+}
+
+GUCI_AVX2 inline bool narrow(__m256i biased) {
+  __m256i const high = _mm256_set1_epi64x(~std::int64_t{0xffffffff});
+  return _mm256_testz_si256(biased, high);
+}
+
+// the lanes of `acc` and the sum of `rest`, added up
+GUCI_AVX2 inline std::optional<std::int64_t> add_lanes(
+    __m256i acc, std::optional<std::int64_t> rest) {
+  if (not rest) return std::nullopt;
+  std::int64_t lanes[5];
+  store(lanes, acc);
+  lanes[4] = *rest;
+  return scalar::sum(lanes, 5);
+}
+
+GUCI_AVX2 inline std::optional<std::int64_t> sum(std::int64_t const* data,
+                                                 std::size_t n) {
+  __m256i acc = _mm256_setzero_si256();
+  __m256i overflow = _mm256_setzero_si256();
+  std::size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256i const x = load(Elements{data}, i);
+    __m256i const r = _mm256_add_epi64(acc, x);
+    overflow = _mm256_or_si256(
+        overflow,
+        _mm256_and_si256(_mm256_xor_si256(acc, r), _mm256_xor_si256(x, r)));
+    acc = r;
+  }
+  if (any_sign(overflow)) return std::nullopt;
+  return add_lanes(acc, scalar::sum(data + i, n - i));
+}
+
+GUCI_AVX2 inline std::optional<std::int64_t> dot(std::int64_t const* a,
+                                                 std::int64_t const* b,
+                                                 std::size_t n) {
+  __m256i acc = _mm256_setzero_si256();
+  __m256i overflow = _mm256_setzero_si256();
+  __m256i wide = _mm256_setzero_si256();
+  std::size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256i const x = load(Elements{a}, i);
+    __m256i const y = load(Elements{b}, i);
+    wide = _mm256_or_si256(wide, biased(x, y));
+    __m256i const p = _mm256_mul_epi32(x, y);
+    __m256i const r = _mm256_add_epi64(acc, p);
+    overflow = _mm256_or_si256(
+        overflow,
+        _mm256_and_si256(_mm256_xor_si256(acc, r), _mm256_xor_si256(p, r)));
+    acc = r;
+  }
+  if (not narrow(wide)) return scalar::dot(a, b, n);
+  if (any_sign(overflow)) return std::nullopt;
+  return add_lanes(acc, scalar::dot(a + i, b + i, n - i));
+}
+
+template <bool kMax>
+GUCI_AVX2 std::int64_t extremum(std::int64_t const* data, std::size_t n) {
+  if (n < 4) return scalar::extremum<kMax>(data, n);
+  __m256i m = load(Elements{data}, 0);
+  std::size_t i = 4;
+  for (; i + 4 <= n; i += 4) {
+    __m256i const x = load(Elements{data}, i);
+    __m256i const take = kMax ? _mm256_cmpgt_epi64(x, m)
+                              : _mm256_cmpgt_epi64(m, x);
+    m = _mm256_blendv_epi8(m, x, take);
+  }
+  std::int64_t lanes[5];
+  store(lanes, m);
+  lanes[4] = i < n ? scalar::extremum<kMax>(data + i, n - i) : lanes[0];
+  return scalar::extremum<kMax>(lanes, 5);
+}
+
+template <typename L, typename R>
+GUCI_AVX2 bool elementwise(Arith op, L lhs, R rhs, std::int64_t* out,
+                           std::size_t n) {
+  __m256i overflow = _mm256_setzero_si256();
+  std::size_t i = 0;
+  switch (op) {
+    case Arith::Add:
+      for (; i + 4 <= n; i += 4) {
+        __m256i const a = load(lhs, i);
+        __m256i const b = load(rhs, i);
+        __m256i const r = _mm256_add_epi64(a, b);
+        overflow = _mm256_or_si256(
+            overflow,
+            _mm256_and_si256(_mm256_xor_si256(a, r), _mm256_xor_si256(b, r)));
+        store(out + i, r);
+      }
+      break;
+    case Arith::Subtract:
+      for (; i + 4 <= n; i += 4) {
+        __m256i const a = load(lhs, i);
+        __m256i const b = load(rhs, i);
+        __m256i const r = _mm256_sub_epi64(a, b);
+        overflow = _mm256_or_si256(
+            overflow,
+            _mm256_and_si256(_mm256_xor_si256(a, b), _mm256_xor_si256(a, r)));
+        store(out + i, r);
+      }
+      break;
+    case Arith::Multiply: {
+      __m256i wide = _mm256_setzero_si256();
+      for (; i + 4 <= n; i += 4) {
+        __m256i const a = load(lhs, i);
+        __m256i const b = load(rhs, i);
+        wide = _mm256_or_si256(wide, biased(a, b));
+        store(out + i, _mm256_mul_epi32(a, b));
+      }
+      if (not narrow(wide)) return scalar::elementwise(op, lhs, rhs, out, n);
+      break;
+    }
+  }
+  if (any_sign(overflow)) return false;
+  return scalar::elementwise(op, advance(lhs, i), advance(rhs, i), out + i,
+                             n - i);
+}
+
+#undef GUCI_AVX2
+}  // namespace avx2
+#endif
+
+inline std::optional<std::int64_t> sum(std::span<std::int64_t const> v,
+                                       Level level = kActiveLevel) {
+#if GUCI_SIMD_X86
+  if (level == Level::AVX2) return avx2::sum(v.data(), v.size());
+#endif
+  (void)level;
+  return scalar::sum(v.data(), v.size());
+}
+
+// Scalar only: there is no 64-bit multiplication below AVX-512, and the
+// product of a few dozen elements of more than one bit overflows anyway.
+inline std::optional<std::int64_t> product(std::span<std::int64_t const> v) {
+  return scalar::product(v.data(), v.size());
+}
+
+// the sum of the products of the elements of `a` and `b`, of equal size
+inline std::optional<std::int64_t> dot(std::span<std::int64_t const> a,
+                                       std::span<std::int64_t const> b,
+                                       Level level = kActiveLevel) {
+#if GUCI_SIMD_X86
+  if (level == Level::AVX2) return avx2::dot(a.data(), b.data(), a.size());
+#endif
+  (void)level;
+  return scalar::dot(a.data(), b.data(), a.size());
+}
+
+// `v` must not be empty
+inline std::int64_t min(std::span<std::int64_t const> v,
+                        Level level = kActiveLevel) {
+#if GUCI_SIMD_X86
+  if (level == Level::AVX2) return avx2::extremum<false>(v.data(), v.size());
+#endif
+  (void)level;
+  return scalar::extremum<false>(v.data(), v.size());
+}
+
+inline std::int64_t max(std::span<std::int64_t const> v,
+                        Level level = kActiveLevel) {
+#if GUCI_SIMD_X86
+  if (level == Level::AVX2) return avx2::extremum<true>(v.data(), v.size());
+#endif
+  (void)level;
+  return scalar::extremum<true>(v.data(), v.size());
+}
+
+// Writes lhs[i] op rhs[i] to out[i] for the n elements; false if one of
+// them overflows, leaving `out` half written.
+template <typename L, typename R>
+bool elementwise(Arith op, L lhs, R rhs, std::int64_t* out, std::size_t n,
+                 Level level = kActiveLevel) {
+#if GUCI_SIMD_X86
+  if (level == Level::AVX2) return avx2::elementwise(op, lhs, rhs, out, n);
+#endif
+  (void)level;
+  return scalar::elementwise(op, lhs, rhs, out, n);
+}
+
+// Sorts `v` in place. Runs of at least kRadixSortMin elements are radix
+// sorted a byte at a time, skipping the bytes that all elements share, such
+// as the high ones of small numbers.
+inline constexpr std::size_t kRadixSortMin = 256;
+
+inline void sort(std::span<std::int64_t> v) {
+  std::size_t const n = v.size();
+  if (n < kRadixSortMin) return std::sort(v.begin(), v.end());
+
+  // with the sign bit flipped, keys order as unsigned numbers
+  constexpr std::uint64_t kSign = std::uint64_t{1} << 63;
+  auto* keys = reinterpret_cast<std::uint64_t*>(v.data());
+  std::array<std::array<std::size_t, 256>, 8> counts{};
+  for (std::size_t i = 0; i < n; ++i) {
+    keys[i] ^= kSign;
+    for (int b = 0; b < 8; ++b) ++counts[b][(keys[i] >> (8 * b)) & 0xff];
+  }
+
+  std::vector<std::uint64_t> scratch(n);
+  std::uint64_t* from = keys;
+  std::uint64_t* to = scratch.data();
+  for (int b = 0; b < 8; ++b) {
+    auto& count = counts[b];
+    if (count[(from[0] >> (8 * b)) & 0xff] == n) continue;
+    std::size_t offset = 0;
+    for (auto& c : count) offset += std::exchange(c, offset);
+    for (std::size_t i = 0; i < n; ++i) {
+      to[count[(from[i] >> (8 * b)) & 0xff]++] = from[i];
+    }
+    std::swap(from, to);
+  }
+  if (from != keys) std::copy_n(from, n, keys);
+  for (std::size_t i = 0; i < n; ++i) keys[i] ^= kSign;
+}
+
+}  // namespace guci::simd
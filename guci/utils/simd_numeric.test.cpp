@@ -0,0 +1,140 @@
+#include "guci/utils/simd_numeric.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <random>
+#include <vector>
+
+#include "catch2/catch.hpp"
+
+namespace guci::simd {
+
+namespace {
+using Limits = std::numeric_limits<std::int64_t>;
+
+std::vector<Level> levels() {
+  std::vector<Level> ls;
+  for (auto l : {Level::Scalar, Level::SSE2, Level::AVX2}) {
+    if (supported(l)) ls.push_back(l);
+  }
+  return ls;
+}
+
+std::vector<std::int64_t> random_elements(std::mt19937_64& gen,
+                                          std::size_t size, std::int64_t lo,
+                                          std::int64_t hi) {
+  std::uniform_int_distribution<std::int64_t> pick(lo, hi);
+  std::vector<std::int64_t> v(size);
+  for (auto& x : v) x = pick(gen);
+  return v;
+}
+
+// in 128 bits, nullopt unless the result fits in 64
+std::optional<std::int64_t> narrow(__int128 x) {
+  if (x < Limits::min() or x > Limits::max()) return std::nullopt;
+  return static_cast<std::int64_t>(x);
+}
+
+// nullopt as soon as a product does not fit
+std::optional<std::int64_t> reference_dot(std::vector<std::int64_t> const& a,
+                                          std::vector<std::int64_t> const& b) {
+  __int128 acc = 0;
+  for (std::size_t i = 0; i < a.size(); ++i) {
+    auto const p = narrow(__int128{a[i]} * b[i]);
+    if (not p) return std::nullopt;
+    acc += *p;
+  }
+  return narrow(acc);
+}
+}  // namespace
+
+TEST_CASE("kernels agree with a 128-bit reference", "[simd_numeric]") {
+  std::mt19937_64 gen{42};
+  // small elements, those just past 32 bits, and any at all
+  auto const bound = GENERATE(std::int64_t{1000}, std::int64_t{1} << 33,
+                              Limits::max());
+
+  for (std::size_t size : {1u, 3u, 4u, 5u, 8u, 31u, 100u, 1001u}) {
+    auto const a = random_elements(gen, size, -bound, bound);
+    auto const b = random_elements(gen, size, -bound, bound);
+    __int128 total = 0;
+    for (auto x : a) total += x;
+
+    for (Level level : levels()) {
+      CAPTURE(bound, size, level);
+      // partial sums may overflow where the total does not
+      auto const s = sum(a, level);
+      if (s) REQUIRE(narrow(total) == s);
+      if (bound < Limits::max()) REQUIRE(s == narrow(total));
+      auto const d = dot(a, b, level);
+      if (d) REQUIRE(d == reference_dot(a, b));
+      if (bound < (1 << 20)) REQUIRE(d == reference_dot(a, b));
+      REQUIRE(min(a, level) == *std::ranges::min_element(a));
+      REQUIRE(max(a, level) == *std::ranges::max_element(a));
+
+      std::vector<std::int64_t> out(size);
+      for (Arith op : {Arith::Add, Arith::Subtract, Arith::Multiply}) {
+        bool fits = true;
+        std::vector<std::int64_t> expected(size);
+        for (std::size_t i = 0; i < size; ++i) {
+          __int128 const x = a[i];
+          auto const r = narrow(op == Arith::Add        ? x + b[i]
+                                : op == Arith::Subtract ? x - b[i]
+                                                        : x * b[i]);
+          fits = fits and r.has_value();
+          expected[i] = r.value_or(0);
+        }
+        bool const done = elementwise(op, Elements{a.data()},
+                                      Elements{b.data()}, out.data(), size,
+                                      level);
+        REQUIRE(done == fits);
+        if (fits) REQUIRE(out == expected);
+
+        REQUIRE(elementwise(op, Elements{a.data()}, Broadcast{0}, out.data(),
+                            size, level));
+        REQUIRE(out == (op == Arith::Multiply
+                            ? std::vector<std::int64_t>(size, 0)
+                            : a));
+      }
+    }
+  }
+}
+
+TEST_CASE("overflow is reported rather than wrapped", "[simd_numeric]") {
+  std::vector<std::int64_t> const big(9, Limits::max() / 4);
+  std::vector<std::int64_t> const twos(9, 2);
+  std::vector<std::int64_t> out(9);
+  for (Level level : levels()) {
+    CAPTURE(level);
+    REQUIRE_FALSE(sum(big, level));
+    REQUIRE(sum(std::span{big}.first(3), level) == 3 * (Limits::max() / 4));
+    REQUIRE_FALSE(dot(big, twos, level));
+    REQUIRE_FALSE(elementwise(Arith::Multiply, Elements{big.data()},
+                              Broadcast{8}, out.data(), 9, level));
+    REQUIRE_FALSE(elementwise(Arith::Subtract, Broadcast{Limits::min()},
+                              Elements{twos.data()}, out.data(), 9, level));
+    REQUIRE(elementwise(Arith::Multiply, Elements{big.data()}, Broadcast{4},
+                        out.data(), 9, level));
+    REQUIRE(out[8] == Limits::max() - 3);
+  }
+  REQUIRE(product(twos) == 512);
+  REQUIRE_FALSE(product(big));
+}
+
+TEST_CASE("sort orders like std::sort", "[simd_numeric]") {
+  std::mt19937_64 gen{7};
+  auto const bound =
+      GENERATE(std::int64_t{3}, std::int64_t{100000}, Limits::max());
+  for (std::size_t size : {0u, 1u, 255u, 256u, 257u, 5000u}) {
+    auto v = random_elements(gen, size, -bound, bound);
+    if (size > 2) v[size / 2] = Limits::min();
+    auto expected = v;
+    std::ranges::sort(expected);
+    sort(v);
+    REQUIRE(v == expected);
+  }
+}
+
+}  // namespace guci::simd
@@ -0,0 +1,295 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+#include "guci/utils/char_class.hpp"
+#include "guci/utils/simd_level.hpp"
+
+// Scanning kernels used by the reader. Each one exists as a scalar reference,
+// an SSE2 version and an AVX2 version; the dispatching functions at the bottom
+// pick the widest one the CPU supports at runtime. All of them return the
+// position of the first byte at or after `pos` that stops the scan, or `size`
+// (npos for the find_ kernels) when there is none.
+namespace guci::simd {
+
+namespace scalar {
+inline std::size_t skip_whitespace(char const* data, std::size_t pos,
+                                   std::size_t size) {
+  while (pos < size and has_class(data[pos], kWhitespace)) ++pos;
+  return pos;
+}
+
+inline std::size_t skip_identifier_rest(char const* data, std::size_t pos,
+                                        std::size_t size) {
+  while (pos < size and has_class(data[pos], kIdentifierRest)) ++pos;
+  return pos;
+}
+
+inline std::size_t find_either(char const* data, std::size_t pos,
+                               std::size_t size, char a, char b) {
+  for (; pos < size; ++pos) {
+    if (data[pos] == a or data[pos] == b) return pos;
+  }
+  return std::string_view::npos;
+}
+
+inline std::size_t find_structural(char const* data, std::size_t pos,
+                                   std::size_t size) {
+  for (; pos < size; ++pos) {
+    if (data[pos] == '(' or data[pos] == ')' or data[pos] == '"') return pos;
+  }
+  return std::string_view::npos;
+}
+}  // namespace scalar
+
+#if GUCI_SIMD_X86
+namespace sse2 {
+inline __m128i in_range(__m128i v, char lo, char count) {
+  __m128i const biased =
+      _mm_xor_si128(_mm_sub_epi8(v, _mm_set1_epi8(lo)), _mm_set1_epi8(-128));
+  return _mm_cmplt_epi8(biased,
+                        _mm_set1_epi8(static_cast<char>(-128 + count)));
+}
+
+inline __m128i whitespace_mask(__m128i v) {
+  return _mm_or_si128(
+      _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                   _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+      _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+}
+
+inline __m128i identifier_rest_mask(__m128i v) {
+  __m128i const lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+  __m128i m = _mm_or_si128(in_range(lower, 'a', 26), in_range(v, '0', 10));
+  for (char c : kIdentifierPunctuation) {
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(c)));
+  }
+  return m;
+}
+
+inline std::size_t skip_whitespace(char const* data, std::size_t pos,
+                                   std::size_t size) {
+  for (; pos + 16 <= size; pos += 16) {
+    __m128i const v =
+        _mm_loadu_si128(reinterpret_cast<__m128i const*>(data + pos));
+    unsigned const stop = ~_mm_movemask_epi8(whitespace_mask(v)) & 0xffff;
+    if (stop != 0) return pos + __builtin_ctz(stop);
+  }
+  return scalar::skip_whitespace(data, pos, size);
+}
+
+inline std::size_t skip_identifier_rest(char const* data, std::size_t pos,
+                                        std::size_t size) {
+  for (; pos + 16 <= size; pos += 16) {
+    __m128i const v =
+        _mm_loadu_si128(reinterpret_cast<__m128i const*>(data + pos));
+    unsigned const stop =
+        ~_mm_movemask_epi8(identifier_rest_mask(v)) & 0xffff;
+    if (stop != 0) return pos + __builtin_ctz(stop);
+  }
+  return scalar::skip_identifier_rest(data, pos, size);
+}
+
+inline std::size_t find_either(char const* data, std::size_t pos,
+                               std::size_t size, char a, char b) {
+  __m128i const va = _mm_set1_epi8(a);
+  __m128i const vb = _mm_set1_epi8(b);
+  for (; pos + 16 <= size; pos += 16) {
+    __m128i const v =
+        _mm_loadu_si128(reinterpret_cast<__m128i const*>(data + pos));
+    unsigned const hit = _mm_movemask_epi8(
+        _mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb)));
+    if (hit != 0) return pos + __builtin_ctz(hit);
+  }
+  return scalar::find_either(data, pos, size, a, b);
+}
+
+inline std::size_t find_structural(char const* data, std::size_t pos,
+                                   std::size_t size) {
+  for (; pos + 16 <= size; pos += 16) {
+    __m128i const v =
+        _mm_loadu_si128(reinterpret_cast<__m128i const*>(data + pos));
+    // '(' and ')' differ only in the lowest bit
+    __m128i const paren = _mm_cmpeq_epi8(_mm_or_si128(v, _mm_set1_epi8(1)),
+                                         _mm_set1_epi8(')'));
+    unsigned const hit = _mm_movemask_epi8(
+        _mm_or_si128(paren, _mm_cmpeq_epi8(v, _mm_set1_epi8('"'))));
+    if (hit != 0) return pos + __builtin_ctz(hit);
+  }
+  return scalar::find_structural(data, pos, size);
+}
+}  // namespace sse2
+
+namespace avx2 {
+#define GUCI_AVX2 __attribute__((target("avx2")))
+
+GUCI_AVX2 inline __m256i in_range(__m256i v, char lo, char count) {
+  __m256i const biased = _mm256_xor_si256(
+      _mm256_sub_epi8(v, _mm256_set1_epi8(lo)), _mm256_set1_epi8(-128));
+  return _mm256_cmpgt_epi8(
+      _mm256_set1_epi8(static_cast<char>(-128 + count)), biased);
+}
+
+GUCI_AVX2 inline __m256i whitespace_mask(__m256i v) {
+  return _mm256_or_si256(
+      _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                      _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))),
+      _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+}
+
+GUCI_AVX2 inline __m256i identifier_rest_mask(__m256i v) {
+  __m256i const lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+  __m256i m =
+      _mm256_or_si256(in_range(lower, 'a', 26), in_range(v, '0', 10));
+  for (char c : kIdentifierPunctuation) {
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c)));
+  }
+  return m;
+}
+
+GUCI_AVX2 inline std::size_t skip_whitespace(char const* data,
+                                             std::size_t pos,
+                                             std::size_t size) {
+  for (; pos + 32 <= size; pos += 32) {
+    __m256i const v =
+        _mm256_loadu_si256(reinterpret_cast<__m256i const*>(data + pos));
+    unsigned const stop = ~_mm256_movemask_epi8(whitespace_mask(v));
+    if (stop != 0) return pos + __builtin_ctz(stop);
+  }
+  return sse2::skip_whitespace(data, pos, size);
+}
+
+GUCI_AVX2 inline std::size_t skip_identifier_rest(char const* data,
+                                                  std::size_t pos,
+                                                  std::size_t size) {
+  for (; pos + 32 <= size; pos += 32) {
+    __m256i const v =
+        _mm256_loadu_si256(reinterpret_cast<__m256i const*>(data + pos));
+    unsigned const stop = ~_mm256_movemask_epi8(identifier_rest_mask(v));
+    if (stop != 0) return pos + __builtin_ctz(stop);
+  }
+  return sse2::skip_identifier_rest(data, pos, size);
+}
+
+GUCI_AVX2 inline std::size_t find_either(char const* data, std::size_t pos,
+                                         std::size_t size, char a, char b) {
+  __m256i const va = _mm256_set1_epi8(a);
+  __m256i const vb = _mm256_set1_epi8(b);
+  for (; pos + 32 <= size; pos += 32) {
+    __m256i const v =
+        _mm256_loadu_si256(reinterpret_cast<__m256i const*>(data + pos));
+    unsigned const hit = _mm256_movemask_epi8(
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, va), _mm256_cmpeq_epi8(v, vb)));
+    if (hit != 0) return pos + __builtin_ctz(hit);
+  }
+  return sse2::find_either(data, pos, size, a, b);
+}
+
+GUCI_AVX2 inline std::size_t find_structural(char const* data,
+                                             std::size_t pos,
+                                             std::size_t size) {
+  for (; pos + 32 <= size; pos += 32) {
+    __m256i const v =
+        _mm256_loadu_si256(reinterpret_cast<__m256i const*>(data + pos));
+    __m256i const paren = _mm256_cmpeq_epi8(
+        _mm256_or_si256(v, _mm256_set1_epi8(1)), _mm256_set1_epi8(')'));
+    unsigned const hit = _mm256_movemask_epi8(
+        _mm256_or_si256(paren, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'))));
+    if (hit != 0) return pos + __builtin_ctz(hit);
+  }
+  return sse2::find_structural(data, pos, size);
+}
+
+#undef GUCI_AVX2
+}  // namespace avx2
+#endif
+
+inline std::size_t skip_whitespace(std::string_view in, std::size_t pos,
+                                   Level level = kActiveLevel) {
+  // most runs are a single separating space, which is not worth a vector load
+  if (pos < in.size() and not has_class(in[pos], kWhitespace)) return pos;
+  switch (level) {
+#if GUCI_SIMD_X86
+    case Level::AVX2:
+      return avx2::skip_whitespace(in.data(), pos, in.size());
+    case Level::SSE2:
+      return sse2::skip_whitespace(in.data(), pos, in.size());
+#endif
+    default:
+      return scalar::skip_whitespace(in.data(), pos, in.size());
+  }
+}
+
+inline std::size_t skip_identifier_rest(std::string_view in, std::size_t pos,
+                                        Level level = kActiveLevel) {
+  switch (level) {
+#if GUCI_SIMD_X86
+    case Level::AVX2:
+      return avx2::skip_identifier_rest(in.data(), pos, in.size());
+    case Level::SSE2:
+      return sse2::skip_identifier_rest(in.data(), pos, in.size());
+#endif
+    default:
+      return scalar::skip_identifier_rest(in.data(), pos, in.size());
+  }
+}
+
+inline std::size_t find_either(std::string_view in, std::size_t pos, char a,
+                               char b, Level level = kActiveLevel) {
+  switch (level) {
+#if GUCI_SIMD_X86
+    case Level::AVX2:
+      return avx2::find_either(in.data(), pos, in.size(), a, b);
+    case Level::SSE2:
+      return sse2::find_either(in.data(), pos, in.size(), a, b);
+#endif
+    default:
+      return scalar::find_either(in.data(), pos, in.size(), a, b);
+  }
+}
+
+// Position of the first '(', ')' or '"', or npos.
+inline std::size_t find_structural(std::string_view in, std::size_t pos,
+                                   Level level = kActiveLevel) {
+  switch (level) {
+#if GUCI_SIMD_X86
+    case Level::AVX2:
+      return avx2::find_structural(in.data(), pos, in.size());
+    case Level::SSE2:
+      return sse2::find_structural(in.data(), pos, in.size());
+#endif
+    default:
+      return scalar::find_structural(in.data(), pos, in.size());
+  }
+}
+
+// Position of the quote closing a string literal whose contents start at
+// `pos`, or npos if the literal is unterminated. The character following a
+// backslash is skipped without looking at it.
+inline std::size_t find_string_end(std::string_view in, std::size_t pos,
+                                   Level level = kActiveLevel) {
+  while (true) {
+    pos = find_either(in, pos, '"', '\\', level);
+    if (pos == std::string_view::npos or in[pos] == '"') return pos;
+    pos += 2;
+  }
+}
+
+// Position of the `close` that balances the `open` at `pos`, or npos.
+inline std::size_t find_matching_delimiter(std::string_view in,
+                                           std::size_t pos, char open,
+                                           char close,
+                                           Level level = kActiveLevel) {
+  if (pos >= in.size() or in[pos] != open) return std::string_view::npos;
+
+  int balance = 0;
+  while (pos != std::string_view::npos) {
+    balance += in[pos] == open ? 1 : -1;
+    if (balance == 0) return pos;
+    pos = find_either(in, pos + 1, open, close, level);
+  }
+  return pos;
+}
+
+}  // namespace guci::simd
@@ -0,0 +1,97 @@
+#include "guci/utils/simd_scan.hpp"
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "catch2/catch.hpp"
+
+namespace guci::simd {
+
+namespace {
+std::string random_input(std::mt19937& gen, std::string_view alphabet,
+                         std::size_t size) {
+  std::uniform_int_distribution<std::size_t> pick(0, alphabet.size() - 1);
+  std::string s(size, ' ');
+  for (auto& c : s) c = alphabet[pick(gen)];
+  return s;
+}
+
+std::vector<Level> levels() {
+  std::vector<Level> ls;
+  for (auto l : {Level::Scalar, Level::SSE2, Level::AVX2}) {
+    if (supported(l)) ls.push_back(l);
+  }
+  return ls;
+}
+
+// byte-at-a-time balancing, as in the original find_matching_delimiter
+std::size_t reference_matching_delimiter(std::string_view in, std::size_t pos,
+                                         char open, char close) {
+  if (pos >= in.size() or in[pos] != open) return std::string_view::npos;
+  int balance = 0;
+  for (auto i = pos; i < in.size(); ++i) {
+    if (in[i] == open) ++balance;
+    if (in[i] == close) --balance;
+    if (balance == 0) return i;
+  }
+  return std::string_view::npos;
+}
+
+std::size_t reference_string_end(std::string_view in, std::size_t pos) {
+  for (; pos < in.size(); ++pos) {
+    if (in[pos] == '"') return pos;
+    if (in[pos] == '\\') ++pos;
+  }
+  return std::string_view::npos;
+}
+}  // namespace
+
+TEST_CASE("kernels agree with the scalar reference", "[simd_scan]") {
+  std::mt19937 gen{42};
+  // skewed towards long runs so that the vector loops do real work
+  auto alphabet = GENERATE(as<std::string_view>{}, "     \t\n\na",
+                           "abcXYZ019_+-*/%^@?!<=>   ", "aaaaaaaaa\"\\",
+                           "xxxxxxx(((())))", "\x80\xff\x7f`@[{ az");
+
+  for (std::size_t size : {0u, 1u, 15u, 16u, 17u, 31u, 33u, 100u, 257u}) {
+    std::string const input = random_input(gen, alphabet, size);
+    for (std::size_t pos = 0; pos <= size; ++pos) {
+      auto const ws = scalar::skip_whitespace(input.data(), pos, size);
+      auto const id = scalar::skip_identifier_rest(input.data(), pos, size);
+      auto const q = scalar::find_either(input.data(), pos, size, '"', '\\');
+      auto const st = scalar::find_structural(input.data(), pos, size);
+      REQUIRE(find_string_end(input, pos, Level::Scalar) ==
+              reference_string_end(input, pos));
+      REQUIRE(find_matching_delimiter(input, pos, '(', ')', Level::Scalar) ==
+              reference_matching_delimiter(input, pos, '(', ')'));
+
+      for (Level level : levels()) {
+        INFO("size " << size << " pos " << pos << " level "
+                     << static_cast<int>(level));
+        REQUIRE(skip_whitespace(input, pos, level) == ws);
+        REQUIRE(skip_identifier_rest(input, pos, level) == id);
+        REQUIRE(find_either(input, pos, '"', '\\', level) == q);
+        REQUIRE(find_structural(input, pos, level) == st);
+        REQUIRE(find_string_end(input, pos, level) ==
+                reference_string_end(input, pos));
+        REQUIRE(find_matching_delimiter(input, pos, '(', ')', level) ==
+                reference_matching_delimiter(input, pos, '(', ')'));
+      }
+    }
+  }
+}
+
+TEST_CASE("identifier characters", "[simd_scan]") {
+  for (int c = 0; c < 256; ++c) {
+    std::string input(40, static_cast<char>(c));
+    auto const expected = has_class(static_cast<char>(c), kIdentifierRest)
+                              ? input.size()
+                              : 0;
+    for (Level level : levels()) {
+      REQUIRE(skip_identifier_rest(input, 0, level) == expected);
+    }
+  }
+}
+
+}  // namespace guci::simd
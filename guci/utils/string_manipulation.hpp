@@ -2,6 +2,8 @@
 
 #include <string_view>
 
+#include "guci/utils/simd_scan.hpp"
+
 inline std::string_view trim(std::string_view sv) {
   std::string_view whitespace = " \t";
 
@@ -39,25 +41,5 @@ inline int parse_digits(std::string_view in) {
 template <char expr_open, char expr_close>
 inline std::string_view::size_type find_matching_delimiter(
     std::string_view in, std::string_view::size_type pos) {
-  if (in[pos] != expr_open) return std::string_view::npos;
-
-  int balance = 0;
-
-  for (auto i = pos; i < in.size(); ++i) {
-    switch (in[i]) {
-      case expr_open:
-        ++balance;
-        break;
-      case expr_close:
-        --balance;
-        break;
-    }
-
-    if (balance == 0) {
-      return i;
-    }
-  }
-
-  return std::string_view::npos;
+  return guci::simd::find_matching_delimiter(in, pos, expr_open, expr_close);
 }
-
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+
+#include "guci/utils/outcome.hpp"
+
+namespace guci {
+
+// A stream socket bound to a path in the file system, either listening for
+// connections or connected.
+class UnixSocket {
+  int fd_ = -1;
+
+  explicit UnixSocket(int fd) : fd_{fd} {}
+
+  static std::error_code last_error() {
+    return {errno, std::generic_category()};
+  }
+
+  static outcome::result<sockaddr_un> address(std::string const& path) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof addr.sun_path) {
+      return std::make_error_code(std::errc::filename_too_long);
+    }
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    return addr;
+  }
+
+  static outcome::result<UnixSocket> open(int flags = 0) {
+    int const fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | flags, 0);
+    if (fd < 0) return last_error();
+    return UnixSocket{fd};
+  }
+
+ public:
+  // Listens on `path`, in place of a socket that may be left there from an
+  // earlier run. accept() does not wait for connections.
+  static outcome::result<UnixSocket> listen(std::string const& path) {
+    auto const addr = OUTCOME_TRYX(address(path));
+    struct stat st;
+    if (::stat(path.c_str(), &st) == 0 and S_ISSOCK(st.st_mode)) {
+      ::unlink(path.c_str());
+    }
+    UnixSocket s = OUTCOME_TRYX(open(SOCK_NONBLOCK));
+    auto const* sa = reinterpret_cast<sockaddr const*>(&addr);
+    if (::bind(s.fd_, sa, sizeof addr) != 0) return last_error();
+    if (::listen(s.fd_, SOMAXCONN) != 0) return last_error();
+    return s;
+  }
+
+  static outcome::result<UnixSocket> connect(std::string const& path) {
+    auto const addr = OUTCOME_TRYX(address(path));
+    UnixSocket s = OUTCOME_TRYX(open());
+    auto const* sa = reinterpret_cast<sockaddr const*>(&addr);
+    int r;
+    do {
+      r = ::connect(s.fd_, sa, sizeof addr);
+    } while (r != 0 and errno == EINTR);
+    if (r != 0) return last_error();
+    return s;
+  }
+
+  UnixSocket(UnixSocket&& other) : fd_{std::exchange(other.fd_, -1)} {}
+  UnixSocket& operator=(UnixSocket&& other) {
+    std::swap(fd_, other.fd_);
+    return *this;
+  }
+  UnixSocket(UnixSocket const&) = delete;
+  UnixSocket& operator=(UnixSocket const&) = delete;
+
+  ~UnixSocket() {
+    if (fd_ >= 0) ::close(fd_);
+  }
+
+  int fd() const { return fd_; }
+
+  // the next connection to a listening socket, if there is one; see read()
+  // for when there is none. Neither reads nor writes on it wait; see
+  // write_some().
+  outcome::result<UnixSocket> accept() const {
+    int fd;
+    do {
+      fd = ::accept4(fd_, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+    } while (fd < 0 and errno == EINTR);
+    if (fd < 0) return last_error();
+    return UnixSocket{fd};
+  }
+
+  // Reads what there is, up to `size` bytes, waiting for something unless
+  // `wait` is false; then errc::resource_unavailable_try_again if there is
+  // nothing. 0 bytes is the end of input.
+  outcome::result<std::size_t> read(char* data, std::size_t size,
+                                    bool wait = true) const {
+    ssize_t n;
+    do {
+      n = ::recv(fd_, data, size, wait ? 0 : MSG_DONTWAIT);
+    } while (n < 0 and errno == EINTR);
+    if (n < 0) return last_error();
+    return static_cast<std::size_t>(n);
+  }
+
+  // Writes as much of `data` as the socket takes without waiting and
+  // returns how much that was, or errc::resource_unavailable_try_again if it
+  // takes nothing.
+  outcome::result<std::size_t> write_some(std::string_view data) const {
+    ssize_t n;
+    do {
+      n = ::send(fd_, data.data(), data.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+    } while (n < 0 and errno == EINTR);
+    if (n < 0) return last_error();
+    return static_cast<std::size_t>(n);
+  }
+
+  // all of `data`, waiting for room unless the socket does not wait
+  outcome::result<void> write(std::string_view data) const {
+    while (not data.empty()) {
+      ssize_t const n = ::send(fd_, data.data(), data.size(), MSG_NOSIGNAL);
+      if (n < 0) {
+        if (errno == EINTR) continue;
+        return last_error();
+      }
+      data.remove_prefix(n);
+    }
+    return outcome::success();
+  }
+};
+
+}  // namespace guci
@@ -0,0 +1,283 @@
+#pragma once
+
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+#include <vector>
+
+namespace guci {
+
+// Memory for runtime values: the contents of lists and strings, and
+// closures. Blocks up to kMaxBlock bytes come from size classes, each a free
+// list over pages of its own, so a long session keeps reusing the same pages
+// instead of fragmenting the malloc heap; larger blocks go to operator new.
+//
+// Memory is reclaimed by reference counting alone: values free their blocks
+// when their last reference goes away, and no collector ever runs. Every
+// thread keeps a few free blocks of each class to itself and shares the rest
+// under the lock of the class. release_free_pages() counts the shared free
+// blocks of each page and unmaps the pages that hold nothing else; a class
+// also does that by itself once its shared free blocks have doubled since it
+// last did.
+class ValueHeap {
+ public:
+  static constexpr std::size_t kPageSize = 64 * 1024;
+  static constexpr std::array<std::uint32_t, 14> kClasses = {
+      16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048};
+  static constexpr std::size_t kMaxBlock = kClasses.back();
+
+  struct Stats {
+    std::uint64_t mapped_bytes = 0;
+    // blocks handed out and not given back to the shared free lists, which
+    // includes the free blocks other threads keep
+    std::uint64_t used_bytes = 0;
+    std::uint64_t large_allocations = 0;
+    std::uint64_t releases = 0;
+    std::uint64_t released_bytes = 0;
+  };
+
+ private:
+  struct Block {
+    Block* next;
+  };
+
+  struct FreeList {
+    Block* head = nullptr;
+    std::uint32_t size = 0;
+
+    void push(Block* b) {
+      b->next = head;
+      head = b;
+      ++size;
+    }
+    Block* pop() {
+      Block* const b = head;
+      head = b->next;
+      --size;
+      return b;
+    }
+  };
+
+  struct SizeClass {
+    std::mutex mutex;
+    FreeList free;
+    std::vector<void*> pages;
+    std::uint32_t release_at = 0;
+  };
+
+  static constexpr std::uint32_t kCacheLimit = 64;
+  static constexpr std::uint32_t kBatch = kCacheLimit / 2;
+
+  // The free blocks of one thread. It is trivially destructible so that
+  // values destroyed after the thread's destructors ran can still free
+  // themselves; by then `alive` is false and they go to the shared lists.
+  struct Cache {
+    std::array<FreeList, kClasses.size()> lists;
+    bool alive;
+  };
+
+  std::array<SizeClass, kClasses.size()> classes_;
+  std::atomic<std::uint64_t> large_allocations_{0};
+  std::atomic<std::uint64_t> releases_{0};
+  std::atomic<std::uint64_t> released_bytes_{0};
+
+  static std::size_t class_of(std::size_t size) {
+    return std::lower_bound(kClasses.begin(), kClasses.end(), size) -
+           kClasses.begin();
+  }
+
+  static std::uint32_t blocks_per_page(std::size_t c) {
+    return kPageSize / kClasses[c];
+  }
+
+  static Cache* cache() {
+    thread_local Cache cache{{}, false};
+    thread_local struct Owner {
+      Owner() { cache.alive = true; }
+      ~Owner() {
+        cache.alive = false;
+        ValueHeap& heap = ValueHeap::global();
+        for (std::size_t c = 0; c < kClasses.size(); ++c) {
+          heap.give_back(c, cache.lists[c], cache.lists[c].size);
+        }
+      }
+    } owner;
+    return cache.alive ? &cache : nullptr;
+  }
+
+  // a page aligned to its size, so that a block finds its page by masking
+  static void* map_page() {
+    void* p = ::mmap(nullptr, 2 * kPageSize, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) throw std::bad_alloc{};
+    auto const start = reinterpret_cast<std::uintptr_t>(p);
+    auto const aligned = (start + kPageSize - 1) & ~(kPageSize - 1);
+    if (aligned != start) ::munmap(p, aligned - start);
+    ::munmap(reinterpret_cast<void*>(aligned + kPageSize),
+             start + kPageSize - aligned);
+    return reinterpret_cast<void*>(aligned);
+  }
+
+  static std::uintptr_t page_of(Block const* b) {
+    return reinterpret_cast<std::uintptr_t>(b) & ~(kPageSize - 1);
+  }
+
+  // moves up to `n` blocks of class `c` from the shared list to `to`,
+  // mapping a page if there are none; the lock is held
+  void take(std::size_t c, FreeList& to, std::uint32_t n) {
+    SizeClass& sc = classes_[c];
+    if (sc.free.size == 0) {
+      auto* const page = static_cast<std::byte*>(map_page());
+      sc.pages.push_back(page);
+      for (std::uint32_t i = blocks_per_page(c); i-- > 0;) {
+        sc.free.push(reinterpret_cast<Block*>(page + i * kClasses[c]));
+      }
+    }
+    while (n-- > 0 and sc.free.size > 0) to.push(sc.free.pop());
+  }
+
+  void give_back(std::size_t c, FreeList& from, std::uint32_t n) {
+    SizeClass& sc = classes_[c];
+    std::lock_guard const lock{sc.mutex};
+    while (n-- > 0 and from.size > 0) sc.free.push(from.pop());
+    if (sc.free.size >= sc.release_at) release_free_pages(c);
+  }
+
+  // Counts the shared free blocks of class `c` page by page, then unmaps the
+  // pages all of whose blocks are free and drops their blocks from the list.
+  // The lock is held.
+  void release_free_pages(std::size_t c) {
+    SizeClass& sc = classes_[c];
+    std::unordered_map<std::uintptr_t, std::uint32_t> free_blocks;
+    for (Block* b = sc.free.head; b != nullptr; b = b->next) {
+      ++free_blocks[page_of(b)];
+    }
+
+    FreeList kept;
+    for (Block* b = sc.free.head; b != nullptr;) {
+      Block* const next = b->next;
+      if (free_blocks[page_of(b)] != blocks_per_page(c)) kept.push(b);
+      b = next;
+    }
+    sc.free = kept;
+
+    std::erase_if(sc.pages, [&](void* page) {
+      auto const it =
+          free_blocks.find(reinterpret_cast<std::uintptr_t>(page));
+      if (it == free_blocks.end() or it->second != blocks_per_page(c)) {
+        return false;
+      }
+      ::munmap(page, kPageSize);
+      released_bytes_.fetch_add(kPageSize, std::memory_order_relaxed);
+      return true;
+    });
+    sc.release_at = std::max(2 * sc.free.size, 4 * blocks_per_page(c));
+  }
+
+ public:
+  // Never destroyed, since values in static storage may be freed after every
+  // destructor it could run in.
+  static ValueHeap& global() {
+    static ValueHeap* const heap = new ValueHeap;
+    return *heap;
+  }
+
+  void* allocate(std::size_t size) {
+    if (size > kMaxBlock) {
+      large_allocations_.fetch_add(1, std::memory_order_relaxed);
+      return ::operator new(size);
+    }
+    std::size_t const c = class_of(size);
+    Cache* const local = cache();
+    if (local == nullptr) {
+      std::lock_guard const lock{classes_[c].mutex};
+      FreeList one;
+      take(c, one, 1);
+      return one.pop();
+    }
+    FreeList& list = local->lists[c];
+    if (list.size == 0) {
+      std::lock_guard const lock{classes_[c].mutex};
+      take(c, list, kBatch);
+    }
+    return list.pop();
+  }
+
+  // `size` is the one `p` was allocated with
+  void deallocate(void* p, std::size_t size) {
+    if (size > kMaxBlock) return ::operator delete(p);
+    std::size_t const c = class_of(size);
+    Cache* const local = cache();
+    if (local == nullptr) {
+      FreeList one;
+      one.push(static_cast<Block*>(p));
+      return give_back(c, one, 1);
+    }
+    FreeList& list = local->lists[c];
+    list.push(static_cast<Block*>(p));
+    if (list.size > kCacheLimit) give_back(c, list, kBatch);
+  }
+
+  // Gives the free blocks of the calling thread back and releases the free
+  // pages of every class; returns the number of bytes given back to the
+  // system.
+  std::uint64_t release_free_pages() {
+    releases_.fetch_add(1, std::memory_order_relaxed);
+    auto const before = released_bytes_.load(std::memory_order_relaxed);
+    Cache* const local = cache();
+    for (std::size_t c = 0; c < kClasses.size(); ++c) {
+      if (local != nullptr) {
+        give_back(c, local->lists[c], local->lists[c].size);
+      }
+      std::lock_guard const lock{classes_[c].mutex};
+      release_free_pages(c);
+    }
+    return released_bytes_.load(std::memory_order_relaxed) - before;
+  }
+
+  Stats stats() {
+    Stats s;
+    for (std::size_t c = 0; c < kClasses.size(); ++c) {
+      std::lock_guard const lock{classes_[c].mutex};
+      SizeClass const& sc = classes_[c];
+      s.mapped_bytes += sc.pages.size() * kPageSize;
+      s.used_bytes += (sc.pages.size() * blocks_per_page(c) - sc.free.size) *
+                      kClasses[c];
+    }
+    s.large_allocations = large_allocations_.load(std::memory_order_relaxed);
+    s.releases = releases_.load(std::memory_order_relaxed);
+    s.released_bytes = released_bytes_.load(std::memory_order_relaxed);
+    return s;
+  }
+};
+
+// Allocates from the value heap, for std::allocate_shared.
+template <typename T>
+struct ValueAllocator {
+  using value_type = T;
+
+  ValueAllocator() = default;
+  template <typename U>
+  ValueAllocator(ValueAllocator<U> const&) {}
+
+  T* allocate(std::size_t n) {
+    return static_cast<T*>(ValueHeap::global().allocate(n * sizeof(T)));
+  }
+  void deallocate(T* p, std::size_t n) {
+    ValueHeap::global().deallocate(p, n * sizeof(T));
+  }
+
+  template <typename U>
+  bool operator==(ValueAllocator<U> const&) const {
+    return true;
+  }
+};
+
+}  // namespace guci
@@ -0,0 +1,73 @@
+#include "guci/utils/value_heap.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "catch2/catch.hpp"
+
+namespace guci {
+
+TEST_CASE("blocks come from size classes and are reused", "[value_heap]") {
+  ValueHeap& heap = ValueHeap::global();
+
+  void* const a = heap.allocate(40);
+  REQUIRE(reinterpret_cast<std::uintptr_t>(a) % 16 == 0);
+  heap.deallocate(a, 40);
+  // 40 and 48 bytes share a class
+  void* const b = heap.allocate(48);
+  REQUIRE(b == a);
+  heap.deallocate(b, 48);
+
+  auto const large = heap.stats().large_allocations;
+  void* const c = heap.allocate(ValueHeap::kMaxBlock + 1);
+  REQUIRE(heap.stats().large_allocations == large + 1);
+  heap.deallocate(c, ValueHeap::kMaxBlock + 1);
+
+  auto shared = std::allocate_shared<std::uint64_t>(
+      ValueAllocator<std::uint64_t>{}, 7);
+  REQUIRE(*shared == 7);
+}
+
+TEST_CASE("empty pages are given back", "[value_heap]") {
+  ValueHeap& heap = ValueHeap::global();
+  std::size_t const per_page = ValueHeap::kPageSize / 256;
+
+  std::vector<void*> blocks;
+  for (std::size_t i = 0; i < 8 * per_page; ++i) {
+    blocks.push_back(heap.allocate(256));
+  }
+  auto const full = heap.stats();
+  REQUIRE(full.used_bytes >= 8 * ValueHeap::kPageSize);
+
+  // one block keeps its page
+  for (std::size_t i = 1; i < blocks.size(); ++i) {
+    heap.deallocate(blocks[i], 256);
+  }
+  heap.release_free_pages();
+  auto const after = heap.stats();
+  REQUIRE(after.mapped_bytes <= full.mapped_bytes - 7 * ValueHeap::kPageSize);
+  REQUIRE(after.released_bytes >= full.released_bytes +
+                                  7 * ValueHeap::kPageSize);
+  REQUIRE(after.releases == full.releases + 1);
+
+  heap.deallocate(blocks[0], 256);
+  REQUIRE(heap.release_free_pages() >= ValueHeap::kPageSize);
+}
+
+TEST_CASE("blocks may be freed by another thread", "[value_heap]") {
+  ValueHeap& heap = ValueHeap::global();
+  std::vector<void*> blocks;
+  for (int i = 0; i < 10000; ++i) blocks.push_back(heap.allocate(96));
+  auto const used = heap.stats().used_bytes;
+
+  // the other thread's free blocks are shared when it exits
+  std::thread{[&] {
+    for (void* b : blocks) heap.deallocate(b, 96);
+  }}.join();
+  REQUIRE(heap.stats().used_bytes <= used - 10000 * 96);
+  heap.release_free_pages();
+}
+
+}  // namespace guci
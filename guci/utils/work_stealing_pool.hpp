@@ -0,0 +1,188 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace guci {
+
+// Worker threads with a deque of tasks each. A worker runs the tasks it
+// submitted itself newest first and, once it has none, steals the oldest task
+// of another; other threads hand their tasks to the workers in turn. A thread
+// that waits for tasks runs queued ones in the meantime, see help_until(), so
+// tasks may wait for the tasks they submitted however few workers there are.
+class WorkStealingPool {
+ public:
+  using Task = std::function<void()>;
+
+  struct Stats {
+    std::uint64_t submitted = 0;
+    // tasks run by a thread other than the worker they were queued on
+    std::uint64_t stolen = 0;
+  };
+
+ private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  // the pool the calling thread works for, if any, and its queue there
+  inline static thread_local WorkStealingPool const* current_pool_ = nullptr;
+  inline static thread_local std::size_t current_queue_ = 0;
+
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::atomic<std::size_t> next_queue_{0};
+  std::atomic<std::size_t> queued_{0};
+  // bumped whenever a task is queued or done; sleepers wait for a change
+  std::atomic<std::uint64_t> events_{0};
+  std::atomic<std::size_t> sleepers_{0};
+  std::mutex sleep_mutex_;
+  std::condition_variable wake_;
+  std::atomic<bool> stopping_{false};
+  std::atomic<std::uint64_t> submitted_{0};
+  std::atomic<std::uint64_t> stolen_{0};
+  // last, so that the workers are gone before the rest
+  std::vector<std::jthread> workers_;
+
+  std::optional<std::size_t> own_queue() const {
+    if (current_pool_ != this) return std::nullopt;
+    return current_queue_;
+  }
+
+  std::optional<Task> take() {
+    auto const own = own_queue();
+    if (own) {
+      Queue& q = *queues_[*own];
+      std::lock_guard const lock{q.mutex};
+      if (not q.tasks.empty()) {
+        Task t = std::move(q.tasks.back());
+        q.tasks.pop_back();
+        return t;
+      }
+    }
+    auto const start = own ? *own + 1 : next_queue_.load();
+    for (std::size_t i = 0; i < queues_.size(); ++i) {
+      auto const index = (start + i) % queues_.size();
+      if (index == own) continue;
+      Queue& q = *queues_[index];
+      std::lock_guard const lock{q.mutex};
+      if (not q.tasks.empty()) {
+        Task t = std::move(q.tasks.front());
+        q.tasks.pop_front();
+        stolen_.fetch_add(1, std::memory_order_relaxed);
+        return t;
+      }
+    }
+    return std::nullopt;
+  }
+
+  void sleep(std::uint64_t seen) {
+    sleepers_.fetch_add(1);
+    {
+      std::unique_lock lock{sleep_mutex_};
+      wake_.wait(lock, [&] { return events_.load() != seen or stopping_; });
+    }
+    sleepers_.fetch_sub(1);
+  }
+
+ public:
+  explicit WorkStealingPool(std::size_t workers) {
+    workers = std::max<std::size_t>(workers, 1);
+    for (std::size_t i = 0; i < workers; ++i) {
+      queues_.push_back(std::make_unique<Queue>());
+    }
+    for (std::size_t i = 0; i < workers; ++i) {
+      workers_.emplace_back([this, i] {
+        current_pool_ = this;
+        current_queue_ = i;
+        help_until([&] { return stopping_ and queued_.load() == 0; });
+      });
+    }
+  }
+
+  // Runs the tasks still queued before returning.
+  ~WorkStealingPool() {
+    stopping_ = true;
+    notify();
+  }
+
+  WorkStealingPool(WorkStealingPool const&) = delete;
+  WorkStealingPool& operator=(WorkStealingPool const&) = delete;
+
+  // One worker per hardware thread but the one of the thread waiting for
+  // them, and at least one. Never destroyed, since tasks may still be
+  // running when the program exits.
+  static WorkStealingPool& global() {
+    static WorkStealingPool* const pool = new WorkStealingPool(
+        std::max(std::thread::hardware_concurrency(), 2u) - 1);
+    return *pool;
+  }
+
+  std::size_t workers() const { return workers_.size(); }
+  // tasks waiting for a thread
+  std::size_t queued() const { return queued_.load(std::memory_order_relaxed); }
+  // whether there is a task queued for each worker already
+  bool busy() const { return queued() >= workers(); }
+
+  void submit(Task task) {
+    auto const index = own_queue().value_or(
+        next_queue_.fetch_add(1, std::memory_order_relaxed) % queues_.size());
+    {
+      Queue& q = *queues_[index];
+      std::lock_guard const lock{q.mutex};
+      q.tasks.push_back(std::move(task));
+    }
+    queued_.fetch_add(1);
+    submitted_.fetch_add(1, std::memory_order_relaxed);
+    notify();
+  }
+
+  // Runs one queued task, if there is one.
+  bool run_one() {
+    std::optional<Task> task = take();
+    if (not task) return false;
+    queued_.fetch_sub(1);
+    (*task)();
+    notify();
+    return true;
+  }
+
+  // Runs queued tasks until `done()`, sleeping while there are none. Tasks
+  // that finish outside the pool call notify() to wake the threads waiting
+  // for them.
+  template <typename Done>
+  void help_until(Done done) {
+    while (not done()) {
+      auto const seen = events_.load();
+      if (run_one()) continue;
+      if (done()) return;
+      sleep(seen);
+    }
+  }
+
+  void notify() {
+    events_.fetch_add(1);
+    if (sleepers_.load() != 0) {
+      { std::lock_guard const lock{sleep_mutex_}; }
+      wake_.notify_all();
+    }
+  }
+
+  Stats stats() const {
+    return {submitted_.load(std::memory_order_relaxed),
+            stolen_.load(std::memory_order_relaxed)};
+  }
+};
+
+}  // namespace guci
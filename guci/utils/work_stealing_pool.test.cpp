@@ -0,0 +1,59 @@
+#include "guci/utils/work_stealing_pool.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+#include "catch2/catch.hpp"
+
+namespace guci {
+
+namespace {
+// fib(n), with fib(n - 1) left to whichever thread takes it first
+std::int64_t fib(WorkStealingPool& pool, int n) {
+  if (n < 2) return n;
+  auto const left = std::make_shared<std::atomic<std::int64_t>>(-1);
+  pool.submit([&pool, left, n] { *left = fib(pool, n - 1); });
+  std::int64_t const right = fib(pool, n - 2);
+  pool.help_until([&] { return *left >= 0; });
+  return *left + right;
+}
+}  // namespace
+
+TEST_CASE("every task runs once", "[work_stealing_pool]") {
+  WorkStealingPool pool{3};
+  REQUIRE(pool.workers() == 3);
+  std::atomic<int> runs{0};
+  for (int i = 0; i < 1000; ++i) pool.submit([&] { ++runs; });
+  pool.help_until([&] { return runs == 1000; });
+  REQUIRE(runs == 1000);
+  REQUIRE(pool.stats().submitted == 1000);
+}
+
+TEST_CASE("tasks wait for the tasks they submit", "[work_stealing_pool]") {
+  // fewer workers than tasks waiting at once
+  WorkStealingPool pool{1};
+  REQUIRE(fib(pool, 18) == 2584);
+
+  std::atomic<std::int64_t> result{-1};
+  pool.submit([&] { result = fib(pool, 15); });
+  pool.help_until([&] { return result >= 0; });
+  REQUIRE(result == 610);
+}
+
+TEST_CASE("idle workers steal queued tasks", "[work_stealing_pool]") {
+  WorkStealingPool pool{2};
+  std::atomic<int> done{0};
+  std::atomic<bool> finished{false};
+  // the worker that takes this one keeps its tasks queued, without helping
+  pool.submit([&] {
+    for (int i = 0; i < 100; ++i) pool.submit([&] { ++done; });
+    while (done < 100) std::this_thread::yield();
+    finished = true;
+  });
+  while (not finished) std::this_thread::yield();
+  REQUIRE(pool.stats().stolen >= 100);
+}
+
+}  // namespace guci